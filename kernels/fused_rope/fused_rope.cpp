@@ -1,7 +1,12 @@
 #include "kernel_operator.h"
 #include "fused_rope_bf16.h"
 #include "fused_rope_fp32.h"
+#include "fused_rope_paged.h"
+#include "fused_rope_paged_mla.h"
+#include "fused_rope_paged_int8.h"
 #include "../types.h"
+#include <stdexcept>
+#include <string>
 
 using namespace AscendC;
 using namespace FusedRope;
@@ -74,6 +79,355 @@ extern "C" __global__ __aicore__ void FusedRopeKernel(
 }
 
 
+template <typename T>
+__aicore__ inline void FusedRopePagedImpl(
+    GM_ADDR oldPositions, GM_ADDR newPositions, GM_ADDR keyCache, GM_ADDR slotMapping,
+    GM_ADDR cosSinCache, GM_ADDR shiftSegments, GM_ADDR invFreq, uint64_t coreNumUse, uint64_t numTokens,
+    uint64_t numHeads, uint64_t headSize, uint64_t rotaryDim,
+    uint64_t kLeadingDimension, uint64_t blockSize, uint64_t blockStride, uint64_t isNeoxStyle,
+    uint64_t frontCore, uint64_t tailCore,
+    uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+    uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+    uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+    uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop, uint64_t slotType,
+    uint64_t positionMode, uint64_t positionType, int64_t shiftDelta, uint64_t numSegments, TPipe* pipe)
+{
+    if (slotType == (uint64_t)kvcache_ops::AscendType::INT32) {
+        FusedRopePaged<T, int32_t> op;
+        op.Init(oldPositions, newPositions, keyCache, slotMapping, cosSinCache,
+                coreNumUse, numTokens,
+                numHeads, headSize, rotaryDim,
+                kLeadingDimension, blockSize, blockStride, isNeoxStyle,
+                frontCore, tailCore,
+                numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+                numTokensEachFrontCore, numTokensEachTailCore,
+                loopTimeEachFrontCore, loopTimeEachTailCore,
+                numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, pipe);
+        op.InitCosSin(invFreq, pipe);
+        op.InitPositions(positionMode, positionType, shiftDelta, shiftSegments, numSegments);
+        op.Process();
+    } else if (slotType == (uint64_t)kvcache_ops::AscendType::INT64) {
+        FusedRopePaged<T, int64_t> op;
+        op.Init(oldPositions, newPositions, keyCache, slotMapping, cosSinCache,
+                coreNumUse, numTokens,
+                numHeads, headSize, rotaryDim,
+                kLeadingDimension, blockSize, blockStride, isNeoxStyle,
+                frontCore, tailCore,
+                numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+                numTokensEachFrontCore, numTokensEachTailCore,
+                loopTimeEachFrontCore, loopTimeEachTailCore,
+                numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, pipe);
+        op.InitCosSin(invFreq, pipe);
+        op.InitPositions(positionMode, positionType, shiftDelta, shiftSegments, numSegments);
+        op.Process();
+    }
+}
+
+// In-place variant of FusedRopeKernel on the paged key cache: token i lives at
+// slotMapping[i] and is rotated from oldPositions[i] to newPositions[i]. Tokens with slot -1 are skipped.
+// positionMode (RopePositionMode) may replace the per-token positions with shiftDelta or the
+// shiftSegments table, positionType selects int64 or int32 per-token positions.
+// With a non-null invFreq, cos/sin are generated in-kernel and cosSinCache is not read.
+extern "C" __global__ __aicore__ void FusedRopePagedKernel(
+    GM_ADDR oldPositions, GM_ADDR newPositions, GM_ADDR keyCache, GM_ADDR slotMapping,
+    GM_ADDR cosSinCache, GM_ADDR shiftSegments, GM_ADDR invFreq, uint64_t coreNumUse, uint64_t numTokens,
+    uint64_t numHeads, uint64_t headSize, uint64_t rotaryDim,
+    uint64_t kLeadingDimension, uint64_t blockSize, uint64_t blockStride, uint64_t isNeoxStyle,
+    uint64_t frontCore, uint64_t tailCore,
+    uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+    uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+    uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+    uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop, uint64_t tilingKey, uint64_t slotType,
+    uint64_t positionMode, uint64_t positionType, int64_t shiftDelta, uint64_t numSegments)
+{
+    TPipe pipe;
+#if (ASCEND_AICORE_ARCH >= 220)
+    // DT_BF16
+    if (tilingKey == (uint64_t)kvcache_ops::AscendType::BF16) {
+        FusedRopePagedImpl<bfloat16_t>(
+            oldPositions, newPositions, keyCache, slotMapping, cosSinCache, shiftSegments, invFreq, coreNumUse, numTokens,
+            numHeads, headSize, rotaryDim, kLeadingDimension, blockSize, blockStride, isNeoxStyle,
+            frontCore, tailCore, numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+            numTokensEachFrontCore, numTokensEachTailCore, loopTimeEachFrontCore, loopTimeEachTailCore,
+            numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, slotType,
+            positionMode, positionType, shiftDelta, numSegments, &pipe);
+    }
+#endif
+    // DT_FLOAT16
+    if (tilingKey == (uint64_t)kvcache_ops::AscendType::FP16) {
+        FusedRopePagedImpl<half>(
+            oldPositions, newPositions, keyCache, slotMapping, cosSinCache, shiftSegments, invFreq, coreNumUse, numTokens,
+            numHeads, headSize, rotaryDim, kLeadingDimension, blockSize, blockStride, isNeoxStyle,
+            frontCore, tailCore, numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+            numTokensEachFrontCore, numTokensEachTailCore, loopTimeEachFrontCore, loopTimeEachTailCore,
+            numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, slotType,
+            positionMode, positionType, shiftDelta, numSegments, &pipe);
+    }
+    // DT_FLOAT
+    if (tilingKey == (uint64_t)kvcache_ops::AscendType::FP32) {
+        FusedRopePagedImpl<float>(
+            oldPositions, newPositions, keyCache, slotMapping, cosSinCache, shiftSegments, invFreq, coreNumUse, numTokens,
+            numHeads, headSize, rotaryDim, kLeadingDimension, blockSize, blockStride, isNeoxStyle,
+            frontCore, tailCore, numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+            numTokensEachFrontCore, numTokensEachTailCore, loopTimeEachFrontCore, loopTimeEachTailCore,
+            numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, slotType,
+            positionMode, positionType, shiftDelta, numSegments, &pipe);
+    }
+}
+
+
+template <typename T>
+__aicore__ inline void FusedRopePagedMLAImpl(
+    GM_ADDR oldPositions, GM_ADDR newPositions, GM_ADDR mlaKVCaches, GM_ADDR slotMapping,
+    GM_ADDR cosSinCache, GM_ADDR shiftSegments, GM_ADDR invFreq, uint64_t coreNumUse, uint64_t numTokens,
+    uint64_t ropeDim, uint64_t blockSize, uint64_t isNeoxStyle,
+    uint64_t frontCore, uint64_t tailCore,
+    uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+    uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+    uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+    uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop, uint64_t slotType,
+    uint64_t positionMode, uint64_t positionType, int64_t shiftDelta, uint64_t numSegments, TPipe* pipe)
+{
+    if (slotType == (uint64_t)kvcache_ops::AscendType::INT32) {
+        FusedRopePagedMLA<T, int32_t> op;
+        op.Init(oldPositions, newPositions, mlaKVCaches, slotMapping, cosSinCache,
+                coreNumUse, numTokens, ropeDim, blockSize, isNeoxStyle,
+                frontCore, tailCore,
+                numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+                numTokensEachFrontCore, numTokensEachTailCore,
+                loopTimeEachFrontCore, loopTimeEachTailCore,
+                numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, pipe);
+        op.InitCosSin(invFreq, pipe);
+        op.InitPositions(positionMode, positionType, shiftDelta, shiftSegments, numSegments);
+        op.Process();
+    } else if (slotType == (uint64_t)kvcache_ops::AscendType::INT64) {
+        FusedRopePagedMLA<T, int64_t> op;
+        op.Init(oldPositions, newPositions, mlaKVCaches, slotMapping, cosSinCache,
+                coreNumUse, numTokens, ropeDim, blockSize, isNeoxStyle,
+                frontCore, tailCore,
+                numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+                numTokensEachFrontCore, numTokensEachTailCore,
+                loopTimeEachFrontCore, loopTimeEachTailCore,
+                numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, pipe);
+        op.InitCosSin(invFreq, pipe);
+        op.InitPositions(positionMode, positionType, shiftDelta, shiftSegments, numSegments);
+        op.Process();
+    }
+}
+
+// FusedRopePagedKernel for the decoupled rope keys of an MLA cache: mlaKVCaches is the [kv_c, k_pe]
+// pointer pair of one layer and only k_pe, [numBlocks, blockSize, ropeDim], is re-rotated.
+extern "C" __global__ __aicore__ void FusedRopePagedMLAKernel(
+    GM_ADDR oldPositions, GM_ADDR newPositions, GM_ADDR mlaKVCaches, GM_ADDR slotMapping,
+    GM_ADDR cosSinCache, GM_ADDR shiftSegments, GM_ADDR invFreq, uint64_t coreNumUse, uint64_t numTokens,
+    uint64_t ropeDim, uint64_t blockSize, uint64_t isNeoxStyle,
+    uint64_t frontCore, uint64_t tailCore,
+    uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+    uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+    uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+    uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop, uint64_t tilingKey, uint64_t slotType,
+    uint64_t positionMode, uint64_t positionType, int64_t shiftDelta, uint64_t numSegments)
+{
+    TPipe pipe;
+#if (ASCEND_AICORE_ARCH >= 220)
+    // DT_BF16
+    if (tilingKey == (uint64_t)kvcache_ops::AscendType::BF16) {
+        FusedRopePagedMLAImpl<bfloat16_t>(
+            oldPositions, newPositions, mlaKVCaches, slotMapping, cosSinCache, shiftSegments, invFreq, coreNumUse, numTokens,
+            ropeDim, blockSize, isNeoxStyle,
+            frontCore, tailCore, numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+            numTokensEachFrontCore, numTokensEachTailCore, loopTimeEachFrontCore, loopTimeEachTailCore,
+            numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, slotType,
+            positionMode, positionType, shiftDelta, numSegments, &pipe);
+    }
+#endif
+    // DT_FLOAT16
+    if (tilingKey == (uint64_t)kvcache_ops::AscendType::FP16) {
+        FusedRopePagedMLAImpl<half>(
+            oldPositions, newPositions, mlaKVCaches, slotMapping, cosSinCache, shiftSegments, invFreq, coreNumUse, numTokens,
+            ropeDim, blockSize, isNeoxStyle,
+            frontCore, tailCore, numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+            numTokensEachFrontCore, numTokensEachTailCore, loopTimeEachFrontCore, loopTimeEachTailCore,
+            numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, slotType,
+            positionMode, positionType, shiftDelta, numSegments, &pipe);
+    }
+    // DT_FLOAT
+    if (tilingKey == (uint64_t)kvcache_ops::AscendType::FP32) {
+        FusedRopePagedMLAImpl<float>(
+            oldPositions, newPositions, mlaKVCaches, slotMapping, cosSinCache, shiftSegments, invFreq, coreNumUse, numTokens,
+            ropeDim, blockSize, isNeoxStyle,
+            frontCore, tailCore, numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+            numTokensEachFrontCore, numTokensEachTailCore, loopTimeEachFrontCore, loopTimeEachTailCore,
+            numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, slotType,
+            positionMode, positionType, shiftDelta, numSegments, &pipe);
+    }
+}
+
+
+template <typename T>
+__aicore__ inline void FusedRopePagedLayersImpl(
+    GM_ADDR oldPositions, GM_ADDR newPositions, GM_ADDR layerKVCaches, GM_ADDR slotMapping,
+    GM_ADDR cosSinCache, GM_ADDR shiftSegments, GM_ADDR invFreq, uint64_t coreNumUse, uint64_t numTokens,
+    uint64_t numLayers, uint64_t kvCacheFormat,
+    uint64_t numHeads, uint64_t headSize, uint64_t rotaryDim,
+    uint64_t kLeadingDimension, uint64_t blockSize, uint64_t blockStride, uint64_t isNeoxStyle,
+    uint64_t frontCore, uint64_t tailCore,
+    uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+    uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+    uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+    uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop, uint64_t slotType,
+    uint64_t positionMode, uint64_t positionType, int64_t shiftDelta, uint64_t numSegments, TPipe* pipe)
+{
+    if (slotType == (uint64_t)kvcache_ops::AscendType::INT32) {
+        FusedRopePaged<T, int32_t> op;
+        op.Init(oldPositions, newPositions, nullptr, slotMapping, cosSinCache,
+                coreNumUse, numTokens,
+                numHeads, headSize, rotaryDim,
+                kLeadingDimension, blockSize, blockStride, isNeoxStyle,
+                frontCore, tailCore,
+                numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+                numTokensEachFrontCore, numTokensEachTailCore,
+                loopTimeEachFrontCore, loopTimeEachTailCore,
+                numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, pipe);
+        op.InitLayers(layerKVCaches, numLayers, kvCacheFormat);
+        op.InitCosSin(invFreq, pipe);
+        op.InitPositions(positionMode, positionType, shiftDelta, shiftSegments, numSegments);
+        op.Process();
+    } else if (slotType == (uint64_t)kvcache_ops::AscendType::INT64) {
+        FusedRopePaged<T, int64_t> op;
+        op.Init(oldPositions, newPositions, nullptr, slotMapping, cosSinCache,
+                coreNumUse, numTokens,
+                numHeads, headSize, rotaryDim,
+                kLeadingDimension, blockSize, blockStride, isNeoxStyle,
+                frontCore, tailCore,
+                numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+                numTokensEachFrontCore, numTokensEachTailCore,
+                loopTimeEachFrontCore, loopTimeEachTailCore,
+                numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, pipe);
+        op.InitLayers(layerKVCaches, numLayers, kvCacheFormat);
+        op.InitCosSin(invFreq, pipe);
+        op.InitPositions(positionMode, positionType, shiftDelta, shiftSegments, numSegments);
+        op.Process();
+    }
+}
+
+// FusedRopePagedKernel over the key caches of numLayers layers in one launch. layerKVCaches is the
+// per-layer pointer table of kvCacheFormat, see FusedRopePaged::InitLayers.
+extern "C" __global__ __aicore__ void FusedRopePagedLayersKernel(
+    GM_ADDR oldPositions, GM_ADDR newPositions, GM_ADDR layerKVCaches, GM_ADDR slotMapping,
+    GM_ADDR cosSinCache, GM_ADDR shiftSegments, GM_ADDR invFreq, uint64_t coreNumUse, uint64_t numTokens,
+    uint64_t numLayers, uint64_t kvCacheFormat,
+    uint64_t numHeads, uint64_t headSize, uint64_t rotaryDim,
+    uint64_t kLeadingDimension, uint64_t blockSize, uint64_t blockStride, uint64_t isNeoxStyle,
+    uint64_t frontCore, uint64_t tailCore,
+    uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+    uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+    uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+    uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop, uint64_t tilingKey, uint64_t slotType,
+    uint64_t positionMode, uint64_t positionType, int64_t shiftDelta, uint64_t numSegments)
+{
+    TPipe pipe;
+#if (ASCEND_AICORE_ARCH >= 220)
+    // DT_BF16
+    if (tilingKey == (uint64_t)kvcache_ops::AscendType::BF16) {
+        FusedRopePagedLayersImpl<bfloat16_t>(
+            oldPositions, newPositions, layerKVCaches, slotMapping, cosSinCache, shiftSegments, invFreq,
+            coreNumUse, numTokens, numLayers, kvCacheFormat,
+            numHeads, headSize, rotaryDim, kLeadingDimension, blockSize, blockStride, isNeoxStyle,
+            frontCore, tailCore, numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+            numTokensEachFrontCore, numTokensEachTailCore, loopTimeEachFrontCore, loopTimeEachTailCore,
+            numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, slotType,
+            positionMode, positionType, shiftDelta, numSegments, &pipe);
+    }
+#endif
+    // DT_FLOAT16
+    if (tilingKey == (uint64_t)kvcache_ops::AscendType::FP16) {
+        FusedRopePagedLayersImpl<half>(
+            oldPositions, newPositions, layerKVCaches, slotMapping, cosSinCache, shiftSegments, invFreq,
+            coreNumUse, numTokens, numLayers, kvCacheFormat,
+            numHeads, headSize, rotaryDim, kLeadingDimension, blockSize, blockStride, isNeoxStyle,
+            frontCore, tailCore, numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+            numTokensEachFrontCore, numTokensEachTailCore, loopTimeEachFrontCore, loopTimeEachTailCore,
+            numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, slotType,
+            positionMode, positionType, shiftDelta, numSegments, &pipe);
+    }
+    // DT_FLOAT
+    if (tilingKey == (uint64_t)kvcache_ops::AscendType::FP32) {
+        FusedRopePagedLayersImpl<float>(
+            oldPositions, newPositions, layerKVCaches, slotMapping, cosSinCache, shiftSegments, invFreq,
+            coreNumUse, numTokens, numLayers, kvCacheFormat,
+            numHeads, headSize, rotaryDim, kLeadingDimension, blockSize, blockStride, isNeoxStyle,
+            frontCore, tailCore, numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+            numTokensEachFrontCore, numTokensEachTailCore, loopTimeEachFrontCore, loopTimeEachTailCore,
+            numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, slotType,
+            positionMode, positionType, shiftDelta, numSegments, &pipe);
+    }
+}
+
+
+template <typename slot_t>
+__aicore__ inline void FusedRopePagedInt8Impl(
+    GM_ADDR oldPositions, GM_ADDR newPositions, GM_ADDR keyCache, GM_ADDR keyScales, GM_ADDR slotMapping,
+    GM_ADDR cosSinCache, GM_ADDR shiftSegments, GM_ADDR invFreq, uint64_t coreNumUse, uint64_t numTokens,
+    uint64_t numHeads, uint64_t headSize, uint64_t rotaryDim,
+    uint64_t kLeadingDimension, uint64_t blockSize, uint64_t blockStride, uint64_t isNeoxStyle,
+    uint64_t updateScales, uint64_t frontCore, uint64_t tailCore,
+    uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+    uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+    uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+    uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop,
+    uint64_t positionMode, uint64_t positionType, int64_t shiftDelta, uint64_t numSegments, TPipe* pipe)
+{
+    FusedRopePagedInt8<slot_t> op;
+    op.Init(oldPositions, newPositions, keyCache, keyScales, slotMapping, cosSinCache,
+            coreNumUse, numTokens,
+            numHeads, headSize, rotaryDim,
+            kLeadingDimension, blockSize, blockStride, isNeoxStyle, updateScales,
+            frontCore, tailCore,
+            numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+            numTokensEachFrontCore, numTokensEachTailCore,
+            loopTimeEachFrontCore, loopTimeEachTailCore,
+            numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, pipe);
+    op.InitCosSin(invFreq, pipe);
+    op.InitPositions(positionMode, positionType, shiftDelta, shiftSegments, numSegments);
+    op.Process();
+}
+
+// FusedRopePagedKernel for an int8 key cache with per (token, head) float scales, the keys are
+// dequantized, rotated and requantized on chip. cosSinCache must be float.
+extern "C" __global__ __aicore__ void FusedRopePagedInt8Kernel(
+    GM_ADDR oldPositions, GM_ADDR newPositions, GM_ADDR keyCache, GM_ADDR keyScales, GM_ADDR slotMapping,
+    GM_ADDR cosSinCache, GM_ADDR shiftSegments, GM_ADDR invFreq, uint64_t coreNumUse, uint64_t numTokens,
+    uint64_t numHeads, uint64_t headSize, uint64_t rotaryDim,
+    uint64_t kLeadingDimension, uint64_t blockSize, uint64_t blockStride, uint64_t isNeoxStyle,
+    uint64_t updateScales, uint64_t frontCore, uint64_t tailCore,
+    uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+    uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+    uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+    uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop, uint64_t slotType,
+    uint64_t positionMode, uint64_t positionType, int64_t shiftDelta, uint64_t numSegments)
+{
+    TPipe pipe;
+    if (slotType == (uint64_t)kvcache_ops::AscendType::INT32) {
+        FusedRopePagedInt8Impl<int32_t>(
+            oldPositions, newPositions, keyCache, keyScales, slotMapping, cosSinCache, shiftSegments, invFreq,
+            coreNumUse, numTokens, numHeads, headSize, rotaryDim, kLeadingDimension, blockSize, blockStride,
+            isNeoxStyle, updateScales, frontCore, tailCore, numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+            numTokensEachFrontCore, numTokensEachTailCore, loopTimeEachFrontCore, loopTimeEachTailCore,
+            numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop,
+            positionMode, positionType, shiftDelta, numSegments, &pipe);
+    } else if (slotType == (uint64_t)kvcache_ops::AscendType::INT64) {
+        FusedRopePagedInt8Impl<int64_t>(
+            oldPositions, newPositions, keyCache, keyScales, slotMapping, cosSinCache, shiftSegments, invFreq,
+            coreNumUse, numTokens, numHeads, headSize, rotaryDim, kLeadingDimension, blockSize, blockStride,
+            isNeoxStyle, updateScales, frontCore, tailCore, numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+            numTokensEachFrontCore, numTokensEachTailCore, loopTimeEachFrontCore, loopTimeEachTailCore,
+            numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop,
+            positionMode, positionType, shiftDelta, numSegments, &pipe);
+    }
+}
+
+
 namespace kvcache_ops {
     extern void rotary_embedding_kernel_dispatch(
         uint64_t blockDim, void* stream, uint8_t* oldPositions,
@@ -98,4 +452,125 @@ namespace kvcache_ops {
             tilingKey
         );
     }
+
+    extern void rotary_embedding_paged_kernel_dispatch(
+        uint64_t blockDim, void* stream, uint8_t* oldPositions,
+        uint8_t* newPositions, uint8_t* keyCache, uint8_t* slotMapping, uint8_t* cosSinCache,
+        uint8_t* shiftSegments, uint8_t* invFreq,
+        uint64_t numTokens, uint64_t numHeads,
+        uint64_t headSize, uint64_t rotaryDim, uint64_t kLeadingDimension,
+        uint64_t blockSize, uint64_t blockStride,
+        uint64_t isNeoxStyle, uint64_t frontCore, uint64_t tailCore,
+        uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+        uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+        uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+        uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop,
+        uint64_t tilingKey, uint64_t slotType,
+        uint64_t positionMode, uint64_t positionType, int64_t shiftDelta, uint64_t numSegments)
+    {
+        FusedRopePagedKernel<<<blockDim, nullptr, stream>>>(
+            oldPositions, newPositions, keyCache, slotMapping,
+            cosSinCache, shiftSegments, invFreq, blockDim, numTokens,
+            numHeads, headSize, rotaryDim,
+            kLeadingDimension, blockSize, blockStride, isNeoxStyle, frontCore,
+            tailCore, numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+            numTokensEachFrontCore, numTokensEachTailCore, loopTimeEachFrontCore,
+            loopTimeEachTailCore, numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop,
+            tilingKey, slotType, positionMode, positionType, shiftDelta, numSegments
+        );
+    }
+
+    extern void rotary_embedding_paged_mla_kernel_dispatch(
+        uint64_t blockDim, void* stream, uint8_t* oldPositions,
+        uint8_t* newPositions, uint8_t* mlaKVCaches, uint8_t* slotMapping, uint8_t* cosSinCache,
+        uint8_t* shiftSegments, uint8_t* invFreq,
+        uint64_t numTokens, uint64_t ropeDim, uint64_t blockSize,
+        uint64_t isNeoxStyle, uint64_t frontCore, uint64_t tailCore,
+        uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+        uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+        uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+        uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop,
+        uint64_t tilingKey, uint64_t slotType,
+        uint64_t positionMode, uint64_t positionType, int64_t shiftDelta, uint64_t numSegments)
+    {
+        FusedRopePagedMLAKernel<<<blockDim, nullptr, stream>>>(
+            oldPositions, newPositions, mlaKVCaches, slotMapping,
+            cosSinCache, shiftSegments, invFreq, blockDim, numTokens,
+            ropeDim, blockSize, isNeoxStyle, frontCore,
+            tailCore, numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+            numTokensEachFrontCore, numTokensEachTailCore, loopTimeEachFrontCore,
+            loopTimeEachTailCore, numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop,
+            tilingKey, slotType, positionMode, positionType, shiftDelta, numSegments
+        );
+    }
+
+    extern void rotary_embedding_paged_layers_kernel_dispatch(
+        uint64_t blockDim, void* stream, uint8_t* oldPositions,
+        uint8_t* newPositions, uint8_t* layerKVCaches, uint8_t* slotMapping, uint8_t* cosSinCache,
+        uint8_t* shiftSegments, uint8_t* invFreq,
+        uint64_t numTokens, uint64_t numLayers, KVCacheFormat kvCacheFormat, uint64_t numHeads,
+        uint64_t headSize, uint64_t rotaryDim, uint64_t kLeadingDimension,
+        uint64_t blockSize, uint64_t blockStride,
+        uint64_t isNeoxStyle, uint64_t frontCore, uint64_t tailCore,
+        uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+        uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+        uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+        uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop,
+        uint64_t tilingKey, uint64_t slotType,
+        uint64_t positionMode, uint64_t positionType, int64_t shiftDelta, uint64_t numSegments)
+    {
+        if (kvCacheFormat != KVCacheFormat::MERGED_KV && kvCacheFormat != KVCacheFormat::SEPARATE_KV &&
+            kvCacheFormat != KVCacheFormat::MLA_KV) {
+            ASCENDC_REPORT_NOT_SUPPORT(false, "Unsupported KVCacheFormat for multi-layer rope.");
+            throw std::runtime_error("KVCacheFormat: " + std::to_string(static_cast<int>(kvCacheFormat)) +
+                                     " not supported for multi-layer rope.");
+        }
+        FusedRopePagedLayersKernel<<<blockDim, nullptr, stream>>>(
+            oldPositions, newPositions, layerKVCaches, slotMapping,
+            cosSinCache, shiftSegments, invFreq, blockDim, numTokens,
+            numLayers, static_cast<uint64_t>(kvCacheFormat),
+            numHeads, headSize, rotaryDim,
+            kLeadingDimension, blockSize, blockStride, isNeoxStyle, frontCore,
+            tailCore, numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+            numTokensEachFrontCore, numTokensEachTailCore, loopTimeEachFrontCore,
+            loopTimeEachTailCore, numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop,
+            tilingKey, slotType, positionMode, positionType, shiftDelta, numSegments
+        );
+    }
+
+    extern void rotary_embedding_paged_int8_kernel_dispatch(
+        uint64_t blockDim, void* stream, uint8_t* oldPositions,
+        uint8_t* newPositions, uint8_t* keyCache, uint8_t* keyScales, uint8_t* slotMapping, uint8_t* cosSinCache,
+        uint8_t* shiftSegments, uint8_t* invFreq,
+        uint64_t numTokens, uint64_t numHeads,
+        uint64_t headSize, uint64_t rotaryDim, uint64_t kLeadingDimension,
+        uint64_t blockSize, uint64_t blockStride,
+        uint64_t isNeoxStyle, uint64_t updateScales, uint64_t frontCore, uint64_t tailCore,
+        uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+        uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+        uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+        uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop,
+        uint64_t slotType,
+        uint64_t positionMode, uint64_t positionType, int64_t shiftDelta, uint64_t numSegments)
+    {
+        if ((numHeads * headSize) % 32 != 0) {
+            ASCENDC_REPORT_NOT_SUPPORT(false, "numHeads * headSize must be a multiple of 32 for int8 rope.");
+            throw std::runtime_error("numHeads * headSize: " + std::to_string(numHeads * headSize) +
+                                     " not supported for int8 rope.");
+        }
+        if (headSize % 8 != 0 || headSize > FusedRope::FusedRopePagedInt8<int32_t>::MAX_HEAD_SIZE) {
+            ASCENDC_REPORT_NOT_SUPPORT(false, "headSize must be a multiple of 8 up to 2040 for int8 rope.");
+            throw std::runtime_error("headSize: " + std::to_string(headSize) + " not supported for int8 rope.");
+        }
+        FusedRopePagedInt8Kernel<<<blockDim, nullptr, stream>>>(
+            oldPositions, newPositions, keyCache, keyScales, slotMapping,
+            cosSinCache, shiftSegments, invFreq, blockDim, numTokens,
+            numHeads, headSize, rotaryDim,
+            kLeadingDimension, blockSize, blockStride, isNeoxStyle, updateScales, frontCore,
+            tailCore, numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+            numTokensEachFrontCore, numTokensEachTailCore, loopTimeEachFrontCore,
+            loopTimeEachTailCore, numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop,
+            slotType, positionMode, positionType, shiftDelta, numSegments
+        );
+    }
 }
\ No newline at end of file
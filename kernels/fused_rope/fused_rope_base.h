@@ -23,6 +23,11 @@ public:
                     uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop);
 
 protected:
+    // GPT-J style: byte offsets that gather one [x1 | x2] row of rotaryDim floats back into interleaved
+    // pairs, offset[2 * i + j] = (j * rotaryDim / 2 + i) * 4. Gather takes one offset per element it
+    // writes, so the row is gathered once per tile row.
+    __aicore__ inline void InitInterleaveOffsets(const LocalTensor<uint32_t>& offsetLocal);
+
     uint32_t blockIdx_;
     uint64_t coreNumUse;
     uint64_t numTokens;
@@ -70,6 +75,16 @@ __aicore__ inline void FusedRopeBase<T>::InitData(uint64_t coreNumUse, uint64_t
         blockIdx_ < frontCore) ? numTokensFrontCoreLastLoop : numTokensTailCoreLastLoop;
 }
 
+template <typename T>
+__aicore__ inline void FusedRopeBase<T>::InitInterleaveOffsets(const LocalTensor<uint32_t>& offsetLocal)
+{
+    for (uint32_t i = 0; i < rotaryDim / 2; i++) {
+        offsetLocal.SetValue(i * 2, i * 4);
+        offsetLocal.SetValue(i * 2 + 1, (rotaryDim / 2 + i) * 4);
+    }
+    PipeBarrier<PIPE_ALL>();
+}
+
 }
 
 #endif
\ No newline at end of file
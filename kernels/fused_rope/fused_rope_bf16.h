@@ -134,6 +134,7 @@ __aicore__ inline void FusedRopeFP16<T>::Init(
         pipe->InitBuffer(offsetBuf, this->rotaryDim * sizeof(uint32_t));
         pipe->InitBuffer(
             temp1, this->numTokensEachLoopCurrentCore * numHeadsMax * this->rotaryDim * sizeof(float));
+        this->InitInterleaveOffsets(offsetBuf.Get<uint32_t>());
     } else {
         pipe->InitBuffer(offsetBuf, 0 * sizeof(uint32_t));
         pipe->InitBuffer(temp1, 0 * sizeof(float));
@@ -301,17 +302,13 @@ __aicore__ inline void FusedRopeFP16<T>::Rope(
     PipeBarrier<PIPE_V>();
 
     if (this->isNeoxStyle == 0) {
-        for (uint32_t i = 0; i < this->rotaryDim / 2; i++) {
-            offsetLocal.SetValue(i * 2, i * 4);
-            offsetLocal.SetValue(i * 2 + 1, (this->rotaryDim / 2 + i) * 4);
-        }
-
+        // re-interleave row by row with the one-row offsets built in Init
         for (uint32_t i = 0; i < loopN * this->numHeads; i++) {
             Gather(
                 temp1Local[i * this->rotaryDim], inLocal[i * this->rotaryDim], offsetLocal, (uint32_t)0,
                 this->rotaryDim);
-            PipeBarrier<PIPE_V>();
         }
+        PipeBarrier<PIPE_V>();
         #if ASCEND_AICORE_ARCH >= 220
             Cast(
                 inQueCalLocal, temp1Local, AscendC::RoundMode::CAST_RINT,
@@ -377,17 +374,23 @@ __aicore__ inline void FusedRopeFP16<T>::Compute(uint64_t index, uint64_t loopN)
             temp1Local, inQueCalLocal, AscendC::RoundMode::CAST_NONE,
             static_cast<uint16_t>(loopN * this->numHeads * this->rotaryDim));
         PipeBarrier<PIPE_V>();
+        // de-interleave the whole tile: all even / odd elements first, then place them as [x1 | x2] rows
         uint64_t rsv = 0;
-        for (uint32_t i = 0; i < loopN * this->numHeads; i++) {
-            GatherMask(
-                inLocal[i * this->rotaryDim], temp1Local[i * this->rotaryDim], static_cast<uint8_t>(1), true,
-                this->rotaryDim, {1, 1, 8, 0}, rsv);
-            PipeBarrier<PIPE_ALL>();
-            GatherMask(
-                inLocal[i * this->rotaryDim + this->rotaryDim / 2], temp1Local[i * this->rotaryDim],
-                static_cast<uint8_t>(2), true, this->rotaryDim, {1, 1, 8, 0}, rsv);
-            PipeBarrier<PIPE_ALL>();
-        }
+        uint64_t halfCount = loopN * this->numHeads * this->rotaryDim / 2;
+        GatherMask(
+            reverseQ, temp1Local, static_cast<uint8_t>(1), true,
+            static_cast<uint32_t>(loopN * this->numHeads * this->rotaryDim), {1, 1, 8, 0}, rsv);
+        GatherMask(
+            reverseQ[halfCount], temp1Local, static_cast<uint8_t>(2), true,
+            static_cast<uint32_t>(loopN * this->numHeads * this->rotaryDim), {1, 1, 8, 0}, rsv);
+        PipeBarrier<PIPE_ALL>();
+        DataCopy(
+            inLocal, reverseQ,
+            {static_cast<uint16_t>(loopN * this->numHeads), calBlockLen, 0, calBlockLen});
+        DataCopy(
+            inLocal[this->rotaryDim / 2], reverseQ[halfCount],
+            {static_cast<uint16_t>(loopN * this->numHeads), calBlockLen, 0, calBlockLen});
+        PipeBarrier<PIPE_ALL>();
     } else {
         Cast(
             inLocal, inQueCalLocal, AscendC::RoundMode::CAST_NONE,
@@ -120,6 +120,7 @@ __aicore__ inline void FusedRopeFP32<T>::Init(
         pipe->InitBuffer(offsetBuf, this->rotaryDim * sizeof(uint32_t));
         pipe->InitBuffer(
             temp1, this->numTokensEachLoopCurrentCore * numHeadsMax * this->rotaryDim * sizeof(T));
+        this->InitInterleaveOffsets(offsetBuf.Get<uint32_t>());
     } else {
         pipe->InitBuffer(offsetBuf, 0 * sizeof(uint32_t));
         pipe->InitBuffer(temp1, 0 * sizeof(T));
@@ -261,15 +262,12 @@ __aicore__ inline void FusedRopeFP32<T>::Rope(
 
     if (this->isNeoxStyle == 0) {
         Add(temp1Local, reverseQ, inQueCalLocal, loopN * this->numHeads * this->rotaryDim);
-        for (uint32_t i = 0; i < this->rotaryDim / 2; i++) {
-            offsetLocal.SetValue(i * 2, i * 4);
-            offsetLocal.SetValue(i * 2 + 1, (this->rotaryDim / 2 + i) * 4);
-        }
+        PipeBarrier<PIPE_V>();
+        // re-interleave row by row with the one-row offsets built in Init
         for (uint32_t i = 0; i < loopN * this->numHeads; i++) {
             Gather(
                 inQueCalLocal[i * this->rotaryDim], temp1Local[i * this->rotaryDim], offsetLocal, (uint32_t)0,
                 this->rotaryDim);
-            PipeBarrier<PIPE_ALL>();
         }
     } else {
         Add(inQueCalLocal, reverseQ, inQueCalLocal, loopN * this->numHeads * this->rotaryDim);
@@ -312,17 +310,23 @@ __aicore__ inline void FusedRopeFP32<T>::Compute(uint64_t index, uint64_t loopN)
             {static_cast<uint16_t>(loopN * this->numHeads), static_cast<uint16_t>(rotaryBlockLen),
              static_cast<uint16_t>(headBlockLen - rotaryBlockLen), 0});
         PipeBarrier<PIPE_ALL>();
+        // de-interleave the whole tile: all even / odd elements first, then place them as [x1 | x2] rows
         uint64_t rsv = 0;
-        for (uint32_t i = 0; i < loopN * this->numHeads; i++) {
-            GatherMask(
-                inQueCalLocal[i * this->rotaryDim], temp1Local[i * this->rotaryDim], static_cast<uint8_t>(1), true,
-                this->rotaryDim, {1, 1, 8, 0}, rsv);
-            PipeBarrier<PIPE_ALL>();
-            GatherMask(
-                inQueCalLocal[i * this->rotaryDim + this->rotaryDim / 2], temp1Local[i * this->rotaryDim],
-                static_cast<uint8_t>(2), true, this->rotaryDim, {1, 1, 8, 0}, rsv);
-            PipeBarrier<PIPE_ALL>();
-        }
+        uint64_t halfCount = loopN * this->numHeads * this->rotaryDim / 2;
+        GatherMask(
+            reverseQ, temp1Local, static_cast<uint8_t>(1), true,
+            static_cast<uint32_t>(loopN * this->numHeads * this->rotaryDim), {1, 1, 8, 0}, rsv);
+        GatherMask(
+            reverseQ[halfCount], temp1Local, static_cast<uint8_t>(2), true,
+            static_cast<uint32_t>(loopN * this->numHeads * this->rotaryDim), {1, 1, 8, 0}, rsv);
+        PipeBarrier<PIPE_ALL>();
+        DataCopy(
+            inQueCalLocal, reverseQ,
+            {static_cast<uint16_t>(loopN * this->numHeads), calBlockLen, 0, calBlockLen});
+        DataCopy(
+            inQueCalLocal[this->rotaryDim / 2], reverseQ[halfCount],
+            {static_cast<uint16_t>(loopN * this->numHeads), calBlockLen, 0, calBlockLen});
+        PipeBarrier<PIPE_ALL>();
     } else {
         DataCopy(
             inQueCalLocal, inLocal,
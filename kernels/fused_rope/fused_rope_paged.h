@@ -0,0 +1,382 @@
+#ifndef FUSED_ROPE_PAGED_H
+#define FUSED_ROPE_PAGED_H
+
+#include "fused_rope_base.h"
+#include "fused_rope_rotator.h"
+#include "../types.h"
+#include "../multi_layer/kvcache_layout.h"
+
+namespace FusedRope {
+using namespace AscendC;
+
+// How the rotation angle of every token is given to FusedRopePaged:
+//   PER_TOKEN:      oldPositions[i] / newPositions[i], int64 (uint64) or int32
+//   CONSTANT_SHIFT: newPosition - oldPosition == shiftDelta for every token
+//   SEGMENT_SHIFT:  [numSegments, 2] int64 table of (first token, delta) sorted by first token,
+//                   a token takes the delta of the last segment starting at or before it
+enum class RopePositionMode : uint64_t {
+    PER_TOKEN = 0,
+    CONSTANT_SHIFT = 1,
+    SEGMENT_SHIFT = 2,
+};
+
+// Re-rotates keys in place inside a paged cache. Each token is looked up through the slot
+// mapping, rotated in UB by the angle of (newPosition - oldPosition) and written back to the
+// same slot, so reused keys never go through a dense staging buffer.
+//
+// The cache slot of a token is
+//     (slot / blockSize) * blockStride + (slot % blockSize) * kLeadingDimension
+// which covers both the plain [numBlocks, blockSize, numHeads, headSize] layout and the
+// merged K/V layout. Only the rotary part of every head is read and written back.
+template <typename T, typename slot_t>
+class FusedRopePaged : public FusedRopeBase<T>
+{
+public:
+    __aicore__ inline FusedRopePaged(){};
+    __aicore__ inline void Init(
+        GM_ADDR oldPosition, GM_ADDR newPosition, GM_ADDR keyCache, GM_ADDR slotMapping, GM_ADDR cosSinCache,
+        uint64_t coreNumUse, uint64_t numTokens, uint64_t numHeads,
+        uint64_t headSize, uint64_t rotaryDim, uint64_t kLeadingDimension,
+        uint64_t blockSize, uint64_t blockStride,
+        uint64_t isNeoxStyle, uint64_t frontCore, uint64_t tailCore,
+        uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+        uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+        uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+        uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop, TPipe* pipe);
+
+    // Reads cos/sin from the cosSinCache of Init or, with a non-null invFreq ([rotaryDim / 2] float),
+    // generates them in-kernel and never reads cosSinCache. Must be called after Init and before InitPositions.
+    __aicore__ inline void InitCosSin(GM_ADDR invFreq, TPipe* pipe);
+
+    // Switches from per-token uint64 positions to another RopePositionMode and/or to int32 positions
+    // (positionType == AscendType::INT32). Must be called after Init.
+    __aicore__ inline void InitPositions(uint64_t positionMode, uint64_t positionType,
+                                         int64_t shiftDelta, GM_ADDR shiftSegments, uint64_t numSegments);
+
+    // Rotates the key cache of numLayers layers instead of keyCache. layerKVCaches is the per-layer
+    // pointer table of kvCacheFormat (KVCacheFormat), laid out as for the multi-layer transfer kernels:
+    // MERGED_KV [layer] (keys first), SEPARATE_KV [layer * 2] and MLA_KV [layer * 2 + 1] (k_pe).
+    // Positions and cos/sin are loaded once per tile and shared by every layer. Must be called after Init.
+    __aicore__ inline void InitLayers(GM_ADDR layerKVCaches, uint64_t numLayers, uint64_t kvCacheFormat);
+
+    __aicore__ inline void Process();
+    __aicore__ inline void Compute(uint64_t index, uint64_t loopN);
+
+protected:
+    // Rotates the tile in the rotary cache component (see GetRopeCacheIdx) of every layer of layerKVCaches
+    template <kvcache_ops::KVCacheFormat fmt>
+    __aicore__ inline void RotateLayers(uint64_t index, uint64_t loopN);
+    __aicore__ inline uint64_t GetOldPosition(uint64_t offsetPos);
+    __aicore__ inline uint64_t GetNewPosition(uint64_t offsetPos);
+    __aicore__ inline int64_t GetSegmentDelta(uint64_t token);
+    // a shift by delta is the rotation from position max(-delta, 0) to max(delta, 0)
+    __aicore__ inline void CopyInShiftRows(uint64_t i, int64_t delta);
+    __aicore__ inline int64_t GetSlot(uint64_t index, uint64_t i);
+    __aicore__ inline uint64_t GetCacheOffset(int64_t slot);
+
+    // Loads the old/new cos/sin rows of the tile and builds the rotation angle of every token.
+    __aicore__ inline void PrepareCosSin(uint64_t index, uint64_t loopN);
+
+    // Gathers the tile's keys from cacheGM, rotates them and scatters them back to the same slots.
+    __aicore__ inline void RotateCache(GlobalTensor<T>& cacheGM, uint64_t index, uint64_t loopN);
+
+    static constexpr uint64_t BLOCK_SIZE = 32;
+    uint64_t blockOffset;
+    uint64_t blockSize;
+    uint64_t blockStride;
+    uint16_t rotaryBlockLenT{0};
+    uint16_t headGapBlockLenT{0};
+
+    GlobalTensor<uint64_t> oldPositionIdGM;
+    GlobalTensor<uint64_t> newPositionIdGM;
+    GM_ADDR oldPositionAddr;
+    GM_ADDR newPositionAddr;
+    GlobalTensor<int32_t> oldPositionIdInt32GM;
+    GlobalTensor<int32_t> newPositionIdInt32GM;
+    GlobalTensor<int64_t> shiftSegmentGM;
+    GlobalTensor<slot_t> slotMappingGM;
+    GlobalTensor<T> keyCacheGM;
+    GlobalTensor<T> cosSinCacheGM;
+
+    GM_ADDR layerKVCaches;
+    uint64_t numLayers{0};
+    kvcache_ops::KVCacheFormat kvCacheFormat{kvcache_ops::KVCacheFormat::UNDEFINED};
+
+    RopePositionMode positionMode{RopePositionMode::PER_TOKEN};
+    bool int32Positions{false};
+    uint64_t numSegments{0};
+    uint64_t segmentCursor{0};
+    // delta the rotator cos/sin currently holds for every token of a tile, SEGMENT_SHIFT only
+    int64_t builtDelta{0};
+    bool builtDeltaValid{false};
+
+    RopeRotator<T> rotator;
+    // rotary part of every head of the tile, [numTokensEachLoop * numHeads, rotaryDim]
+    TBuf<TPosition::VECCALC> keyBuf;
+};
+
+
+template <typename T, typename slot_t>
+__aicore__ inline void FusedRopePaged<T, slot_t>::Init(
+        GM_ADDR oldPositionId, GM_ADDR newPositionId, GM_ADDR keyCache, GM_ADDR slotMapping, GM_ADDR cosSinCache,
+        uint64_t coreNumUse, uint64_t numTokens, uint64_t numHeads,
+        uint64_t headSize, uint64_t rotaryDim, uint64_t kLeadingDimension,
+        uint64_t blockSize, uint64_t blockStride,
+        uint64_t isNeoxStyle, uint64_t frontCore, uint64_t tailCore,
+        uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+        uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+        uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+        uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop, TPipe* pipe)
+{
+    this->InitData(coreNumUse, numTokens, numHeads, headSize, rotaryDim,
+                    kLeadingDimension, isNeoxStyle, frontCore, tailCore,
+                    numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+                    numTokensEachFrontCore, numTokensEachTailCore,
+                    loopTimeEachFrontCore, loopTimeEachTailCore,
+                    numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop);
+
+    this->blockSize = blockSize;
+    this->blockStride = blockStride;
+    rotaryBlockLenT = static_cast<uint16_t>(this->rotaryDim * sizeof(T) / BLOCK_SIZE);
+    headGapBlockLenT = static_cast<uint16_t>((this->headSize - this->rotaryDim) * sizeof(T) / BLOCK_SIZE);
+
+    if (this->blockIdx_ < this->frontCore) {
+        blockOffset = this->numTokensEachFrontCore * this->blockIdx_;
+    } else {
+        blockOffset = this->numTokensEachFrontCore * (this->frontCore) +
+                      (this->blockIdx_ - this->frontCore) * this->numTokensEachTailCore;
+    }
+
+    oldPositionAddr = oldPositionId;
+    newPositionAddr = newPositionId;
+    oldPositionIdGM.SetGlobalBuffer((__gm__ uint64_t*)oldPositionId + blockOffset);
+    newPositionIdGM.SetGlobalBuffer((__gm__ uint64_t*)newPositionId + blockOffset);
+    slotMappingGM.SetGlobalBuffer((__gm__ slot_t*)slotMapping + blockOffset);
+    keyCacheGM.SetGlobalBuffer((__gm__ T*)keyCache);
+    cosSinCacheGM.SetGlobalBuffer((__gm__ T*)cosSinCache);
+
+    pipe->InitBuffer(keyBuf, this->numTokensEachLoopCurrentCore * this->numHeads * this->rotaryDim * sizeof(T));
+    // the tile only holds the rotary part of every head, so its rows are rotaryDim long
+    rotator.Init(pipe, this->numTokensEachLoopCurrentCore, this->numHeads, this->rotaryDim,
+                 this->rotaryDim, this->isNeoxStyle);
+}
+
+template <typename T, typename slot_t>
+__aicore__ inline void FusedRopePaged<T, slot_t>::InitCosSin(GM_ADDR invFreq, TPipe* pipe)
+{
+    if (invFreq != nullptr) {
+        rotator.InitInvFreq(pipe, invFreq);
+    } else {
+        rotator.InitCosSinCache(pipe);
+    }
+}
+
+template <typename T, typename slot_t>
+__aicore__ inline void FusedRopePaged<T, slot_t>::InitPositions(
+        uint64_t positionMode, uint64_t positionType, int64_t shiftDelta, GM_ADDR shiftSegments, uint64_t numSegments)
+{
+    this->positionMode = static_cast<RopePositionMode>(positionMode);
+    int32Positions = (positionType == static_cast<uint64_t>(kvcache_ops::AscendType::INT32));
+    if (this->positionMode == RopePositionMode::PER_TOKEN && int32Positions) {
+        oldPositionIdInt32GM.SetGlobalBuffer((__gm__ int32_t*)oldPositionAddr + blockOffset);
+        newPositionIdInt32GM.SetGlobalBuffer((__gm__ int32_t*)newPositionAddr + blockOffset);
+    }
+    if (this->positionMode == RopePositionMode::CONSTANT_SHIFT) {
+        // every tile shares the same angle: build it once for the whole kernel
+        for (uint64_t i = 0; i < this->numTokensEachLoopCurrentCore; ++i) {
+            CopyInShiftRows(i, shiftDelta);
+        }
+        rotator.BuildCosSin(this->numTokensEachLoopCurrentCore);
+    } else if (this->positionMode == RopePositionMode::SEGMENT_SHIFT) {
+        this->numSegments = numSegments;
+        shiftSegmentGM.SetGlobalBuffer((__gm__ int64_t*)shiftSegments, 2 * numSegments);
+        segmentCursor = 0;
+        builtDeltaValid = false;
+    }
+}
+
+template <typename T, typename slot_t>
+__aicore__ inline void FusedRopePaged<T, slot_t>::InitLayers(
+        GM_ADDR layerKVCaches, uint64_t numLayers, uint64_t kvCacheFormat)
+{
+    this->layerKVCaches = layerKVCaches;
+    this->numLayers = numLayers;
+    this->kvCacheFormat = static_cast<kvcache_ops::KVCacheFormat>(kvCacheFormat);
+}
+
+template <typename T, typename slot_t>
+template <kvcache_ops::KVCacheFormat fmt>
+__aicore__ inline void FusedRopePaged<T, slot_t>::RotateLayers(uint64_t index, uint64_t loopN)
+{
+    for (uint64_t layerIdx = 0; layerIdx < numLayers; ++layerIdx) {
+        keyCacheGM.SetGlobalBuffer((__gm__ T*)kvcache_ops::GetLayerBasePtr<fmt>(
+            layerKVCaches, layerIdx, kvcache_ops::GetRopeCacheIdx<fmt>()));
+        RotateCache(keyCacheGM, index, loopN);
+    }
+}
+
+template <typename T, typename slot_t>
+__aicore__ inline uint64_t FusedRopePaged<T, slot_t>::GetOldPosition(uint64_t offsetPos)
+{
+    if (int32Positions) {
+        return static_cast<uint64_t>(oldPositionIdInt32GM.GetValue(offsetPos));
+    }
+    return oldPositionIdGM.GetValue(offsetPos);
+}
+
+template <typename T, typename slot_t>
+__aicore__ inline uint64_t FusedRopePaged<T, slot_t>::GetNewPosition(uint64_t offsetPos)
+{
+    if (int32Positions) {
+        return static_cast<uint64_t>(newPositionIdInt32GM.GetValue(offsetPos));
+    }
+    return newPositionIdGM.GetValue(offsetPos);
+}
+
+template <typename T, typename slot_t>
+__aicore__ inline int64_t FusedRopePaged<T, slot_t>::GetSegmentDelta(uint64_t token)
+{
+    // tokens are visited in increasing order, so the cursor only moves forward
+    while (segmentCursor + 1 < numSegments &&
+           static_cast<uint64_t>(shiftSegmentGM.GetValue(2 * (segmentCursor + 1))) <= token) {
+        segmentCursor++;
+    }
+    return shiftSegmentGM.GetValue(2 * segmentCursor + 1);
+}
+
+template <typename T, typename slot_t>
+__aicore__ inline void FusedRopePaged<T, slot_t>::CopyInShiftRows(uint64_t i, int64_t delta)
+{
+    if (delta >= 0) {
+        rotator.CopyInCosSinRows(i, cosSinCacheGM, 0, static_cast<uint64_t>(delta));
+    } else {
+        rotator.CopyInCosSinRows(i, cosSinCacheGM, static_cast<uint64_t>(-delta), 0);
+    }
+}
+
+template <typename T, typename slot_t>
+__aicore__ inline int64_t FusedRopePaged<T, slot_t>::GetSlot(uint64_t index, uint64_t i)
+{
+    return static_cast<int64_t>(slotMappingGM.GetValue(this->numTokensEachLoopCurrentCore * index + i));
+}
+
+template <typename T, typename slot_t>
+__aicore__ inline uint64_t FusedRopePaged<T, slot_t>::GetCacheOffset(int64_t slot)
+{
+    uint64_t pageIdx = static_cast<uint64_t>(slot) / blockSize;
+    uint64_t pageOffset = static_cast<uint64_t>(slot) % blockSize;
+    return pageIdx * blockStride + pageOffset * this->kLeadingDimension;
+}
+
+template <typename T, typename slot_t>
+__aicore__ inline void FusedRopePaged<T, slot_t>::PrepareCosSin(uint64_t index, uint64_t loopN)
+{
+    if (positionMode == RopePositionMode::CONSTANT_SHIFT) {
+        return;
+    }
+    if (positionMode == RopePositionMode::SEGMENT_SHIFT) {
+        uint64_t firstToken = blockOffset + this->numTokensEachLoopCurrentCore * index;
+        int64_t firstDelta = GetSegmentDelta(firstToken);
+        bool uniform = (segmentCursor + 1 >= numSegments) ||
+                       (static_cast<uint64_t>(shiftSegmentGM.GetValue(2 * (segmentCursor + 1))) >= firstToken + loopN);
+        if (uniform) {
+            // the whole tile lies in one segment: reuse the angle if the previous tile had the same delta
+            if (builtDeltaValid && builtDelta == firstDelta) {
+                return;
+            }
+            for (uint64_t i = 0; i < this->numTokensEachLoopCurrentCore; ++i) {
+                PipeBarrier<PIPE_ALL>();
+                CopyInShiftRows(i, firstDelta);
+            }
+            rotator.BuildCosSin(this->numTokensEachLoopCurrentCore);
+            builtDelta = firstDelta;
+            builtDeltaValid = true;
+            return;
+        }
+        for (uint64_t i = 0; i < loopN; ++i) {
+            int64_t delta = GetSegmentDelta(firstToken + i);
+            PipeBarrier<PIPE_ALL>();
+            CopyInShiftRows(i, delta);
+        }
+        rotator.BuildCosSin(loopN);
+        builtDeltaValid = false;
+        return;
+    }
+    for (uint32_t i = 0; i < loopN; ++i) {
+        // NOTE: padded tokens (slot == -1) may carry positions outside the cos/sin cache
+        if (GetSlot(index, i) < 0) {
+            continue;
+        }
+        uint64_t offsetPos = this->numTokensEachLoopCurrentCore * index + i;
+        uint64_t oldPos = GetOldPosition(offsetPos);
+        uint64_t newPos = GetNewPosition(offsetPos);
+        PipeBarrier<PIPE_ALL>();
+        rotator.CopyInCosSinRows(i, cosSinCacheGM, oldPos, newPos);
+    }
+    rotator.BuildCosSin(loopN);
+}
+
+template <typename T, typename slot_t>
+__aicore__ inline void FusedRopePaged<T, slot_t>::RotateCache(
+        GlobalTensor<T>& cacheGM, uint64_t index, uint64_t loopN)
+{
+    uint64_t tokenSize = this->numHeads * this->rotaryDim;
+    LocalTensor<T> keyLocal = keyBuf.Get<T>();
+
+    // gather: only the rotary part of every head is read
+    DataCopyParams loadParams = {static_cast<uint16_t>(this->numHeads), rotaryBlockLenT, headGapBlockLenT, 0};
+    for (uint32_t i = 0; i < loopN; ++i) {
+        int64_t slot = GetSlot(index, i);
+        if (slot < 0) {
+            continue;
+        }
+        DataCopy(keyLocal[i * tokenSize], cacheGM[GetCacheOffset(slot)], loadParams);
+    }
+    PipeBarrier<PIPE_ALL>();
+
+    rotator.Rotate(keyLocal, loopN, this->rotaryDim);
+
+    // scatter back to the same slots
+    DataCopyParams storeParams = {static_cast<uint16_t>(this->numHeads), rotaryBlockLenT, 0, headGapBlockLenT};
+    for (uint32_t i = 0; i < loopN; ++i) {
+        int64_t slot = GetSlot(index, i);
+        if (slot < 0) {
+            continue;
+        }
+        DataCopy(cacheGM[GetCacheOffset(slot)], keyLocal[i * tokenSize], storeParams);
+    }
+    PipeBarrier<PIPE_ALL>();
+}
+
+template <typename T, typename slot_t>
+__aicore__ inline void FusedRopePaged<T, slot_t>::Compute(uint64_t index, uint64_t loopN)
+{
+    PrepareCosSin(index, loopN);
+    if (numLayers == 0) {
+        RotateCache(keyCacheGM, index, loopN);
+        return;
+    }
+    if (kvCacheFormat == kvcache_ops::KVCacheFormat::MERGED_KV) {
+        RotateLayers<kvcache_ops::KVCacheFormat::MERGED_KV>(index, loopN);
+    } else if (kvCacheFormat == kvcache_ops::KVCacheFormat::MLA_KV) {
+        RotateLayers<kvcache_ops::KVCacheFormat::MLA_KV>(index, loopN);
+    } else {
+        RotateLayers<kvcache_ops::KVCacheFormat::SEPARATE_KV>(index, loopN);
+    }
+}
+
+template <typename T, typename slot_t>
+__aicore__ inline void FusedRopePaged<T, slot_t>::Process()
+{
+    for (uint64_t n = 0; n < this->loopTimeCurrentCore - 1; n++) {
+        Compute(n, this->numTokensEachLoopCurrentCore);
+    }
+    if (this->numTokensLastLoopCurrentCore == 0) {
+        Compute(this->loopTimeCurrentCore - 1, this->numTokensEachLoopCurrentCore);
+    } else {
+        Compute(this->loopTimeCurrentCore - 1, this->numTokensLastLoopCurrentCore);
+    }
+}
+}
+
+#endif
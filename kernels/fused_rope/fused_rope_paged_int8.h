@@ -0,0 +1,283 @@
+#ifndef FUSED_ROPE_PAGED_INT8_H
+#define FUSED_ROPE_PAGED_INT8_H
+
+#include "fused_rope_paged.h"
+
+namespace FusedRope {
+using namespace AscendC;
+
+// In-place re-rotation of an int8 paged key cache with one float scale per (token, head).
+//
+// keyScales is [numBlocks, blockSize, numHeads] float and follows the key slots. Every tile is
+// dequantized, rotated in float and requantized in UB in a single pass. With updateScales the
+// scale of every head is re-derived as max|x| / 127 after the rotation and written back as well,
+// otherwise the old scales are kept. cosSinCache is float (or replaced by invFreq, see InitCosSin).
+//
+// Whole heads are loaded since the scales cover the full head, numHeads * headSize must be a
+// multiple of 32. The scale update reduces a head per repeat, headSize must be a multiple of 8 up
+// to MAX_HEAD_SIZE.
+template <typename slot_t>
+class FusedRopePagedInt8 : public FusedRopePaged<float, slot_t>
+{
+public:
+    __aicore__ inline FusedRopePagedInt8(){};
+    __aicore__ inline void Init(
+        GM_ADDR oldPosition, GM_ADDR newPosition, GM_ADDR keyCache, GM_ADDR keyScales,
+        GM_ADDR slotMapping, GM_ADDR cosSinCache,
+        uint64_t coreNumUse, uint64_t numTokens, uint64_t numHeads,
+        uint64_t headSize, uint64_t rotaryDim, uint64_t kLeadingDimension,
+        uint64_t blockSize, uint64_t blockStride,
+        uint64_t isNeoxStyle, uint64_t updateScales, uint64_t frontCore, uint64_t tailCore,
+        uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+        uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+        uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+        uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop, TPipe* pipe);
+
+    __aicore__ inline void Process();
+    __aicore__ inline void Compute(uint64_t index, uint64_t loopN);
+
+    static constexpr uint64_t MAX_HEAD_SIZE = 255 * 8; // a head of float blocks as one repeat stride
+
+protected:
+    __aicore__ inline uint64_t GetScaleOffset(int64_t slot);
+    // scaleBc[token, head, :] = scale[token, head]
+    __aicore__ inline void BroadcastScales(const LocalTensor<float>& scaleLocal, uint64_t loopN);
+    __aicore__ inline void Dequantize(uint64_t loopN);
+    __aicore__ inline void UpdateScales(uint64_t loopN);
+    __aicore__ inline void Quantize(uint64_t loopN);
+    __aicore__ inline void RotateCacheInt8(uint64_t index, uint64_t loopN);
+
+    static constexpr float INT8_MAX_F = 127.0f;
+    static constexpr float MIN_SCALE = 1e-8f;
+    static constexpr uint64_t ELE_NUM_FP32 = 8;
+    static constexpr uint64_t REDUCE_WIDTH = 64; // float elements of one repeat
+    static constexpr uint64_t MAX_REPEAT = 255;
+    uint64_t tokenSize;
+    uint64_t scaleRowLen; // numHeads aligned to 32B, one scale row per token in UB
+    bool updateScales;
+
+    GlobalTensor<int8_t> keyCacheInt8GM;
+    GlobalTensor<float> keyScaleGM;
+
+    // keyInt8Buf/keyHalfBuf/keyFloatBuf: whole heads of the tile, [numTokensEachLoop, numHeads * headSize],
+    // scaleBcBuf: per element scale (and |x| scratch), same shape as keyFloatBuf,
+    // scaleBuf/invScaleBuf: [numTokensEachLoop, scaleRowLen].
+    TBuf<TPosition::VECCALC> keyInt8Buf, keyHalfBuf, keyFloatBuf, scaleBcBuf, scaleBuf, invScaleBuf;
+};
+
+template <typename slot_t>
+__aicore__ inline void FusedRopePagedInt8<slot_t>::Init(
+        GM_ADDR oldPosition, GM_ADDR newPosition, GM_ADDR keyCache, GM_ADDR keyScales,
+        GM_ADDR slotMapping, GM_ADDR cosSinCache,
+        uint64_t coreNumUse, uint64_t numTokens, uint64_t numHeads,
+        uint64_t headSize, uint64_t rotaryDim, uint64_t kLeadingDimension,
+        uint64_t blockSize, uint64_t blockStride,
+        uint64_t isNeoxStyle, uint64_t updateScales, uint64_t frontCore, uint64_t tailCore,
+        uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+        uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+        uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+        uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop, TPipe* pipe)
+{
+    // the float base owns positions, slots and the rotator, its keyBuf holds the compact rotary part
+    FusedRopePaged<float, slot_t>::Init(oldPosition, newPosition, nullptr, slotMapping, cosSinCache,
+                                        coreNumUse, numTokens, numHeads, headSize, rotaryDim, kLeadingDimension,
+                                        blockSize, blockStride, isNeoxStyle, frontCore, tailCore,
+                                        numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+                                        numTokensEachFrontCore, numTokensEachTailCore,
+                                        loopTimeEachFrontCore, loopTimeEachTailCore,
+                                        numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, pipe);
+    this->updateScales = (updateScales != 0);
+    tokenSize = this->numHeads * this->headSize;
+    scaleRowLen = (this->numHeads + ELE_NUM_FP32 - 1) / ELE_NUM_FP32 * ELE_NUM_FP32;
+
+    keyCacheInt8GM.SetGlobalBuffer((__gm__ int8_t*)keyCache);
+    keyScaleGM.SetGlobalBuffer((__gm__ float*)keyScales);
+
+    uint64_t maxTokens = this->numTokensEachLoopCurrentCore;
+    pipe->InitBuffer(keyInt8Buf, maxTokens * tokenSize * sizeof(int8_t));
+    pipe->InitBuffer(keyHalfBuf, maxTokens * tokenSize * sizeof(half));
+    pipe->InitBuffer(keyFloatBuf, maxTokens * tokenSize * sizeof(float));
+    pipe->InitBuffer(scaleBcBuf, maxTokens * tokenSize * sizeof(float));
+    pipe->InitBuffer(scaleBuf, maxTokens * scaleRowLen * sizeof(float));
+    pipe->InitBuffer(invScaleBuf, maxTokens * scaleRowLen * sizeof(float));
+}
+
+template <typename slot_t>
+__aicore__ inline uint64_t FusedRopePagedInt8<slot_t>::GetScaleOffset(int64_t slot)
+{
+    return static_cast<uint64_t>(slot) * this->numHeads;
+}
+
+template <typename slot_t>
+__aicore__ inline void FusedRopePagedInt8<slot_t>::BroadcastScales(const LocalTensor<float>& scaleLocal, uint64_t loopN)
+{
+    LocalTensor<float> scaleBcLocal = scaleBcBuf.Get<float>();
+    uint32_t dstShape[2] = {static_cast<uint32_t>(this->numHeads), static_cast<uint32_t>(this->headSize)};
+    uint32_t srcShape[2] = {static_cast<uint32_t>(this->numHeads), 1};
+    for (uint32_t i = 0; i < loopN; ++i) {
+        Broadcast<float, 2, 1, false>(scaleBcLocal[i * tokenSize], scaleLocal[i * scaleRowLen], dstShape, srcShape);
+    }
+    PipeBarrier<PIPE_V>();
+}
+
+template <typename slot_t>
+__aicore__ inline void FusedRopePagedInt8<slot_t>::Dequantize(uint64_t loopN)
+{
+    LocalTensor<int8_t> keyInt8Local = keyInt8Buf.Get<int8_t>();
+    LocalTensor<half> keyHalfLocal = keyHalfBuf.Get<half>();
+    LocalTensor<float> keyFloatLocal = keyFloatBuf.Get<float>();
+    LocalTensor<float> scaleBcLocal = scaleBcBuf.Get<float>();
+    uint32_t count = static_cast<uint32_t>(loopN * tokenSize);
+
+    Cast(keyHalfLocal, keyInt8Local, AscendC::RoundMode::CAST_NONE, count);
+    PipeBarrier<PIPE_V>();
+    Cast(keyFloatLocal, keyHalfLocal, AscendC::RoundMode::CAST_NONE, count);
+    BroadcastScales(scaleBuf.Get<float>(), loopN);
+    Mul(keyFloatLocal, keyFloatLocal, scaleBcLocal, count);
+    PipeBarrier<PIPE_V>();
+}
+
+template <typename slot_t>
+__aicore__ inline void FusedRopePagedInt8<slot_t>::UpdateScales(uint64_t loopN)
+{
+    LocalTensor<float> keyFloatLocal = keyFloatBuf.Get<float>();
+    LocalTensor<float> absLocal = scaleBcBuf.Get<float>();
+    LocalTensor<float> scaleLocal = scaleBuf.Get<float>();
+
+    Abs(absLocal, keyFloatLocal, static_cast<uint32_t>(loopN * tokenSize));
+    PipeBarrier<PIPE_V>();
+
+    // every head is a row of headSize, one row per repeat: fold each row down to its first REDUCE_WIDTH
+    uint8_t headBlocks = static_cast<uint8_t>(this->headSize / ELE_NUM_FP32);
+    BinaryRepeatParams foldParams(1, 1, 1, headBlocks, headBlocks, headBlocks);
+    uint64_t rows = loopN * this->numHeads;
+    for (uint64_t row = 0; row < rows; row += MAX_REPEAT) {
+        uint8_t repeats = static_cast<uint8_t>(rows - row < MAX_REPEAT ? rows - row : MAX_REPEAT);
+        LocalTensor<float> rowLocal = absLocal[row * this->headSize];
+        for (uint64_t off = REDUCE_WIDTH; off < this->headSize; off += REDUCE_WIDTH) {
+            uint64_t width = this->headSize - off < REDUCE_WIDTH ? this->headSize - off : REDUCE_WIDTH;
+            Max(rowLocal, rowLocal, rowLocal[off], width, repeats, foldParams);
+            PipeBarrier<PIPE_V>();
+        }
+    }
+
+    // then reduce the heads of every token into its scale row
+    int32_t reduceWidth = static_cast<int32_t>(this->headSize < REDUCE_WIDTH ? this->headSize : REDUCE_WIDTH);
+    for (uint32_t i = 0; i < loopN; ++i) {
+        for (uint64_t h = 0; h < this->numHeads; h += MAX_REPEAT) {
+            int32_t repeats = static_cast<int32_t>(this->numHeads - h < MAX_REPEAT ? this->numHeads - h : MAX_REPEAT);
+            WholeReduceMax<float>(scaleLocal[i * scaleRowLen + h], absLocal[i * tokenSize + h * this->headSize],
+                                  reduceWidth, repeats, 1, 1, headBlocks, ReduceOrder::ORDER_ONLY_VALUE);
+        }
+    }
+    PipeBarrier<PIPE_V>();
+
+    int32_t scaleCount = static_cast<int32_t>(loopN * scaleRowLen);
+    Muls(scaleLocal, scaleLocal, 1.0f / INT8_MAX_F, scaleCount);
+    PipeBarrier<PIPE_V>();
+    Maxs(scaleLocal, scaleLocal, MIN_SCALE, scaleCount);
+    PipeBarrier<PIPE_V>();
+}
+
+template <typename slot_t>
+__aicore__ inline void FusedRopePagedInt8<slot_t>::Quantize(uint64_t loopN)
+{
+    LocalTensor<int8_t> keyInt8Local = keyInt8Buf.Get<int8_t>();
+    LocalTensor<half> keyHalfLocal = keyHalfBuf.Get<half>();
+    LocalTensor<float> keyFloatLocal = keyFloatBuf.Get<float>();
+    LocalTensor<float> scaleBcLocal = scaleBcBuf.Get<float>();
+    LocalTensor<float> invScaleLocal = invScaleBuf.Get<float>();
+    uint32_t count = static_cast<uint32_t>(loopN * tokenSize);
+
+    Duplicate<float>(invScaleLocal, 1.0f, static_cast<int32_t>(loopN * scaleRowLen));
+    PipeBarrier<PIPE_V>();
+    Div(invScaleLocal, invScaleLocal, scaleBuf.Get<float>(), static_cast<int32_t>(loopN * scaleRowLen));
+    PipeBarrier<PIPE_V>();
+    BroadcastScales(invScaleLocal, loopN);
+    Mul(keyFloatLocal, keyFloatLocal, scaleBcLocal, count);
+    PipeBarrier<PIPE_V>();
+    Cast(keyHalfLocal, keyFloatLocal, AscendC::RoundMode::CAST_NONE, count);
+    PipeBarrier<PIPE_V>();
+    #if ASCEND_AICORE_ARCH >= 220
+        Cast(keyInt8Local, keyHalfLocal, AscendC::RoundMode::CAST_RINT, count);
+    #else
+        Cast(keyInt8Local, keyHalfLocal, AscendC::RoundMode::CAST_NONE, count);
+    #endif
+    PipeBarrier<PIPE_ALL>();
+}
+
+template <typename slot_t>
+__aicore__ inline void FusedRopePagedInt8<slot_t>::RotateCacheInt8(uint64_t index, uint64_t loopN)
+{
+    LocalTensor<int8_t> keyInt8Local = keyInt8Buf.Get<int8_t>();
+    LocalTensor<float> keyFloatLocal = keyFloatBuf.Get<float>();
+    LocalTensor<float> scaleLocal = scaleBuf.Get<float>();
+    DataCopyExtParams scaleParams{1, static_cast<uint32_t>(this->numHeads * sizeof(float)), 0, 0, 0};
+    DataCopyPadExtParams<float> padParams{false, 0, 0, 0};
+
+    // gather whole heads and their scales
+    for (uint32_t i = 0; i < loopN; ++i) {
+        int64_t slot = this->GetSlot(index, i);
+        if (slot < 0) {
+            continue;
+        }
+        DataCopy(keyInt8Local[i * tokenSize], keyCacheInt8GM[this->GetCacheOffset(slot)], tokenSize);
+        DataCopyPad(scaleLocal[i * scaleRowLen], keyScaleGM[GetScaleOffset(slot)], scaleParams, padParams);
+    }
+    PipeBarrier<PIPE_ALL>();
+
+    Dequantize(loopN);
+
+    uint16_t rows = static_cast<uint16_t>(loopN * this->numHeads);
+    if (this->headSize != this->rotaryDim) {
+        LocalTensor<float> rotaryLocal = this->keyBuf.template Get<float>();
+        DataCopy(rotaryLocal, keyFloatLocal, {rows, this->rotaryBlockLenT, this->headGapBlockLenT, 0});
+        PipeBarrier<PIPE_ALL>();
+        this->rotator.Rotate(rotaryLocal, loopN, this->rotaryDim);
+        DataCopy(keyFloatLocal, rotaryLocal, {rows, this->rotaryBlockLenT, 0, this->headGapBlockLenT});
+        PipeBarrier<PIPE_ALL>();
+    } else {
+        this->rotator.Rotate(keyFloatLocal, loopN, this->rotaryDim);
+    }
+
+    if (updateScales) {
+        UpdateScales(loopN);
+    }
+    Quantize(loopN);
+
+    // scatter back to the same slots
+    for (uint32_t i = 0; i < loopN; ++i) {
+        int64_t slot = this->GetSlot(index, i);
+        if (slot < 0) {
+            continue;
+        }
+        DataCopy(keyCacheInt8GM[this->GetCacheOffset(slot)], keyInt8Local[i * tokenSize], tokenSize);
+        if (updateScales) {
+            DataCopyPad(keyScaleGM[GetScaleOffset(slot)], scaleLocal[i * scaleRowLen], scaleParams);
+        }
+    }
+    PipeBarrier<PIPE_ALL>();
+}
+
+template <typename slot_t>
+__aicore__ inline void FusedRopePagedInt8<slot_t>::Compute(uint64_t index, uint64_t loopN)
+{
+    this->PrepareCosSin(index, loopN);
+    RotateCacheInt8(index, loopN);
+}
+
+template <typename slot_t>
+__aicore__ inline void FusedRopePagedInt8<slot_t>::Process()
+{
+    for (uint64_t n = 0; n < this->loopTimeCurrentCore - 1; n++) {
+        Compute(n, this->numTokensEachLoopCurrentCore);
+    }
+    if (this->numTokensLastLoopCurrentCore == 0) {
+        Compute(this->loopTimeCurrentCore - 1, this->numTokensEachLoopCurrentCore);
+    } else {
+        Compute(this->loopTimeCurrentCore - 1, this->numTokensLastLoopCurrentCore);
+    }
+}
+}
+
+#endif
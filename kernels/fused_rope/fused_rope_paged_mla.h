@@ -0,0 +1,55 @@
+#ifndef FUSED_ROPE_PAGED_MLA_H
+#define FUSED_ROPE_PAGED_MLA_H
+
+#include "fused_rope_paged.h"
+#include "../multi_layer/kvcache_layout.h"
+
+namespace FusedRope {
+using namespace AscendC;
+
+// In-place re-rotation of the decoupled rope keys of an MLA cache.
+//
+// mlaKVCaches is the GM pointer pair of one layer, [kv_c latent, k_pe], in the order used by
+// KVCacheFormat::MLA_KV. Only k_pe, [numBlocks, blockSize, ropeDim], is read and written back,
+// the latent is never touched. A k_pe row is a single head whose every element is rotary.
+template <typename T, typename slot_t>
+class FusedRopePagedMLA : public FusedRopePaged<T, slot_t>
+{
+public:
+    __aicore__ inline FusedRopePagedMLA(){};
+    __aicore__ inline void Init(
+        GM_ADDR oldPosition, GM_ADDR newPosition, GM_ADDR mlaKVCaches, GM_ADDR slotMapping, GM_ADDR cosSinCache,
+        uint64_t coreNumUse, uint64_t numTokens, uint64_t ropeDim, uint64_t blockSize,
+        uint64_t isNeoxStyle, uint64_t frontCore, uint64_t tailCore,
+        uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+        uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+        uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+        uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop, TPipe* pipe);
+};
+
+template <typename T, typename slot_t>
+__aicore__ inline void FusedRopePagedMLA<T, slot_t>::Init(
+        GM_ADDR oldPosition, GM_ADDR newPosition, GM_ADDR mlaKVCaches, GM_ADDR slotMapping, GM_ADDR cosSinCache,
+        uint64_t coreNumUse, uint64_t numTokens, uint64_t ropeDim, uint64_t blockSize,
+        uint64_t isNeoxStyle, uint64_t frontCore, uint64_t tailCore,
+        uint64_t numTokensFrontCoreEachLoop, uint64_t numTokensTailCoreEachLoop,
+        uint64_t numTokensEachFrontCore, uint64_t numTokensEachTailCore,
+        uint64_t loopTimeEachFrontCore, uint64_t loopTimeEachTailCore,
+        uint64_t numTokensFrontCoreLastLoop, uint64_t numTokensTailCoreLastLoop, TPipe* pipe)
+{
+    // mlaKVCaches is the pointer pair of a single layer, layer 0 of the MLA_KV pointer table
+    GM_ADDR kPeCache = kvcache_ops::GetLayerBasePtr<kvcache_ops::KVCacheFormat::MLA_KV>(
+        mlaKVCaches, 0, kvcache_ops::GetRopeCacheIdx<kvcache_ops::KVCacheFormat::MLA_KV>());
+
+    // one head per token, rows are ropeDim apart and a page holds blockSize rows
+    FusedRopePaged<T, slot_t>::Init(oldPosition, newPosition, kPeCache, slotMapping, cosSinCache,
+                                    coreNumUse, numTokens, 1, ropeDim, ropeDim, ropeDim,
+                                    blockSize, blockSize * ropeDim, isNeoxStyle, frontCore, tailCore,
+                                    numTokensFrontCoreEachLoop, numTokensTailCoreEachLoop,
+                                    numTokensEachFrontCore, numTokensEachTailCore,
+                                    loopTimeEachFrontCore, loopTimeEachTailCore,
+                                    numTokensFrontCoreLastLoop, numTokensTailCoreLastLoop, pipe);
+}
+}
+
+#endif
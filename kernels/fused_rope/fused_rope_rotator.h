@@ -0,0 +1,441 @@
+#ifndef FUSED_ROPE_ROTATOR_H
+#define FUSED_ROPE_ROTATOR_H
+
+#include "kernel_operator.h"
+
+namespace FusedRope {
+using namespace AscendC;
+
+// Rotates the rotary part of key tiles held in UB by a per-token angle of (newPosition - oldPosition).
+// Every token is rotated once with
+//     cos(n - o) = cos(n)cos(o) + sin(n)sin(o)
+//     sin(n - o) = sin(n)cos(o) - cos(n)sin(o)
+// instead of being rotated back to position 0 and forward again.
+//
+// Init is followed by exactly one of InitCosSinCache and InitInvFreq, which picks where cos/sin come
+// from. Usage per tile: CopyInCosSinRows for every valid token, BuildCosSin, then Rotate on any number
+// of key tiles sharing those positions.
+//
+// With InitInvFreq the cos/sin cache is not read: the angle of every token is generated as
+// (newPosition - oldPosition) * inv_freq with vector Sin/Cos. The shift is split into
+// hi * 4096 + lo so that both partial angles stay small enough for float, and the two parts are
+// combined with the angle addition formulas. (4096 * inv_freq) mod 2 * pi is only held to float
+// precision and scaled by hi, so the angle error grows linearly with the shift: about 2e-4 rad at
+// 2^20 tokens, over 0.1 rad near 2^30. Shifts are supported up to 2^20 tokens, use the cos/sin
+// cache for larger ones.
+template <typename T>
+class RopeRotator
+{
+public:
+    __aicore__ inline RopeRotator(){};
+    __aicore__ inline void Init(
+        TPipe* pipe, uint64_t maxTokens, uint64_t numHeads, uint64_t headSize,
+        uint64_t rotaryDim, uint64_t isNeoxStyle);
+
+    // Reads cos/sin from the cos/sin cache rows passed to CopyInCosSinRows.
+    __aicore__ inline void InitCosSinCache(TPipe* pipe);
+    // Generates cos/sin from invFreq, [rotaryDim / 2] float, instead of reading the cos/sin cache.
+    __aicore__ inline void InitInvFreq(TPipe* pipe, GM_ADDR invFreq);
+
+    __aicore__ inline void CopyInCosSinRows(
+        uint64_t i, GlobalTensor<T>& cosSinCacheGM, uint64_t oldPos, uint64_t newPos);
+    __aicore__ inline void BuildCosSin(uint64_t loopN);
+
+    // Rotates keyLocal in place. It holds loopN tokens × numHeads head rows, consecutive head rows are
+    // rowStride elements apart and the rotary part is the first rotaryDim elements of every row.
+    __aicore__ inline void Rotate(const LocalTensor<T>& keyLocal, uint64_t loopN, uint64_t rowStride);
+
+protected:
+    __aicore__ inline void SetShift(uint64_t i, int64_t shift);
+    __aicore__ inline void BuildCosSinFromShifts(uint64_t loopN);
+    // Reduces x to [0, 2 * pi) in place
+    __aicore__ inline void ReduceAngle(const LocalTensor<float>& x, uint32_t count);
+    __aicore__ inline void BroadcastHeads(const LocalTensor<float>& deltaCos, const LocalTensor<float>& deltaSin,
+                                          uint64_t loopN);
+
+    // Splits [rows, rotaryDim] into the two rotary halves x1/x2 (NeoX: first/second half,
+    // GPT-J: even/odd elements) and merges them back after the rotation.
+    __aicore__ inline void SplitHalves(const LocalTensor<float>& xLocal, uint64_t rows);
+    __aicore__ inline void MergeHalves(const LocalTensor<float>& xLocal, uint64_t rows);
+
+    static constexpr uint64_t BLOCK_SIZE = 32;
+    static constexpr uint64_t ELE_NUM_FP32 = 8;
+    static constexpr int64_t SHIFT_SPLIT_BITS = 12;
+    static constexpr float INV_TWO_PI = 0.15915494309189535f;
+    // 2 * pi = TWO_PI_HI + TWO_PI_LO, TWO_PI_HI has few enough mantissa bits for n * TWO_PI_HI to be exact
+    static constexpr float TWO_PI_HI = 6.28125f;
+    static constexpr float TWO_PI_LO = 1.9353071795864769e-3f;
+    uint64_t maxTokens;
+    uint64_t numHeads;
+    uint64_t headSize;
+    uint64_t rotaryDim;
+    uint64_t isNeoxStyle;
+    uint64_t halfDim;
+    uint64_t maxRows;
+    uint16_t rotaryBlockLenT{0};
+    uint16_t halfBlockLen{0};
+    bool invFreqMode{false};
+
+    // rowBuf/rowCalBuf: old and new cos/sin cache rows of the tile, [2, maxTokens, rotaryDim], InitCosSinCache only,
+    // quarterBuf: cos_o, sin_o, cos_n, sin_n, cos, sin rows, each [maxTokens, rotaryDim / 2] float,
+    // cosBuf/sinBuf: per-head cos/sin of the rotation angle, [maxRows, rotaryDim / 2] float,
+    // compactBuf: rotary part of the key rows when they are strided, [maxRows, rotaryDim] T,
+    // xBuf: [maxRows, rotaryDim] float, splitBuf: [x1 | x2] halves, each [maxRows, rotaryDim / 2] float.
+    TBuf<TPosition::VECCALC> rowBuf, rowCalBuf, quarterBuf, cosBuf, sinBuf, compactBuf, xBuf, splitBuf, offsetBuf;
+    // InitInvFreq only. freqBuf: inv_freq and (4096 * inv_freq) mod 2 * pi, each [rotaryDim / 2],
+    // angleBuf: hi and lo partial angles of the tile, [2, maxTokens, rotaryDim / 2],
+    // floorBuf: float and int32 scratch of ReduceAngle, each [maxTokens, rotaryDim / 2].
+    TBuf<TPosition::VECCALC> freqBuf, angleBuf, floorBuf;
+};
+
+template <typename T>
+__aicore__ inline void RopeRotator<T>::Init(
+        TPipe* pipe, uint64_t maxTokens, uint64_t numHeads, uint64_t headSize,
+        uint64_t rotaryDim, uint64_t isNeoxStyle)
+{
+    this->maxTokens = maxTokens;
+    this->numHeads = numHeads;
+    this->headSize = headSize;
+    this->rotaryDim = rotaryDim;
+    this->isNeoxStyle = isNeoxStyle;
+    halfDim = rotaryDim / 2;
+    maxRows = maxTokens * numHeads;
+    rotaryBlockLenT = static_cast<uint16_t>(rotaryDim * sizeof(T) / BLOCK_SIZE);
+    halfBlockLen = static_cast<uint16_t>(halfDim / ELE_NUM_FP32);
+
+    pipe->InitBuffer(quarterBuf, 6 * maxTokens * halfDim * sizeof(float));
+    pipe->InitBuffer(cosBuf, maxRows * halfDim * sizeof(float));
+    pipe->InitBuffer(sinBuf, maxRows * halfDim * sizeof(float));
+    pipe->InitBuffer(splitBuf, maxRows * rotaryDim * sizeof(float));
+    if (headSize != rotaryDim) {
+        pipe->InitBuffer(compactBuf, maxRows * rotaryDim * sizeof(T));
+    } else {
+        pipe->InitBuffer(compactBuf, 0 * sizeof(T));
+    }
+    if constexpr (IsSameType<T, float>::value) {
+        // the key rows are already float
+        pipe->InitBuffer(xBuf, 0 * sizeof(float));
+    } else {
+        pipe->InitBuffer(xBuf, maxRows * rotaryDim * sizeof(float));
+    }
+
+    if (isNeoxStyle == 0) {
+        // GPT-J style: offsets that re-interleave [x1 | x2] back into pairs, built once.
+        // offset[row * rotaryDim + 2 * i + j] = (j * maxRows * halfDim + row * halfDim + i) * sizeof(float)
+        pipe->InitBuffer(offsetBuf, maxRows * rotaryDim * sizeof(uint32_t));
+        LocalTensor<int32_t> offsetLocal = offsetBuf.Get<int32_t>();
+        for (uint32_t i = 0; i < halfDim; i++) {
+            offsetLocal.SetValue(i * 2, i * sizeof(float));
+            offsetLocal.SetValue(i * 2 + 1, (maxRows * halfDim + i) * sizeof(float));
+        }
+        PipeBarrier<PIPE_ALL>();
+        for (uint64_t rows = 1; rows < maxRows; rows *= 2) {
+            uint64_t copyRows = (2 * rows <= maxRows) ? rows : (maxRows - rows);
+            Adds(offsetLocal[rows * rotaryDim], offsetLocal,
+                 static_cast<int32_t>(rows * halfDim * sizeof(float)),
+                 static_cast<int32_t>(copyRows * rotaryDim));
+            PipeBarrier<PIPE_V>();
+        }
+    } else {
+        pipe->InitBuffer(offsetBuf, 0 * sizeof(uint32_t));
+    }
+}
+
+template <typename T>
+__aicore__ inline void RopeRotator<T>::InitCosSinCache(TPipe* pipe)
+{
+    pipe->InitBuffer(rowBuf, 2 * maxTokens * rotaryDim * sizeof(T));
+    if constexpr (IsSameType<T, float>::value) {
+        // the cache rows are already float
+        pipe->InitBuffer(rowCalBuf, 0 * sizeof(float));
+    } else {
+        pipe->InitBuffer(rowCalBuf, 2 * maxTokens * rotaryDim * sizeof(float));
+    }
+}
+
+template <typename T>
+__aicore__ inline void RopeRotator<T>::InitInvFreq(TPipe* pipe, GM_ADDR invFreq)
+{
+    invFreqMode = true;
+    // rowBuf/rowCalBuf are never allocated, the cos/sin cache is not read
+    pipe->InitBuffer(freqBuf, 2 * halfDim * sizeof(float));
+    pipe->InitBuffer(angleBuf, 2 * maxTokens * halfDim * sizeof(float));
+    pipe->InitBuffer(floorBuf, 2 * maxTokens * halfDim * sizeof(float));
+
+    GlobalTensor<float> invFreqGM;
+    invFreqGM.SetGlobalBuffer((__gm__ float*)invFreq, halfDim);
+    LocalTensor<float> freqLocal = freqBuf.Get<float>();
+    DataCopy(freqLocal, invFreqGM, {1, halfBlockLen, 0, 0});
+    PipeBarrier<PIPE_ALL>();
+
+    // the hi part of a shift is a multiple of 4096, scaling by a power of 2 is exact
+    LocalTensor<float> bigFreq = freqLocal[halfDim];
+    Muls(bigFreq, freqLocal, static_cast<float>(1 << SHIFT_SPLIT_BITS), static_cast<uint32_t>(halfDim));
+    PipeBarrier<PIPE_V>();
+    ReduceAngle(bigFreq, static_cast<uint32_t>(halfDim));
+}
+
+template <typename T>
+__aicore__ inline void RopeRotator<T>::ReduceAngle(const LocalTensor<float>& x, uint32_t count)
+{
+    LocalTensor<float> n = floorBuf.Get<float>();
+    LocalTensor<int32_t> nInt = floorBuf.Get<int32_t>()[maxTokens * halfDim];
+    // n = floor(x / 2pi), x -= n * 2pi in two steps to keep the low bits of 2pi
+    Muls(n, x, INV_TWO_PI, count);
+    PipeBarrier<PIPE_V>();
+    Cast(nInt, n, AscendC::RoundMode::CAST_FLOOR, count);
+    PipeBarrier<PIPE_V>();
+    Cast(n, nInt, AscendC::RoundMode::CAST_NONE, count);
+    PipeBarrier<PIPE_V>();
+    Axpy(x, n, -TWO_PI_HI, count);
+    PipeBarrier<PIPE_V>();
+    Axpy(x, n, -TWO_PI_LO, count);
+    PipeBarrier<PIPE_V>();
+}
+
+template <typename T>
+__aicore__ inline void RopeRotator<T>::SetShift(uint64_t i, int64_t shift)
+{
+    // shift = sign * (hi * 4096 + lo), both parts carry the sign
+    int64_t absShift = shift < 0 ? -shift : shift;
+    float hi = static_cast<float>(absShift >> SHIFT_SPLIT_BITS);
+    float lo = static_cast<float>(absShift & ((1 << SHIFT_SPLIT_BITS) - 1));
+    if (shift < 0) {
+        hi = -hi;
+        lo = -lo;
+    }
+    LocalTensor<float> freqLocal = freqBuf.Get<float>();
+    LocalTensor<float> angleLocal = angleBuf.Get<float>();
+    Muls(angleLocal[i * halfDim], freqLocal[halfDim], hi, static_cast<uint32_t>(halfDim));
+    Muls(angleLocal[(maxTokens + i) * halfDim], freqLocal, lo, static_cast<uint32_t>(halfDim));
+}
+
+template <typename T>
+__aicore__ inline void RopeRotator<T>::BuildCosSinFromShifts(uint64_t loopN)
+{
+    LocalTensor<float> angleLocal = angleBuf.Get<float>();
+    LocalTensor<float> quarterLocal = quarterBuf.Get<float>();
+    LocalTensor<float> cosLocal = cosBuf.Get<float>();
+    LocalTensor<float> sinLocal = sinBuf.Get<float>();
+    PipeBarrier<PIPE_ALL>();
+
+    uint64_t quarterSize = maxTokens * halfDim;
+    uint32_t count = static_cast<uint32_t>(loopN * halfDim);
+    LocalTensor<float> hiAngle = angleLocal;
+    LocalTensor<float> loAngle = angleLocal[quarterSize];
+    ReduceAngle(hiAngle, count);
+    ReduceAngle(loAngle, count);
+
+    LocalTensor<float> hiCos = quarterLocal;
+    LocalTensor<float> hiSin = quarterLocal[quarterSize];
+    LocalTensor<float> loCos = quarterLocal[2 * quarterSize];
+    LocalTensor<float> loSin = quarterLocal[3 * quarterSize];
+    LocalTensor<float> deltaCos = (numHeads == 1) ? cosLocal : quarterLocal[4 * quarterSize];
+    LocalTensor<float> deltaSin = (numHeads == 1) ? sinLocal : quarterLocal[5 * quarterSize];
+    Cos(hiCos, hiAngle, count);
+    Sin(hiSin, hiAngle, count);
+    Cos(loCos, loAngle, count);
+    Sin(loSin, loAngle, count);
+    PipeBarrier<PIPE_V>();
+
+    // cos(a + b) = cos(a)cos(b) - sin(a)sin(b), sin(a + b) = sin(a)cos(b) + cos(a)sin(b)
+    LocalTensor<float> tmpLocal = hiAngle;
+    Mul(deltaCos, hiCos, loCos, count);
+    Mul(tmpLocal, hiSin, loSin, count);
+    PipeBarrier<PIPE_V>();
+    Sub(deltaCos, deltaCos, tmpLocal, count);
+    PipeBarrier<PIPE_V>();
+    Mul(deltaSin, hiSin, loCos, count);
+    Mul(tmpLocal, hiCos, loSin, count);
+    PipeBarrier<PIPE_V>();
+    Add(deltaSin, deltaSin, tmpLocal, count);
+    PipeBarrier<PIPE_V>();
+
+    BroadcastHeads(deltaCos, deltaSin, loopN);
+}
+
+template <typename T>
+__aicore__ inline void RopeRotator<T>::BroadcastHeads(
+        const LocalTensor<float>& deltaCos, const LocalTensor<float>& deltaSin, uint64_t loopN)
+{
+    if (numHeads == 1) {
+        return;
+    }
+    LocalTensor<float> cosLocal = cosBuf.Get<float>();
+    LocalTensor<float> sinLocal = sinBuf.Get<float>();
+    uint32_t dstShape[2] = {static_cast<uint32_t>(numHeads), static_cast<uint32_t>(halfDim)};
+    uint32_t srcShape[2] = {1, static_cast<uint32_t>(halfDim)};
+    for (uint32_t i = 0; i < loopN; ++i) {
+        Broadcast<float, 2, 0, false>(cosLocal[i * numHeads * halfDim], deltaCos[i * halfDim], dstShape, srcShape);
+        Broadcast<float, 2, 0, false>(sinLocal[i * numHeads * halfDim], deltaSin[i * halfDim], dstShape, srcShape);
+    }
+    PipeBarrier<PIPE_V>();
+}
+
+template <typename T>
+__aicore__ inline void RopeRotator<T>::CopyInCosSinRows(
+        uint64_t i, GlobalTensor<T>& cosSinCacheGM, uint64_t oldPos, uint64_t newPos)
+{
+    if (invFreqMode) {
+        SetShift(i, static_cast<int64_t>(newPos) - static_cast<int64_t>(oldPos));
+        return;
+    }
+    LocalTensor<T> rowLocal = rowBuf.Get<T>();
+    DataCopy(rowLocal[i * rotaryDim], cosSinCacheGM[oldPos * rotaryDim], {1, rotaryBlockLenT, 0, 0});
+    DataCopy(rowLocal[(maxTokens + i) * rotaryDim], cosSinCacheGM[newPos * rotaryDim], {1, rotaryBlockLenT, 0, 0});
+}
+
+template <typename T>
+__aicore__ inline void RopeRotator<T>::BuildCosSin(uint64_t loopN)
+{
+    if (invFreqMode) {
+        BuildCosSinFromShifts(loopN);
+        return;
+    }
+    LocalTensor<T> rowLocal = rowBuf.Get<T>();
+    LocalTensor<float> quarterLocal = quarterBuf.Get<float>();
+    LocalTensor<float> cosLocal = cosBuf.Get<float>();
+    LocalTensor<float> sinLocal = sinBuf.Get<float>();
+    PipeBarrier<PIPE_ALL>();
+
+    LocalTensor<float> rowCalLocal;
+    if constexpr (IsSameType<T, float>::value) {
+        rowCalLocal = rowLocal;
+    } else {
+        rowCalLocal = rowCalBuf.Get<float>();
+        Cast(rowCalLocal, rowLocal, AscendC::RoundMode::CAST_NONE, static_cast<uint32_t>(2 * maxTokens * rotaryDim));
+        PipeBarrier<PIPE_V>();
+    }
+
+    // cache rows are [cos | sin], each rotaryDim / 2 long
+    uint64_t quarterSize = maxTokens * halfDim;
+    LocalTensor<float> oldCos = quarterLocal;
+    LocalTensor<float> oldSin = quarterLocal[quarterSize];
+    LocalTensor<float> newCos = quarterLocal[2 * quarterSize];
+    LocalTensor<float> newSin = quarterLocal[3 * quarterSize];
+    LocalTensor<float> deltaCos = (numHeads == 1) ? cosLocal : quarterLocal[4 * quarterSize];
+    LocalTensor<float> deltaSin = (numHeads == 1) ? sinLocal : quarterLocal[5 * quarterSize];
+    LocalTensor<float> tmpLocal = rowCalLocal;
+
+    DataCopyParams halfParams = {static_cast<uint16_t>(loopN), halfBlockLen, halfBlockLen, 0};
+    DataCopy(oldCos, rowCalLocal, halfParams);
+    DataCopy(oldSin, rowCalLocal[halfDim], halfParams);
+    DataCopy(newCos, rowCalLocal[maxTokens * rotaryDim], halfParams);
+    DataCopy(newSin, rowCalLocal[maxTokens * rotaryDim + halfDim], halfParams);
+    PipeBarrier<PIPE_ALL>();
+
+    uint32_t count = static_cast<uint32_t>(loopN * halfDim);
+    Mul(deltaCos, newCos, oldCos, count);
+    Mul(tmpLocal, newSin, oldSin, count);
+    PipeBarrier<PIPE_V>();
+    Add(deltaCos, deltaCos, tmpLocal, count);
+    PipeBarrier<PIPE_V>();
+    Mul(deltaSin, newSin, oldCos, count);
+    Mul(tmpLocal, newCos, oldSin, count);
+    PipeBarrier<PIPE_V>();
+    Sub(deltaSin, deltaSin, tmpLocal, count);
+    PipeBarrier<PIPE_V>();
+
+    BroadcastHeads(deltaCos, deltaSin, loopN);
+}
+
+template <typename T>
+__aicore__ inline void RopeRotator<T>::SplitHalves(const LocalTensor<float>& xLocal, uint64_t rows)
+{
+    LocalTensor<float> splitLocal = splitBuf.Get<float>();
+    LocalTensor<float> x1 = splitLocal;
+    LocalTensor<float> x2 = splitLocal[maxRows * halfDim];
+    if (isNeoxStyle == 0) {
+        // GPT-J style
+        uint64_t rsv = 0;
+        uint32_t count = static_cast<uint32_t>(rows * rotaryDim);
+        GatherMask(x1, xLocal, static_cast<uint8_t>(1), true, count, {1, 1, 8, 0}, rsv);
+        GatherMask(x2, xLocal, static_cast<uint8_t>(2), true, count, {1, 1, 8, 0}, rsv);
+        PipeBarrier<PIPE_V>();
+    } else {
+        DataCopyParams halfParams = {static_cast<uint16_t>(rows), halfBlockLen, halfBlockLen, 0};
+        DataCopy(x1, xLocal, halfParams);
+        DataCopy(x2, xLocal[halfDim], halfParams);
+        PipeBarrier<PIPE_ALL>();
+    }
+}
+
+template <typename T>
+__aicore__ inline void RopeRotator<T>::MergeHalves(const LocalTensor<float>& xLocal, uint64_t rows)
+{
+    LocalTensor<float> splitLocal = splitBuf.Get<float>();
+    if (isNeoxStyle == 0) {
+        // GPT-J style
+        LocalTensor<uint32_t> offsetLocal = offsetBuf.Get<uint32_t>();
+        Gather(xLocal, splitLocal, offsetLocal, (uint32_t)0, static_cast<uint32_t>(rows * rotaryDim));
+        PipeBarrier<PIPE_V>();
+    } else {
+        DataCopyParams halfParams = {static_cast<uint16_t>(rows), halfBlockLen, 0, halfBlockLen};
+        DataCopy(xLocal, splitLocal, halfParams);
+        DataCopy(xLocal[halfDim], splitLocal[maxRows * halfDim], halfParams);
+        PipeBarrier<PIPE_ALL>();
+    }
+}
+
+template <typename T>
+__aicore__ inline void RopeRotator<T>::Rotate(const LocalTensor<T>& keyLocal, uint64_t loopN, uint64_t rowStride)
+{
+    uint64_t rows = loopN * numHeads;
+    uint32_t rotaryCount = static_cast<uint32_t>(rows * rotaryDim);
+    uint16_t rowGapBlockLenT = static_cast<uint16_t>((rowStride - rotaryDim) * sizeof(T) / BLOCK_SIZE);
+    LocalTensor<float> splitLocal = splitBuf.Get<float>();
+    LocalTensor<float> cosLocal = cosBuf.Get<float>();
+    LocalTensor<float> sinLocal = sinBuf.Get<float>();
+
+    LocalTensor<T> rotaryLocal = keyLocal;
+    if (rowStride != rotaryDim) {
+        rotaryLocal = compactBuf.Get<T>();
+        DataCopy(rotaryLocal, keyLocal, {static_cast<uint16_t>(rows), rotaryBlockLenT, rowGapBlockLenT, 0});
+        PipeBarrier<PIPE_ALL>();
+    }
+
+    LocalTensor<float> xLocal;
+    if constexpr (IsSameType<T, float>::value) {
+        xLocal = rotaryLocal;
+    } else {
+        xLocal = xBuf.Get<float>();
+        Cast(xLocal, rotaryLocal, AscendC::RoundMode::CAST_NONE, rotaryCount);
+        PipeBarrier<PIPE_V>();
+    }
+
+    SplitHalves(xLocal, rows);
+
+    // x1' = x1 × cosθ - x2 × sinθ, x2' = x2 × cosθ + x1 × sinθ, with θ = θ_new - θ_old
+    uint32_t count = static_cast<uint32_t>(rows * halfDim);
+    LocalTensor<float> x1 = splitLocal;
+    LocalTensor<float> x2 = splitLocal[maxRows * halfDim];
+    LocalTensor<float> x2Sin = xLocal;
+    LocalTensor<float> x1Sin = xLocal[rows * halfDim];
+    Mul(x2Sin, x2, sinLocal, count);
+    Mul(x1Sin, x1, sinLocal, count);
+    Mul(x1, x1, cosLocal, count);
+    Mul(x2, x2, cosLocal, count);
+    PipeBarrier<PIPE_V>();
+    Sub(x1, x1, x2Sin, count);
+    Add(x2, x2, x1Sin, count);
+    PipeBarrier<PIPE_V>();
+
+    MergeHalves(xLocal, rows);
+
+    if constexpr (!IsSameType<T, float>::value) {
+        #if ASCEND_AICORE_ARCH >= 220
+            Cast(rotaryLocal, xLocal, AscendC::RoundMode::CAST_RINT, rotaryCount);
+        #else
+            Cast(rotaryLocal, xLocal, AscendC::RoundMode::CAST_NONE, rotaryCount);
+        #endif
+    }
+    PipeBarrier<PIPE_ALL>();
+
+    if (rowStride != rotaryDim) {
+        DataCopy(keyLocal, rotaryLocal, {static_cast<uint16_t>(rows), rotaryBlockLenT, 0, rowGapBlockLenT});
+        PipeBarrier<PIPE_ALL>();
+    }
+}
+}
+
+#endif
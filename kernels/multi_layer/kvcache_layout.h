@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2025. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+ 
+#ifndef KVCACHE_LAYOUT_H
+#define KVCACHE_LAYOUT_H
+
+#include "kernel_operator.h"
+#include "../types.h"
+
+namespace kvcache_ops {
+
+// Helper function to get layer base pointer based on KVCache format
+template <KVCacheFormat fmt>
+__aicore__ inline __gm__ uint8_t* GetLayerBasePtr(
+    GM_ADDR pagedKVCaches, 
+    int32_t layerIdx, 
+    int32_t kvIdx) 
+{   
+    // its a pointer within the GM addr space, that point to another GM addr space
+    __gm__ uint8_t * __gm__ *pagedKVCachesPtr = 
+        reinterpret_cast<__gm__ uint8_t* __gm__ *>(pagedKVCaches);
+    
+    // getting the right ptr to the paged kvcache layer
+    if constexpr (fmt == KVCacheFormat::MERGED_KV) {
+        return pagedKVCachesPtr[layerIdx];
+    } else if constexpr (fmt == KVCacheFormat::SEPARATE_KV || fmt == KVCacheFormat::MLA_KV) {
+        return pagedKVCachesPtr[layerIdx * 2 + kvIdx];
+    } else if constexpr (fmt == KVCacheFormat::DSA_KV) {
+        return pagedKVCachesPtr[layerIdx * 3 + kvIdx];
+    }
+}
+
+// Cache component that holds the rotary embedded part of the keys:
+// the key cache for MERGED_KV / SEPARATE_KV, the decoupled k_pe cache for MLA_KV.
+template <KVCacheFormat fmt>
+__aicore__ inline constexpr int32_t GetRopeCacheIdx()
+{
+    if constexpr (fmt == KVCacheFormat::MLA_KV) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+} // namespace kvcache_ops
+
+#endif // KVCACHE_LAYOUT_H
@@ -19,6 +19,7 @@
 
 #include "kernel_operator.h"
 #include "../types.h"
+#include "kvcache_layout.h"
 #include <stdexcept>
 #include <string>
 
@@ -48,6 +49,18 @@ struct V2Config {
     int32_t maxTokensPerLoop; // num tokens per inner loop for transferring
 };
 
+struct V2RopeConfig {
+    V2Config v2;
+    uint8_t* oldPositions; // [numTokensChunk] uint64, positions the chunk was rotated with
+    uint8_t* newPositions; // [numTokensChunk] uint64, positions the chunk is reloaded at
+    uint8_t* cosSinCache; // [maxPosition, rotaryDim], [cos | sin] per row
+    int32_t numHeads; // heads of the rotated component
+    int32_t headSize; // stride of the head rows of the rotated component
+    int32_t rotaryDim; // leading elements of every head that are rotated
+    bool isNeoxStyle;
+    int32_t ropeTokensPerLoop; // num tokens rotated at once within a transfer loop
+};
+
 inline StandardConfig MakeStandardConfig(
     int64_t hiddenDims, int32_t numLayers, int64_t pageBuffSize,
     int32_t numTokensChunk, int32_t kvs, bool page2L)
@@ -88,25 +101,21 @@ inline V2Config MakeV2Config(
     return cfg;
 }
 
-// Helper function to get layer base pointer based on KVCache format
-template <KVCacheFormat fmt>
-__aicore__ inline __gm__ uint8_t* GetLayerBasePtr(
-    GM_ADDR pagedKVCaches, 
-    int32_t layerIdx, 
-    int32_t kvIdx) 
-{   
-    // its a pointer within the GM addr space, that point to another GM addr space
-    __gm__ uint8_t * __gm__ *pagedKVCachesPtr = 
-        reinterpret_cast<__gm__ uint8_t* __gm__ *>(pagedKVCaches);
-    
-    // getting the right ptr to the paged kvcache layer
-    if constexpr (fmt == KVCacheFormat::MERGED_KV) {
-        return pagedKVCachesPtr[layerIdx];
-    } else if constexpr (fmt == KVCacheFormat::SEPARATE_KV || fmt == KVCacheFormat::MLA_KV) {
-        return pagedKVCachesPtr[layerIdx * 2 + kvIdx];
-    } else if constexpr (fmt == KVCacheFormat::DSA_KV) {
-        return pagedKVCachesPtr[layerIdx * 3 + kvIdx];
-    }
+inline V2RopeConfig MakeV2RopeConfig(
+    const V2Config& v2, uint8_t* oldPositions, uint8_t* newPositions, uint8_t* cosSinCache,
+    int32_t numHeads, int32_t headSize, int32_t rotaryDim, bool isNeoxStyle, int32_t ropeTokensPerLoop)
+{
+    V2RopeConfig cfg;
+    cfg.v2 = v2;
+    cfg.oldPositions = oldPositions;
+    cfg.newPositions = newPositions;
+    cfg.cosSinCache = cosSinCache;
+    cfg.numHeads = numHeads;
+    cfg.headSize = headSize;
+    cfg.rotaryDim = rotaryDim;
+    cfg.isNeoxStyle = isNeoxStyle;
+    cfg.ropeTokensPerLoop = ropeTokensPerLoop;
+    return cfg;
 }
 
 template <typename scalar_t, typename slot_t, KVCacheFormat fmt>
@@ -602,6 +611,20 @@ struct V2Launcher {
         int64_t dsaHiddenDims = 0);
 };
 
+template<typename scalar_t, typename slot_t, KVCacheFormat fmt>
+struct V2RopeLauncher {
+    static void Launch(
+        uint32_t blockDim, 
+        void* stream, 
+        uint8_t* pagedKVCaches, 
+        uint8_t* srcCacheTensor, 
+        uint8_t* slotmappings,
+        const V2RopeConfig& config,
+        int64_t kHiddenDims = 0,
+        int64_t vHiddenDims = 0,
+        int64_t dsaHiddenDims = 0);
+};
+
 template<template<typename, typename, KVCacheFormat> class LauncherT, typename scalar_t, typename slot_t, typename ConfigT>
 void dispatch_paged_kernel_on_format(
     KVCacheFormat kvcacheFormat, 
@@ -15,10 +15,13 @@
  */
 
 #include "multi_layer_mem_kernels.h"
+#include "../fused_rope/fused_rope_rotator.h"
 #include <stdexcept>
 #include <string>
 
-template <typename scalar_t, typename slot_t, kvcache_ops::KVCacheFormat kvcache_fmt> 
+// withRope: L2Page only, the rotary component of every layer is re-rotated from oldPositions to
+// newPositions while its token tile is in UB, before being scattered into the pages.
+template <typename scalar_t, typename slot_t, kvcache_ops::KVCacheFormat kvcache_fmt, bool withRope = false> 
 class MultiLayerPagedKVCopyV2 {
     using local_scalar_t = AscendC::LocalTensor<scalar_t>;
 
@@ -54,6 +57,45 @@ public:
         this->pipe_->InitBuffer(pagedTokenQue_, 2, this->perLoopBuffSize_);
     }
 
+    __aicore__ inline void initRope(GM_ADDR oldPositions, GM_ADDR newPositions, GM_ADDR cosSinCache,
+                                    const int32_t numHeads, const int32_t headSize, const int32_t rotaryDim,
+                                    const bool isNeoxStyle, const int32_t ropeTokensPerLoop)
+    {
+        this->headSize_ = headSize;
+        this->ropeTokensPerLoop_ = ropeTokensPerLoop;
+        this->oldPositionGlobal_.SetGlobalBuffer(reinterpret_cast<__gm__ uint64_t*>(oldPositions), 
+                                                 this->numTokensChunk_);
+        this->newPositionGlobal_.SetGlobalBuffer(reinterpret_cast<__gm__ uint64_t*>(newPositions), 
+                                                 this->numTokensChunk_);
+        this->cosSinCacheGlobal_.SetGlobalBuffer(reinterpret_cast<__gm__ scalar_t*>(cosSinCache));
+        this->rotator_.Init(this->pipe_, ropeTokensPerLoop, numHeads, headSize, rotaryDim, isNeoxStyle);
+        this->rotator_.InitCosSinCache(this->pipe_);
+    }
+
+    // rotates the tokens [startTokensIdx, endTokensIdx) of the tile, ropeTokensPerLoop at a time
+    __aicore__ inline void _rotateTile(const local_scalar_t &tileBuffer, __gm__ slot_t *slotmappingPtr,
+                                       const int64_t hiddenDims, const int32_t startTokensIdx,
+                                       const int32_t endTokensIdx)
+    {
+        for (int32_t subStartIdx = startTokensIdx; subStartIdx < endTokensIdx; 
+             subStartIdx += this->ropeTokensPerLoop_) {
+            int32_t subEndIdx = min(subStartIdx + this->ropeTokensPerLoop_, endTokensIdx);
+            for (int32_t tokenIdx = subStartIdx; tokenIdx < subEndIdx; tokenIdx++) {
+                // padded tokens may carry positions outside the cos/sin cache
+                if (static_cast<int64_t>(slotmappingPtr[tokenIdx]) < 0) {
+                    continue;
+                }
+                uint64_t oldPos = this->oldPositionGlobal_.GetValue(tokenIdx);
+                uint64_t newPos = this->newPositionGlobal_.GetValue(tokenIdx);
+                AscendC::PipeBarrier<PIPE_ALL>();
+                this->rotator_.CopyInCosSinRows(tokenIdx - subStartIdx, this->cosSinCacheGlobal_, oldPos, newPos);
+            }
+            this->rotator_.BuildCosSin(subEndIdx - subStartIdx);
+            this->rotator_.Rotate(tileBuffer[(subStartIdx - startTokensIdx) * hiddenDims], 
+                                  subEndIdx - subStartIdx, this->headSize_);
+        }
+    }
+
     __aicore__ inline int64_t GetHiddenDims(const int cacheIdx) {
         if constexpr (kvcache_fmt == kvcache_ops::KVCacheFormat::MLA_KV) {
             return (cacheIdx == 0) ? this->kHiddenDims_ : this->vHiddenDims_;
@@ -149,6 +191,12 @@ public:
         pagedTokenQue_.EnQue(perLayerSingleCacheBuffer);
         perLayerSingleCacheBuffer = pagedTokenQue_.DeQue<scalar_t>();
 
+        if constexpr (withRope) {
+            if (cacheIdx == kvcache_ops::GetRopeCacheIdx<kvcache_fmt>()) {
+                this->_rotateTile(perLayerSingleCacheBuffer, slotmappingPtr, hiddenDims, startTokensIdx, endTokensIdx);
+            }
+        }
+
         // 4. now this is in ub
         int64_t slot;
         int64_t tmpPagedOffset;
@@ -233,6 +281,14 @@ private:
     int64_t kHiddenDims_;
     int64_t vHiddenDims_;
     int64_t dsaHiddenDims_;
+
+    // For withRope: positions of the chunk tokens and the cos/sin cache of the rotary component
+    AscendC::GlobalTensor<uint64_t> oldPositionGlobal_;
+    AscendC::GlobalTensor<uint64_t> newPositionGlobal_;
+    AscendC::GlobalTensor<scalar_t> cosSinCacheGlobal_;
+    FusedRope::RopeRotator<scalar_t> rotator_;
+    int32_t headSize_;
+    int32_t ropeTokensPerLoop_;
 };
 
 #define MULTI_LAYER_PAGED_KV_COPY_V2_KERNEL_NAME(TYPE, SLOTTYPE, FMT) \
@@ -263,6 +319,39 @@ private:
         }                                                                                               \
     }
 
+#define MULTI_LAYER_PAGED_KV_COPY_V2_ROPE_KERNEL_NAME(TYPE, SLOTTYPE, FMT) \
+    multi_layer_paged_kv_copy_v2_rope_##TYPE##_##SLOTTYPE##_##FMT
+
+#define MULTI_LAYER_PAGED_KV_COPY_V2_ROPE_DECLARE(TYPE, SLOTTYPE, FMT)                                \
+    extern "C" __global__ __aicore__ void MULTI_LAYER_PAGED_KV_COPY_V2_ROPE_KERNEL_NAME(TYPE, SLOTTYPE, FMT)( \
+        __gm__ uint8_t* pagedKVCaches, __gm__ uint8_t* srcCacheTensor, __gm__ uint8_t* slotmappings,    \
+        __gm__ uint8_t* oldPositions, __gm__ uint8_t* newPositions, __gm__ uint8_t* cosSinCache,        \
+        const int64_t hiddenDims, const int32_t kvs, const int32_t numLayers,                           \
+        const int64_t pageBuffSize, const int32_t numTokensChunk,                                       \
+        const int64_t perLoopBuffer, const int32_t maxTokensPerLoop,                                    \
+        const int64_t kHiddenDims, const int64_t vHiddenDims, const int64_t dsaHiddenDims,              \
+        const int32_t numHeads, const int32_t headSize, const int32_t rotaryDim,                        \
+        const bool isNeoxStyle, const int32_t ropeTokensPerLoop)                                        \
+    {                                                                                                   \
+        AscendC::TPipe pipe;                                                                            \
+        MultiLayerPagedKVCopyV2<TYPE, SLOTTYPE, kvcache_ops::KVCacheFormat::FMT, true> op{};            \
+        int32_t bIdx = AscendC::GetBlockIdx();                                                          \
+        int32_t launchedCores = AscendC::GetBlockNum();                                                 \
+        int32_t layersPerCore = (numLayers + launchedCores - 1) / launchedCores;                        \
+        int32_t startLayersIdx = bIdx * layersPerCore;                                                  \
+        int32_t endLayersIdx = min(numLayers, startLayersIdx + layersPerCore);                          \
+        op.init(pagedKVCaches, srcCacheTensor, slotmappings, hiddenDims,                                \
+                numLayers, pageBuffSize, numTokensChunk, perLoopBuffer, maxTokensPerLoop, false, &pipe,  \
+                kHiddenDims, vHiddenDims, dsaHiddenDims);                                               \
+        op.initRope(oldPositions, newPositions, cosSinCache, numHeads, headSize, rotaryDim,             \
+                    isNeoxStyle, ropeTokensPerLoop);                                                    \
+        for (int32_t layerIdx = startLayersIdx; layerIdx < endLayersIdx; layerIdx++) {                  \
+            for (int32_t cacheIdx = 0; cacheIdx < kvs; cacheIdx++) {                                    \
+                op.processLayerCache(pagedKVCaches, srcCacheTensor, slotmappings, cacheIdx, layerIdx, false); \
+            }                                                                                           \
+        }                                                                                               \
+    }
+
 #define EXPAND_FMT_V2(TYPE, SLOTTYPE) \
     MULTI_LAYER_PAGED_KV_COPY_V2_DECLARE(TYPE, SLOTTYPE, MERGED_KV) \
     MULTI_LAYER_PAGED_KV_COPY_V2_DECLARE(TYPE, SLOTTYPE, SEPARATE_KV) \
@@ -280,6 +369,21 @@ EXPAND_SLOT_V2(int8_t)
 EXPAND_SLOT_V2(bfloat16_t)
 #endif
 
+// DSA_KV has no rope variant: its indexer keys are not re-rotated here.
+#define EXPAND_FMT_V2_ROPE(TYPE, SLOTTYPE) \
+    MULTI_LAYER_PAGED_KV_COPY_V2_ROPE_DECLARE(TYPE, SLOTTYPE, MERGED_KV) \
+    MULTI_LAYER_PAGED_KV_COPY_V2_ROPE_DECLARE(TYPE, SLOTTYPE, SEPARATE_KV) \
+    MULTI_LAYER_PAGED_KV_COPY_V2_ROPE_DECLARE(TYPE, SLOTTYPE, MLA_KV)
+
+#define EXPAND_SLOT_V2_ROPE(TYPE) \
+    EXPAND_FMT_V2_ROPE(TYPE, int32_t) \
+    EXPAND_FMT_V2_ROPE(TYPE, int64_t)
+
+EXPAND_SLOT_V2_ROPE(half)
+#if (__CCE_AICORE__ >= 220)
+EXPAND_SLOT_V2_ROPE(bfloat16_t)
+#endif
+
 namespace kvcache_ops {
 
 #define SPECIALIZE_V2_LAUNCHER(TYPE, SLOTTYPE, FMT)                                                    \
@@ -316,6 +420,56 @@ EXPAND_V2_LAUNCHER_SLOT(int8_t)
 EXPAND_V2_LAUNCHER_SLOT(bfloat16_t)
 #endif
 
+#define SPECIALIZE_V2_ROPE_LAUNCHER(TYPE, SLOTTYPE, FMT)                                               \
+template<>                                                                                             \
+struct V2RopeLauncher<TYPE, SLOTTYPE, KVCacheFormat::FMT> {                                            \
+    static void Launch(uint32_t blockDim, void *stream,                                                \
+                      uint8_t *pagedKVCaches, uint8_t *srcCacheTensor, uint8_t *slotmappings,          \
+                      const V2RopeConfig& config,                                                      \
+                      int64_t kHiddenDims = 0, int64_t vHiddenDims = 0, int64_t dsaHiddenDims = 0)     \
+    {                                                                                                  \
+        MULTI_LAYER_PAGED_KV_COPY_V2_ROPE_KERNEL_NAME(TYPE, SLOTTYPE, FMT)<<<blockDim, nullptr, stream>>>( \
+            pagedKVCaches, srcCacheTensor, slotmappings,                                               \
+            config.oldPositions, config.newPositions, config.cosSinCache,                              \
+            config.v2.common.hiddenDims, config.v2.common.kvs, config.v2.common.numLayers,             \
+            config.v2.common.pageBuffSize, config.v2.common.numTokensChunk,                            \
+            config.v2.perLoopBuffSize, config.v2.maxTokensPerLoop,                                     \
+            kHiddenDims, vHiddenDims, dsaHiddenDims,                                                   \
+            config.numHeads, config.headSize, config.rotaryDim,                                        \
+            config.isNeoxStyle, config.ropeTokensPerLoop);                                             \
+    }                                                                                                  \
+};
+
+#define SPECIALIZE_V2_ROPE_LAUNCHER_UNSUPPORTED(TYPE, SLOTTYPE, FMT)                                   \
+template<>                                                                                             \
+struct V2RopeLauncher<TYPE, SLOTTYPE, KVCacheFormat::FMT> {                                            \
+    static void Launch(uint32_t blockDim, void *stream,                                                \
+                      uint8_t *pagedKVCaches, uint8_t *srcCacheTensor, uint8_t *slotmappings,          \
+                      const V2RopeConfig& config,                                                      \
+                      int64_t kHiddenDims = 0, int64_t vHiddenDims = 0, int64_t dsaHiddenDims = 0)     \
+    {                                                                                                  \
+        (void)blockDim; (void)stream; (void)pagedKVCaches; (void)srcCacheTensor; (void)slotmappings;  \
+        (void)config; (void)kHiddenDims; (void)vHiddenDims; (void)dsaHiddenDims;                      \
+        ASCENDC_REPORT_NOT_SUPPORT(false, "KVCacheFormat " #FMT " is not supported with rope.")        \
+        throw std::runtime_error("KVCacheFormat " #FMT " is not supported with rope.");              \
+    }                                                                                                  \
+};
+
+#define EXPAND_V2_ROPE_LAUNCHER_FMT(TYPE, SLOTTYPE) \
+    SPECIALIZE_V2_ROPE_LAUNCHER(TYPE, SLOTTYPE, MERGED_KV) \
+    SPECIALIZE_V2_ROPE_LAUNCHER(TYPE, SLOTTYPE, SEPARATE_KV) \
+    SPECIALIZE_V2_ROPE_LAUNCHER(TYPE, SLOTTYPE, MLA_KV) \
+    SPECIALIZE_V2_ROPE_LAUNCHER_UNSUPPORTED(TYPE, SLOTTYPE, DSA_KV)
+
+#define EXPAND_V2_ROPE_LAUNCHER_SLOT(TYPE) \
+    EXPAND_V2_ROPE_LAUNCHER_FMT(TYPE, int32_t) \
+    EXPAND_V2_ROPE_LAUNCHER_FMT(TYPE, int64_t)
+
+EXPAND_V2_ROPE_LAUNCHER_SLOT(half)
+#if (ASCEND_AICORE_ARCH >= 220)
+EXPAND_V2_ROPE_LAUNCHER_SLOT(bfloat16_t)
+#endif
+
 extern void multi_layer_kv_transfer_kernel_v2(kvcache_ops::AscendType type, kvcache_ops::AscendType slotType, 
                                               const kvcache_ops::KVCacheFormat kvcacheFormat,uint32_t blockDim, void *stream,
                                               uint8_t *pagedKVCaches, uint8_t *dstCacheTensor, uint8_t *slotmappings, 
@@ -355,4 +509,46 @@ extern void multi_layer_kv_transfer_kernel_v2(kvcache_ops::AscendType type, kvca
     }
 }
 
-} // namespace kvcache_ops
+// L2Page transfer that also re-rotates the rotary component (see GetRopeCacheIdx) from oldPositions
+// to newPositions, so a reloaded chunk needs no separate RoPE pass over the pages.
+// perLoopBuffer must leave room in UB for the rotator buffers of ropeTokensPerLoop tokens.
+extern void multi_layer_kv_transfer_kernel_v2_rope(kvcache_ops::AscendType type, kvcache_ops::AscendType slotType, 
+                                                   const kvcache_ops::KVCacheFormat kvcacheFormat, uint32_t blockDim, 
+                                                   void *stream, uint8_t *pagedKVCaches, uint8_t *srcCacheTensor, 
+                                                   uint8_t *slotmappings, uint8_t *oldPositions, uint8_t *newPositions,
+                                                   uint8_t *cosSinCache,
+                                                   const int64_t hiddenDims, const int32_t kvs, const int32_t numLayers, 
+                                                   const int64_t pageBuffSize, const int32_t numTokensChunk, 
+                                                   const int64_t perLoopBuffer, const int32_t maxTokensPerLoop,
+                                                   const int32_t numHeads, const int32_t headSize, 
+                                                   const int32_t rotaryDim, const bool isNeoxStyle,
+                                                   const int32_t ropeTokensPerLoop,
+                                                   const int64_t kHiddenDims = 0, const int64_t vHiddenDims = 0, 
+                                                   const int64_t dsaHiddenDims = 0)
+{
+    auto config = kvcache_ops::MakeV2RopeConfig(
+        kvcache_ops::MakeV2Config(hiddenDims, numLayers, pageBuffSize, numTokensChunk, false, kvs,
+                                  perLoopBuffer, maxTokensPerLoop),
+        oldPositions, newPositions, cosSinCache, numHeads, headSize, rotaryDim, isNeoxStyle, ropeTokensPerLoop
+    );
+
+    switch(type) {
+        case kvcache_ops::AscendType::FP16:
+            kvcache_ops::dispatch_paged_kernel_on_slot_type<kvcache_ops::V2RopeLauncher, half>(
+                slotType, kvcacheFormat, blockDim, stream, 
+                pagedKVCaches, srcCacheTensor, slotmappings, config, kHiddenDims, vHiddenDims, dsaHiddenDims);
+            break;    
+#if (ASCEND_AICORE_ARCH >= 220)
+        case kvcache_ops::AscendType::BF16:
+            kvcache_ops::dispatch_paged_kernel_on_slot_type<kvcache_ops::V2RopeLauncher, bfloat16_t>(
+                slotType, kvcacheFormat, blockDim, stream, 
+                pagedKVCaches, srcCacheTensor, slotmappings, config, kHiddenDims, vHiddenDims, dsaHiddenDims);
+            break;
+#endif
+        default:
+            ASCENDC_REPORT_NOT_SUPPORT(false, std::to_string(static_cast<int>(type)) + " is not supported with rope.")
+            throw std::runtime_error("Scalar type: " + std::to_string(static_cast<int>(type)) + " not supported with rope.");
+    }
+}
+
+} // namespace kvcache_ops
\ No newline at end of file
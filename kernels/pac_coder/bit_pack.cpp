@@ -0,0 +1,266 @@
+#include "kernel_operator.h"
+#include <stdexcept>
+#include <string>
+using namespace AscendC;
+
+namespace kvcache_ops {
+namespace pac_coder {
+
+// Fixed width alternative to the PAC streams for symbols of up to N_PACK_BITS_MAX bits, no tables and no
+// rectification. The symbols are taken as one flat array in tiles of N_PACK_TILE, a tile packs to n_bits bit
+// planes of N_PACK_PLANE_BYTES: bit i of plane k is bit k of symbol i of the tile (as a compare mask).
+constexpr int32_t N_PACK_BITS_MAX = 4;
+constexpr int32_t N_PACK_TILE = 8192;
+constexpr int32_t N_PACK_PLANE_BYTES = N_PACK_TILE / 8;
+static_assert(N_PACK_TILE % 128 == 0);
+
+namespace impl {
+class PacBitPacker {
+public:
+    __aicore__ inline PacBitPacker(
+        GM_ADDR syms, // Symbols [n_syms], uint8
+        GM_ADDR planes, // Bit planes [ceil(n_syms / N_PACK_TILE), n_bits, N_PACK_PLANE_BYTES], uint8
+        TPipe& pipe,
+        int64_t n_syms,
+        int32_t n_bits,
+        bool unpacking); // Only the queues of pack() or of unpack() are allocated
+
+    __aicore__ inline void pack(int64_t tile_id);
+    __aicore__ inline void unpack(int64_t tile_id);
+
+private:
+    // Symbols of the tile, fewer than N_PACK_TILE for the last one
+    __aicore__ inline int32_t tile_syms(int64_t tile_id);
+
+    TQue<TPosition::VECIN, 2> symInQ;
+    TQue<TPosition::VECOUT, 2> symOutQ;
+    TQue<TPosition::VECIN, 2> planeInQ;
+    TQue<TPosition::VECOUT, 2> planeOutQ;
+    GlobalTensor<uint8_t> g_syms;
+    GlobalTensor<uint8_t> g_planes;
+
+    TPipe& pipe;
+
+    int64_t n_syms;
+    int32_t n_bits;
+
+    // Intermediate buffers
+    TBuf<TPosition::VECCALC> calcBuf; // Symbols of a tile in half and a scratch of the same size
+    LocalTensor<half> vals;
+    LocalTensor<half> vals_tmp;
+
+    // Class has no known need to support move or copy operations
+    PacBitPacker(const PacBitPacker&) = delete;
+    PacBitPacker& operator=(const PacBitPacker&) = delete;
+    PacBitPacker(PacBitPacker&&) = delete;
+    PacBitPacker& operator=(PacBitPacker&&) = delete;
+};
+
+__aicore__ inline PacBitPacker::PacBitPacker(
+    GM_ADDR syms,
+    GM_ADDR planes,
+    TPipe& _pipe,
+    int64_t n_syms,
+    int32_t n_bits,
+    bool unpacking):
+        pipe(_pipe),
+        n_syms(n_syms),
+        n_bits(n_bits) {
+    int64_t n_tiles = (n_syms + N_PACK_TILE - 1) / N_PACK_TILE;
+    g_syms.SetGlobalBuffer(reinterpret_cast<__gm__ uint8_t*>(syms), n_syms);
+    g_planes.SetGlobalBuffer(reinterpret_cast<__gm__ uint8_t*>(planes), n_tiles * n_bits * N_PACK_PLANE_BYTES);
+
+    if (unpacking) {
+        pipe.InitBuffer(planeInQ, 2, N_PACK_BITS_MAX * N_PACK_PLANE_BYTES);
+        pipe.InitBuffer(symOutQ, 2, N_PACK_TILE);
+    } else {
+        pipe.InitBuffer(symInQ, 2, N_PACK_TILE);
+        pipe.InitBuffer(planeOutQ, 2, N_PACK_BITS_MAX * N_PACK_PLANE_BYTES);
+    }
+
+    pipe.InitBuffer(calcBuf, 2 * N_PACK_TILE * sizeof(half));
+    vals = calcBuf.GetWithOffset<half>(N_PACK_TILE, 0);
+    vals_tmp = calcBuf.GetWithOffset<half>(N_PACK_TILE, N_PACK_TILE * sizeof(half));
+}
+
+__aicore__ inline int32_t PacBitPacker::tile_syms(int64_t tile_id) {
+    int64_t n_left = n_syms - tile_id * N_PACK_TILE;
+    return n_left < N_PACK_TILE ? static_cast<int32_t>(n_left) : N_PACK_TILE;
+}
+
+// Peels the planes off from the most significant bit down, as PacEncoder::split_raw_bits() does. Symbols past
+// n_bits saturate to the largest packable one, the padding of the last tile packs as symbol 0
+__aicore__ inline void PacBitPacker::pack(int64_t tile_id) {
+    int32_t n_valid = tile_syms(tile_id);
+
+    auto l_syms = symInQ.AllocTensor<uint8_t>();
+    if (n_valid < N_PACK_TILE) {
+        Duplicate(l_syms.ReinterpretCast<int16_t>(), static_cast<int16_t>(0), N_PACK_TILE / 2);
+        PipeBarrier<PIPE_ALL>();
+    }
+    DataCopyExtParams copy_params = {1, static_cast<uint32_t>(n_valid), 0, 0, 0};
+    DataCopyPadExtParams<uint8_t> pad_params = {false, 0, 0, 0};
+    DataCopyPad(l_syms, g_syms[tile_id * N_PACK_TILE], copy_params, pad_params);
+    symInQ.EnQue(l_syms);
+    l_syms = symInQ.DeQue<uint8_t>();
+
+    Cast(vals, l_syms, RoundMode::CAST_NONE, N_PACK_TILE);
+    symInQ.FreeTensor(l_syms);
+    Mins(vals, vals, static_cast<half>((1 << n_bits) - 1), N_PACK_TILE);
+
+    auto l_planes = planeOutQ.AllocTensor<uint8_t>();
+    for (int32_t k_ii = n_bits - 1; k_ii >= 0; --k_ii) {
+        auto plane = l_planes[k_ii * N_PACK_PLANE_BYTES];
+        CompareScalar(plane, vals, static_cast<half>(1 << k_ii), CMPMODE::GE, N_PACK_TILE);
+        Adds(vals_tmp, vals, static_cast<half>(-(1 << k_ii)), N_PACK_TILE);
+        Select(vals, plane, vals_tmp, vals, SELMODE::VSEL_TENSOR_TENSOR_MODE, N_PACK_TILE);
+    }
+    planeOutQ.EnQue(l_planes);
+    l_planes = planeOutQ.DeQue<uint8_t>();
+    DataCopy(g_planes[tile_id * n_bits * N_PACK_PLANE_BYTES], l_planes, n_bits * N_PACK_PLANE_BYTES);
+    planeOutQ.FreeTensor(l_planes);
+}
+
+// symbol = sum of 2^k over the planes with its bit set, as the raw bit merge of the PAC decoder
+__aicore__ inline void PacBitPacker::unpack(int64_t tile_id) {
+    int32_t n_valid = tile_syms(tile_id);
+
+    auto l_planes = planeInQ.AllocTensor<uint8_t>();
+    DataCopy(l_planes, g_planes[tile_id * n_bits * N_PACK_PLANE_BYTES], n_bits * N_PACK_PLANE_BYTES);
+    planeInQ.EnQue(l_planes);
+    l_planes = planeInQ.DeQue<uint8_t>();
+
+    half zero = 0.;
+    Duplicate(vals, zero, N_PACK_TILE);
+    for (int32_t k_ii = 0; k_ii < n_bits; ++k_ii) {
+        Duplicate(vals_tmp, static_cast<half>(1 << k_ii), N_PACK_TILE);
+        Select(vals_tmp, l_planes[k_ii * N_PACK_PLANE_BYTES], vals_tmp, zero, SELMODE::VSEL_TENSOR_SCALAR_MODE, N_PACK_TILE);
+        Add(vals, vals, vals_tmp, N_PACK_TILE);
+    }
+    planeInQ.FreeTensor(l_planes);
+
+    auto l_syms = symOutQ.AllocTensor<uint8_t>();
+    Cast(l_syms, vals, RoundMode::CAST_RINT, N_PACK_TILE);
+    symOutQ.EnQue(l_syms);
+    l_syms = symOutQ.DeQue<uint8_t>();
+    DataCopyExtParams copy_params = {1, static_cast<uint32_t>(n_valid), 0, 0, 0};
+    DataCopyPad(g_syms[tile_id * N_PACK_TILE], l_syms, copy_params);
+    symOutQ.FreeTensor(l_syms);
+}
+} // namespace impl
+} // namespace pac_coder
+} // namespace kvcache_ops
+
+extern "C" __global__ __aicore__ void pac_pack_bits_kernel (
+    GM_ADDR input_data_ptr,
+    GM_ADDR output_data_ptr,
+    const int64_t n_syms,
+    const int n_bits
+) {
+    TPipe pipe{};
+    int32_t coreIdx = GetBlockIdx();
+    int32_t launchedCores = GetBlockNum();
+
+    KERNEL_TASK_TYPE_DEFAULT(KERNEL_TYPE_AIV_ONLY);
+
+    kvcache_ops::pac_coder::impl::PacBitPacker packer {input_data_ptr, output_data_ptr, pipe, n_syms, n_bits, false};
+
+    int64_t n_tiles = (n_syms + kvcache_ops::pac_coder::N_PACK_TILE - 1) / kvcache_ops::pac_coder::N_PACK_TILE;
+    for (int64_t tile_id = coreIdx; tile_id < n_tiles; tile_id += launchedCores) {
+        packer.pack(tile_id);
+    }
+}
+
+extern "C" __global__ __aicore__ void pac_unpack_bits_kernel (
+    GM_ADDR input_data_ptr,
+    GM_ADDR output_data_ptr,
+    const int64_t n_syms,
+    const int n_bits
+) {
+    TPipe pipe{};
+    int32_t coreIdx = GetBlockIdx();
+    int32_t launchedCores = GetBlockNum();
+
+    KERNEL_TASK_TYPE_DEFAULT(KERNEL_TYPE_AIV_ONLY);
+
+    kvcache_ops::pac_coder::impl::PacBitPacker packer {output_data_ptr, input_data_ptr, pipe, n_syms, n_bits, true};
+
+    int64_t n_tiles = (n_syms + kvcache_ops::pac_coder::N_PACK_TILE - 1) / kvcache_ops::pac_coder::N_PACK_TILE;
+    for (int64_t tile_id = coreIdx; tile_id < n_tiles; tile_id += launchedCores) {
+        packer.unpack(tile_id);
+    }
+}
+
+namespace kvcache_ops {
+namespace pac_coder {
+
+// Host side check of the parameters shared by pack_bits() and unpack_bits()
+static void check_pack_params(int n_bits, int n_tokens, int n_layers, int n_channels) {
+    if (n_bits < 1 || n_bits > N_PACK_BITS_MAX) {
+        ASCENDC_REPORT_NOT_SUPPORT(false, "Unsupported number of packed bits.");
+        throw std::runtime_error("n_bits: " + std::to_string(n_bits) + " not supported.");
+    }
+
+    if (n_tokens < 1 || n_layers < 1 || n_channels < 1) {
+        int64_t n_syms = static_cast<int64_t>(n_layers) * n_tokens * n_channels;
+        ASCENDC_REPORT_NOT_SUPPORT(false, "Unsupported number of packed symbols.");
+        throw std::runtime_error("n_syms: " + std::to_string(n_syms) + " not supported.");
+    }
+}
+
+// Packs [n_layers, n_tokens, n_channels] uint8 symbols below 2^n_bits, n_bits of 1 up to N_PACK_BITS_MAX, into
+// output_data_ptr of ceil(n_layers * n_tokens * n_channels / N_PACK_TILE) * n_bits * N_PACK_PLANE_BYTES bytes.
+// Symbols of 2^n_bits and above are not rejected, they saturate and unpack as 2^n_bits - 1.
+// Symbol i of the flat array is bit (i % N_PACK_TILE) of plane k at (i / N_PACK_TILE) * n_bits + k for its bit k,
+// so any token is read without touching the rest of the chunk. No metadata, tiles pack independently.
+void pack_bits(
+    uint8_t* input_data_ptr,
+    uint8_t* output_data_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bits,
+    const int n_tokens,
+    const int n_layers,
+    const int n_channels) {
+
+    check_pack_params(n_bits, n_tokens, n_layers, n_channels);
+
+    int64_t n_syms = static_cast<int64_t>(n_layers) * n_tokens * n_channels;
+
+    int64_t n_tiles = (n_syms + N_PACK_TILE - 1) / N_PACK_TILE;
+    int blockDim = n_tiles < n_aiv ? static_cast<int>(n_tiles) : n_aiv;
+
+    pac_pack_bits_kernel<<<blockDim, nullptr, stream>>>(
+        input_data_ptr,
+        output_data_ptr,
+        n_syms,
+        n_bits);
+}
+
+// Reverses pack_bits() with the same n_bits and dimensions into [n_layers, n_tokens, n_channels] uint8
+void unpack_bits(
+    uint8_t* input_data_ptr,
+    uint8_t* output_data_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bits,
+    const int n_tokens,
+    const int n_layers,
+    const int n_channels) {
+
+    check_pack_params(n_bits, n_tokens, n_layers, n_channels);
+
+    int64_t n_syms = static_cast<int64_t>(n_layers) * n_tokens * n_channels;
+
+    int64_t n_tiles = (n_syms + N_PACK_TILE - 1) / N_PACK_TILE;
+    int blockDim = n_tiles < n_aiv ? static_cast<int>(n_tiles) : n_aiv;
+
+    pac_unpack_bits_kernel<<<blockDim, nullptr, stream>>>(
+        input_data_ptr,
+        output_data_ptr,
+        n_syms,
+        n_bits);
+}
+
+} // namespace pac_coder
+} // namespace kvcache_ops
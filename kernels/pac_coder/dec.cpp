@@ -1,29 +1,32 @@
 #include "kernel_operator.h"
+#include "../types.h"
+#include "../multi_layer/multi_layer_mem_kernels.h"
+#include "pac_common.h"
+#include <stdexcept>
+#include <string>
 using namespace AscendC;
 
 namespace kvcache_ops {
 namespace pac_coder {
 
-constexpr int32_t N_C_PER_BLOCK = 32;
-// Some copy masks implicitly assume 32 channels - update as appropriate before changing this assert
-static_assert(N_C_PER_BLOCK == 32);
+constexpr int32_t N_RAW_PLANE_BYTES = N_C_PER_BLOCK * N_T_MAX / 8;
+constexpr int32_t N_RAW_MERGE_COUNT = 2048; // Symbols merged with their low bits at a time
 
-constexpr uint32_t N_T_MAX = 256;
-constexpr uint32_t N_B_MAX = 32;
-constexpr int32_t DATABLOCK_BYTES = 32;
-constexpr int32_t N_DBs_PER_BLOCK = N_C_PER_BLOCK / DATABLOCK_BYTES;
+// Symbols are looked up from the next byte of their lane, entries are symbol << DEC_LUT_LEN_BITS | length
+constexpr int32_t DEC_LUT_SIZE = 256;
+constexpr int32_t DEC_LUT_LEN_BITS = 4;
 
-namespace impl {
-__aicore__ inline auto ceil_32(int32_t size) -> uint32_t {
-    return size % 32 == 0 ? size : 32 * (1 + (size / 32));
-};
+// Batched launches take PAC_DEC_DESC_WORDS device addresses per chunk, in the order pac_decode_range() takes them:
+// meta, cumulative lengths, sub-stream offsets, raw bit planes, byte stream and output
+constexpr int32_t PAC_DEC_DESC_WORDS = 6;
+static_assert(N_B_MAX << DEC_LUT_LEN_BITS <= 2048); // Entries are exact in half
 
-__aicore__ inline auto read_unaligned_u8_2_half(
+namespace impl {
+__aicore__ inline auto read_unaligned_u8(
     LocalTensor<uint8_t>& src,
     LocalTensor<uint32_t>& src_gather_idxs, // in form idx 0, idx 0, idx 1, idx 1 in bits
-    LocalTensor<half>& dst,
+    LocalTensor<uint32_t>& dst,
     LocalTensor<uint32_t>& tmp_slot_1,
-    LocalTensor<uint32_t>& tmp_slot_2,
     LocalTensor<int32_t>& pows_2,
     uint32_t count) -> void {
         auto src_i16 = src.ReinterpretCast<int16_t>();
@@ -35,10 +38,10 @@ __aicore__ inline auto read_unaligned_u8_2_half(
         // Gather the relevant i16 and the following i16 which provides back fill when shifting to the bits of interest
         uint64_t mask[2] = {0};
         mask[0] = 0xAAAAAAAAAAAAAAAA;
-        Gather(tmp_slot_2.ReinterpretCast<int16_t>(), src_i16, tmp_slot_1, 0, mask, 1, 0);
+        Gather(dst.ReinterpretCast<int16_t>(), src_i16, tmp_slot_1, 0, mask, 1, 0);
 
         mask[0] = 0x5555555555555555;
-        Gather(tmp_slot_2.ReinterpretCast<int16_t>(), src_i16, tmp_slot_1, 2, mask, 1, 0);
+        Gather(dst.ReinterpretCast<int16_t>(), src_i16, tmp_slot_1, 2, mask, 1, 0);
 
         // Identify the bit offset within the temporary buffer
         ShiftLeft(tmp_slot_1, src_gather_idxs.ReinterpretCast<uint32_t>(), static_cast<uint32_t>(28), 2*count);
@@ -57,39 +60,59 @@ __aicore__ inline auto read_unaligned_u8_2_half(
         };
         GatherMask(tmp_slot_1, tmp_slot_1, 2, false, 0, gmp, _rsvd);
 
-        Mul(tmp_slot_2.ReinterpretCast<int32_t>(), tmp_slot_2.ReinterpretCast<int32_t>(), tmp_slot_1.ReinterpretCast<int32_t>(), count);
+        Mul(dst.ReinterpretCast<int32_t>(), dst.ReinterpretCast<int32_t>(), tmp_slot_1.ReinterpretCast<int32_t>(), count);
 
         // Reduce to range 0 - 255 (8 bit)
-        ShiftRight(tmp_slot_2, tmp_slot_2, static_cast<uint32_t>(24), count);
-        Cast(dst, tmp_slot_2.ReinterpretCast<int32_t>(), RoundMode::CAST_NONE, count);
+        ShiftRight(dst, dst, static_cast<uint32_t>(24), count);
 }
 
 class PacDecoder {
 public:
     __aicore__ inline PacDecoder(
         GM_ADDR meta_data_ptr, // In bytesteam [steam_length], uint8
-        GM_ADDR cum_lens_ptr, // In cum lengths [n_layers, n_channels], uint64
+        GM_ADDR cum_lens_ptr, // In cum lengths [n_layers, n_batches, n_channels], uint64
+        GM_ADDR sub_offsets_ptr, // In sub-stream offsets [n_layers, n_batches, n_sub_streams, n_channels], uint32
+        GM_ADDR raw_bits_ptr, // In raw bit planes [n_layers, n_batches, ceil(n_channels / 32), n_raw_bits, N_RAW_PLANE_BYTES], uint8
         GM_ADDR bytestream_ptr,  // In CDF [n_layers, n_channels, n_bins], uint16
-        GM_ADDR output_data_ptr, // Output symbols [n_layers, batch_size, n_channels], uint8
         AscendC::TPipe& pipe,
         int32_t n_tokens,
         int32_t n_layers,
         int32_t n_channels,
-        uint32_t n_bins);
-
-    __aicore__ inline void decode(int layer_id, int channel_id);
+        uint32_t n_bins,
+        int32_t n_sub_streams,
+        int32_t pred_group, // As encoded, PRED_NONE, PRED_PREV or the tokens of a group coded against its first
+        int32_t t_range_start, // Tokens [t_range_start, t_range_end) of the chunk are decoded
+        int32_t t_range_end);
+
+    // Decoded symbols of every batch are handed to writer, see PacSymbolWriter and PacPagedKVWriter. Only the
+    // batches overlapping the token range are read, each up to the last token of the range
+    template <typename Writer>
+    __aicore__ inline void decode(int layer_id, int channel_id, Writer& writer);
+
+    // Moves on to another chunk of the same n_layers, n_channels, n_bins and coding, see pac_decode_batched()
+    __aicore__ inline void set_chunk(
+        GM_ADDR meta_data_ptr,
+        GM_ADDR cum_lens_ptr,
+        GM_ADDR sub_offsets_ptr,
+        GM_ADDR raw_bits_ptr,
+        GM_ADDR bytestream_ptr,
+        int32_t n_tokens,
+        int32_t t_range_start,
+        int32_t t_range_end);
 
 private:
     AscendC::TQue<AscendC::TPosition::VECIN, 2> byteStreamInQ;
     AscendC::TQue<AscendC::TPosition::VECIN, 2> lensInQ;
     AscendC::TQue<AscendC::TPosition::VECIN, 2> MetaInQ;
+    AscendC::TQue<AscendC::TPosition::VECIN, 2> rawBitsInQ;
 
     AscendC::GlobalTensor<uint16_t> gm_meta_data;
     AscendC::GlobalTensor<uint32_t> gm_cum_lens;
+    AscendC::GlobalTensor<uint32_t> gm_sub_offsets;
+    AscendC::GlobalTensor<uint8_t> gm_raw_bits;
     AscendC::GlobalTensor<uint8_t> gm_bytestream;
 
     AscendC::TQue<AscendC::TPosition::VECOUT, 2> symOutQ;
-    AscendC::GlobalTensor<uint8_t> gm_output_data;
 
     AscendC::TPipe& pipe;
 
@@ -99,11 +122,28 @@ private:
     int32_t n_channels;
     uint32_t n_bins;
 
+    // Chunks longer than N_T_MAX tokens are decoded N_T_MAX tokens at a time
+    int32_t n_batches;
+    // Batches are coded as rows of their own, so the cumulative lengths seek straight to the first batch of the range
+    int32_t t_range_start;
+    int32_t t_range_end;
+    int32_t n_c_blocks; // The last block is a masked tail when n_channels % N_C_PER_BLOCK != 0
+
+    // Low bits of every symbol that were not entropy coded, see pac_encode
+    int32_t n_raw_bits;
+
+    // Every sub-stream of every channel is a lane, a decode step emits n_sub_streams tokens of the block
+    int32_t n_sub_streams;
+    int32_t n_lanes;
+
+    int32_t pred_group;
+
     // For transient (per encode) intermediates
      TBuf<TPosition::VECCALC> calcBuf;
     uint32_t calc_buf_offset_init = 0;
-    LocalTensor<int32_t> duplicating_gather_idxs;
     LocalTensor<int32_t> pows_2;
+    LocalTensor<int32_t> pred_anchor_i16_idxs; // 128 [0, 1, ... 31 | 0, 1, ... ] x sizeof(i16), a token row over a repeat
+    LocalTensor<half> byte_vals; // [DEC_LUT_SIZE, N_C_PER_BLOCK], each row holds its byte value
 
     // Class has no known need to support move or copy operations
     PacDecoder(const PacDecoder&) = delete;
@@ -114,98 +154,122 @@ private:
 
 __aicore__ inline PacDecoder::PacDecoder(
     GM_ADDR meta_data_ptr, // In bytesteam [steam_length], uint8
-    GM_ADDR cum_lens_ptr, // In cum lengths [n_layers, n_channels], uint64
+    GM_ADDR cum_lens_ptr, // In cum lengths [n_layers, n_batches, n_channels], uint64
+    GM_ADDR sub_offsets_ptr, // In sub-stream offsets [n_layers, n_batches, n_sub_streams, n_channels], uint32
+    GM_ADDR raw_bits_ptr, // In raw bit planes [n_layers, n_batches, ceil(n_channels / 32), n_raw_bits, N_RAW_PLANE_BYTES], uint8
     GM_ADDR bytestream_ptr,  // In CDF [n_layers, n_channels, n_bins], uint16
-    GM_ADDR output_data_ptr, // Output symbols [n_layers, batch_size, n_channels], uint8
     AscendC::TPipe& _pipe,
     int32_t n_tokens,
     int32_t n_layers,
     int32_t n_channels,
-    uint32_t n_bins):
+    uint32_t n_bins,
+    int32_t n_sub_streams,
+    int32_t pred_group,
+    int32_t t_range_start,
+    int32_t t_range_end):
         pipe(_pipe),
-        n_tokens(n_tokens),
         n_layers(n_layers),
         n_channels(n_channels),
-        n_bins(n_bins) {
+        n_bins(n_bins),
+        n_c_blocks((n_channels + N_C_PER_BLOCK - 1) / N_C_PER_BLOCK),
+        n_sub_streams(n_sub_streams),
+        n_lanes(n_sub_streams * N_C_PER_BLOCK),
+        pred_group(pred_group) {
     half deq_scale = 1.0;
     SetDeqScale(deq_scale);
 
+    n_raw_bits = 0;
+    while ((N_B_MAX << n_raw_bits) < n_bins) {
+        ++n_raw_bits;
+    }
+
     auto MetaInQSize = N_C_PER_BLOCK * N_B_MAX * sizeof(uint16_t);
     pipe.InitBuffer(MetaInQ, 1, MetaInQSize);
-    auto gm_meta_data_dim = n_layers * n_channels * N_B_MAX;
-    gm_meta_data.SetGlobalBuffer(reinterpret_cast<__gm__ uint16_t*>(meta_data_ptr), gm_meta_data_dim);
 
-    auto lensInQSize = 2 * N_C_PER_BLOCK * sizeof(uint32_t);
+    auto lensInQSize = 2 * N_C_PER_BLOCK * sizeof(uint64_t);
     pipe.InitBuffer(lensInQ, 1, lensInQSize);
-    auto gm_cum_lens_dim = n_layers * n_channels;
-    gm_cum_lens.SetGlobalBuffer(reinterpret_cast<__gm__ uint32_t*>(cum_lens_ptr), gm_cum_lens_dim);
+
+    pipe.InitBuffer(rawBitsInQ, 1, N_RAW_BITS_MAX * N_RAW_PLANE_BYTES);
 
     auto byteStreamInQSize = N_C_PER_BLOCK * N_T_MAX * sizeof(uint8_t);
     pipe.InitBuffer(byteStreamInQ, 1, byteStreamInQSize);
-    auto gm_bytestream_dim =  ceil_32(gm_cum_lens((n_layers * n_channels) - 1));
-    gm_bytestream.SetGlobalBuffer(reinterpret_cast<__gm__ uint8_t*>(bytestream_ptr), gm_bytestream_dim);
+
+    set_chunk(meta_data_ptr, cum_lens_ptr, sub_offsets_ptr, raw_bits_ptr, bytestream_ptr, n_tokens, t_range_start, t_range_end);
 
     auto symOutQSize = N_C_PER_BLOCK * N_T_MAX * sizeof(uint8_t);
     pipe.InitBuffer(symOutQ, 1, symOutQSize);
-    auto gm_output_data_dim = n_layers * n_channels * N_T_MAX;
-    gm_output_data.SetGlobalBuffer(reinterpret_cast<__gm__ uint8_t*>(output_data_ptr), gm_output_data_dim);
 
-    uint32_t calc_buf_sz_aligned = 0x18000;
+    uint32_t calc_buf_sz_aligned = 0x1C000;
     pipe.InitBuffer(calcBuf, calc_buf_sz_aligned);
 
     calc_buf_offset_init = 0;
-    uint32_t duplicating_gather_idxs_sz = ceil_32(N_C_PER_BLOCK * N_B_MAX * sizeof(int32_t));
-    duplicating_gather_idxs = calcBuf.GetWithOffset<int32_t>(N_C_PER_BLOCK * N_B_MAX, calc_buf_offset_init);
-    calc_buf_offset_init += duplicating_gather_idxs_sz;
-    for (auto c_ii = 0; c_ii < N_C_PER_BLOCK; ++c_ii) {
-        Duplicate(duplicating_gather_idxs[c_ii * N_B_MAX], static_cast<int32_t>(c_ii * sizeof(half)), N_B_MAX);
-    }
-
     uint32_t pows_2_sz = ceil_32(32 * sizeof(int32_t));
     pows_2 = calcBuf.GetWithOffset<int32_t>(32, calc_buf_offset_init);
     calc_buf_offset_init += pows_2_sz;
     for (auto ii = 0; ii < 32; ++ii) {
         pows_2.SetValue(ii, (1 << ii));
     }
-}
 
-__aicore__ inline void PacDecoder::decode(int layer_id, int channel_start_id) {
-    // --------
-    // Phase: Copy IN
-    // --------
-    uint32_t offset_idx = layer_id * n_channels + channel_start_id;
-    auto lens = lensInQ.AllocTensor<uint32_t>();
-    if (offset_idx == 0) {
-        Duplicate(lens.ReinterpretCast<int32_t>(), 0, N_C_PER_BLOCK);
-    } else {
-        DataCopy(lens, gm_cum_lens[offset_idx - N_C_PER_BLOCK], N_C_PER_BLOCK);
+    uint32_t pred_anchor_i16_idxs_sz = ceil_32(128 * sizeof(int32_t));
+    pred_anchor_i16_idxs = calcBuf.GetWithOffset<int32_t>(128, calc_buf_offset_init);
+    calc_buf_offset_init += pred_anchor_i16_idxs_sz;
+    CreateVecIndex(pred_anchor_i16_idxs, 0, 128);
+    ShiftLeft(pred_anchor_i16_idxs.ReinterpretCast<uint32_t>(), pred_anchor_i16_idxs.ReinterpretCast<uint32_t>(), static_cast<uint32_t>(27), 128);
+    ShiftRight(pred_anchor_i16_idxs.ReinterpretCast<uint32_t>(), pred_anchor_i16_idxs.ReinterpretCast<uint32_t>(), static_cast<uint32_t>(27), 128);
+    Muls(pred_anchor_i16_idxs, pred_anchor_i16_idxs, static_cast<int32_t>(sizeof(half)), 128);
+
+    uint32_t byte_vals_sz = ceil_32(DEC_LUT_SIZE * N_C_PER_BLOCK * sizeof(half));
+    byte_vals = calcBuf.GetWithOffset<half>(DEC_LUT_SIZE * N_C_PER_BLOCK, calc_buf_offset_init);
+    calc_buf_offset_init += byte_vals_sz;
+    Duplicate(byte_vals, static_cast<half>(0), N_C_PER_BLOCK);
+    for (auto n_rows = 1; n_rows < DEC_LUT_SIZE; n_rows *= 2) {
+        Adds(byte_vals[n_rows * N_C_PER_BLOCK], byte_vals, static_cast<half>(n_rows), n_rows * N_C_PER_BLOCK);
     }
-    DataCopy(lens[N_C_PER_BLOCK], gm_cum_lens[offset_idx], N_C_PER_BLOCK);
+}
 
-    lensInQ.EnQue(lens);
-    lens = lensInQ.DeQue<uint32_t>();
-    uint32_t calc_buf_offset = calc_buf_offset_init;
+__aicore__ inline void PacDecoder::set_chunk(
+    GM_ADDR meta_data_ptr,
+    GM_ADDR cum_lens_ptr,
+    GM_ADDR sub_offsets_ptr,
+    GM_ADDR raw_bits_ptr,
+    GM_ADDR bytestream_ptr,
+    int32_t n_tokens,
+    int32_t t_range_start,
+    int32_t t_range_end) {
+    this->n_tokens = n_tokens;
+    this->t_range_start = t_range_start;
+    this->t_range_end = t_range_end;
+    n_batches = (n_tokens + N_T_MAX - 1) / N_T_MAX;
 
-    auto bytestream = byteStreamInQ.AllocTensor<uint8_t>();
-    PipeBarrier<PIPE_ALL>();
-    DataSyncBarrier<MemDsbT::ALL>();
-    uint32_t offset_start = offset_idx == 0 ? 0 : lens.GetValue(N_C_PER_BLOCK - 1);
-    int32_t max_len = 0;
-    for (auto c_ii = 0; c_ii < N_C_PER_BLOCK; ++c_ii) {
-        uint32_t offset_end = lens.GetValue(N_C_PER_BLOCK + c_ii);
-        max_len = max_len < offset_end - offset_start ? offset_end - offset_start : max_len;
-        uint32_t copy_len = ceil_32(offset_end - offset_start);
-        DataCopy(bytestream[c_ii * N_T_MAX], gm_bytestream[offset_start], copy_len);
-        offset_start = offset_end;
-        PipeBarrier<PIPE_ALL>();
-        DataSyncBarrier<MemDsbT::ALL>();
-    }
-    byteStreamInQ.EnQue(bytestream);
-    bytestream = byteStreamInQ.DeQue<uint8_t>();
-    lensInQ.FreeTensor(lens);
+    auto gm_meta_data_dim = n_layers * n_channels * N_B_MAX;
+    gm_meta_data.SetGlobalBuffer(reinterpret_cast<__gm__ uint16_t*>(meta_data_ptr), gm_meta_data_dim);
+
+    // Low and high word of every cumulative length
+    auto gm_cum_lens_dim = 2 * n_layers * n_batches * n_channels;
+    gm_cum_lens.SetGlobalBuffer(reinterpret_cast<__gm__ uint32_t*>(cum_lens_ptr), gm_cum_lens_dim);
+    gm_sub_offsets.SetGlobalBuffer(reinterpret_cast<__gm__ uint32_t*>(sub_offsets_ptr), n_layers * n_batches * n_sub_streams * n_channels);
+
+    gm_raw_bits.SetGlobalBuffer(reinterpret_cast<__gm__ uint8_t*>(raw_bits_ptr),
+        n_layers * n_batches * n_c_blocks * n_raw_bits * N_RAW_PLANE_BYTES);
+
+    uint64_t gm_bytestream_len = (static_cast<uint64_t>(gm_cum_lens(gm_cum_lens_dim - 1)) << 32) | gm_cum_lens(gm_cum_lens_dim - 2);
+    auto gm_bytestream_dim = (gm_bytestream_len + DATABLOCK_BYTES - 1) / DATABLOCK_BYTES * DATABLOCK_BYTES;
+    gm_bytestream.SetGlobalBuffer(reinterpret_cast<__gm__ uint8_t*>(bytestream_ptr), gm_bytestream_dim);
+}
+
+template <typename Writer>
+__aicore__ inline void PacDecoder::decode(int layer_id, int channel_start_id, Writer& writer) {
+    uint32_t calc_buf_offset = calc_buf_offset_init;
 
+    // --------
+    // Phase: Derive Decode Table (shared by all batches of the layer)
+    // --------
+    int32_t n_valid = block_channels(n_channels, channel_start_id);
     auto meta_info = MetaInQ.AllocTensor<uint16_t>();
-    DataCopy(meta_info, gm_meta_data[offset_idx * N_B_MAX], N_C_PER_BLOCK * N_B_MAX);
+    if (n_valid < N_C_PER_BLOCK) {
+        fill_tail_meta(meta_info, n_valid);
+    }
+    DataCopy(meta_info, gm_meta_data[(layer_id * n_channels + channel_start_id) * N_B_MAX], n_valid * N_B_MAX);
     MetaInQ.EnQue(meta_info);
     meta_info = MetaInQ.DeQue<uint16_t>();
 
@@ -221,10 +285,6 @@ __aicore__ inline void PacDecoder::decode(int layer_id, int channel_start_id) {
     LocalTensor<int32_t> enc_lens_32 = calcBuf.GetWithOffset<int32_t>(bins_per_block, calc_buf_offset);
     calc_buf_offset += enc_lens_32_sz;
 
-    // --------
-    // Phase: Derive Decode Table
-    // --------
-
     //  Meta info in the form [enc pattern (sym 0), enc len (sym 0) | enc pattern (sym 1), enc len (sym 1) | ... ]
     uint16_t shift_byte = 8;
     ShiftRight(encs.ReinterpretCast<uint16_t>(), meta_info, shift_byte, bins_per_block);
@@ -253,15 +313,16 @@ __aicore__ inline void PacDecoder::decode(int layer_id, int channel_start_id) {
     LocalTensor<half> sorted = calcBuf.GetWithOffset<half>(sorted_count_sz / sizeof(half), calc_buf_offset);
     calc_buf_offset += sorted_count_sz;
 
-    // Sort the encode bins - Quick symbol lookup requires the lookup table is ordered
-    uint32_t idxs_sz = ceil_32(N_B_MAX * sizeof(int32_t));
-    LocalTensor<int32_t> idxs = calcBuf.GetWithOffset<int32_t>(N_B_MAX, calc_buf_offset);
-    CreateVecIndex(idxs, 0, N_B_MAX);
-    calc_buf_offset += idxs_sz;
+    // Sort the encode bins - the lookup table is filled in bin order. The sort carries each symbol's table entry
+    uint32_t entries_sz = ceil_32(bins_per_block * sizeof(int32_t));
+    LocalTensor<int32_t> entries = calcBuf.GetWithOffset<int32_t>(bins_per_block, calc_buf_offset);
+    calc_buf_offset += entries_sz;
+    CreateVecIndex(entries, 0, bins_per_block);
+    ShiftLeft(entries.ReinterpretCast<uint32_t>(), entries.ReinterpretCast<uint32_t>(), static_cast<uint32_t>(27), bins_per_block);
+    ShiftRight(entries.ReinterpretCast<uint32_t>(), entries.ReinterpretCast<uint32_t>(), static_cast<uint32_t>(27 - DEC_LUT_LEN_BITS), bins_per_block);
+    Add(entries, entries, enc_lens_32, bins_per_block);
 
-    for (uint32_t c_ii = 0; c_ii < N_C_PER_BLOCK; ++c_ii) {
-        Sort32(sorted[c_ii * N_B_MAX * (8 / sizeof(half))], encs_h[c_ii * N_B_MAX], idxs.ReinterpretCast<uint32_t>(), N_B_MAX / 32);
-    }
+    Sort32(sorted, encs_h, entries.ReinterpretCast<uint32_t>(), N_C_PER_BLOCK);
 
     uint64_t _rsvd = 0;
     auto elems_per_256 = 256 / 8;
@@ -273,134 +334,497 @@ __aicore__ inline void PacDecoder::decode(int layer_id, int channel_start_id) {
         0 // src1RepeatStride - not used
     };
 
-    uint32_t enc_syms_sz = ceil_32(bins_per_block * sizeof(int32_t));
-    LocalTensor<int32_t> enc_syms = calcBuf.GetWithOffset<int32_t>(bins_per_block, calc_buf_offset);
-    calc_buf_offset += enc_syms_sz;
-
     uint32_t enc_bins_sz = ceil_32(bins_per_block * sizeof(half));
     LocalTensor<half> enc_bins = calcBuf.GetWithOffset<half>(bins_per_block, calc_buf_offset);
     calc_buf_offset += enc_bins_sz;
 
-    GatherMask(enc_syms, sorted.ReinterpretCast<int32_t>(), 2, false, 0, gmp, _rsvd);
+    GatherMask(entries, sorted.ReinterpretCast<int32_t>(), 2, false, 0, gmp, _rsvd);
     GatherMask(enc_bins, sorted.ReinterpretCast<half>(), 3, false, 0, gmp, _rsvd);
 
-    // Shift encode values back one to get bin boundaries
-    for (auto c_ii = 0; c_ii < N_C_PER_BLOCK; ++c_ii) {
-        int16_t next = 0;
-        auto last = enc_bins.GetValue(c_ii * N_B_MAX + 0);;
-        for (auto b_ii = 0; b_ii < N_B_MAX; ++b_ii) {
-            next = last;
-            last = enc_bins.GetValue(c_ii * N_B_MAX + b_ii);
-            enc_bins.SetValue(c_ii * N_B_MAX + b_ii, next);
-        }
+    auto entries_h = encs_h; // Buffer re-use
+    Cast(entries_h, entries, RoundMode::CAST_NONE, bins_per_block);
+
+    // --------
+    // Phase: Build the lookup table, [DEC_LUT_SIZE, N_C_PER_BLOCK] entries by byte value
+    // --------
+    uint32_t dec_lut_sz = ceil_32(DEC_LUT_SIZE * N_C_PER_BLOCK * sizeof(half));
+    LocalTensor<half> dec_lut = calcBuf.GetWithOffset<half>(DEC_LUT_SIZE * N_C_PER_BLOCK, calc_buf_offset);
+    calc_buf_offset += dec_lut_sz;
+
+    uint32_t lut_mask_sz = ceil_32(DEC_LUT_SIZE * N_C_PER_BLOCK / 8);
+    LocalTensor<uint8_t> lut_mask = calcBuf.GetWithOffset<uint8_t>(lut_mask_sz, calc_buf_offset);
+    calc_buf_offset += lut_mask_sz;
+
+    // One bin of every channel, repeated to a full 128 elem repeat so it broadcasts down the table
+    uint32_t lut_row_count = 128;
+    uint32_t lut_row_sz = ceil_32(lut_row_count * sizeof(half));
+    LocalTensor<half> bin_row = calcBuf.GetWithOffset<half>(lut_row_count, calc_buf_offset);
+    calc_buf_offset += lut_row_sz;
+    LocalTensor<half> entry_row = calcBuf.GetWithOffset<half>(lut_row_count, calc_buf_offset);
+    calc_buf_offset += lut_row_sz;
+
+    uint32_t lut_row_idxs_sz = ceil_32(lut_row_count * sizeof(int32_t));
+    LocalTensor<int32_t> lut_row_idxs = calcBuf.GetWithOffset<int32_t>(lut_row_count, calc_buf_offset);
+    calc_buf_offset += lut_row_idxs_sz;
+    CreateVecIndex(lut_row_idxs, 0, lut_row_count);
+    ShiftLeft(lut_row_idxs.ReinterpretCast<uint32_t>(), lut_row_idxs.ReinterpretCast<uint32_t>(), static_cast<uint32_t>(27), lut_row_count);
+    ShiftRight(lut_row_idxs.ReinterpretCast<uint32_t>(), lut_row_idxs.ReinterpretCast<uint32_t>(), static_cast<uint32_t>(27), lut_row_count);
+    Muls(lut_row_idxs, lut_row_idxs, static_cast<int32_t>(N_B_MAX * sizeof(half)), lut_row_count);
+    Adds(lut_row_idxs, lut_row_idxs, static_cast<int32_t>((N_B_MAX - 1) * sizeof(half)), lut_row_count);
+
+    // A byte decodes to the symbol with the highest bin boundary at or below it, the first such in the descending
+    // sort. Walk the bins up from the lowest, each one taking over the bytes at or above its boundary. Un-encodable
+    // symbols sit at 512, above every byte
+    uint8_t lut_repeats = DEC_LUT_SIZE * N_C_PER_BLOCK / lut_row_count;
+    Gather(entry_row, entries_h, lut_row_idxs.ReinterpretCast<uint32_t>(), 0, lut_row_count);
+    Copy(dec_lut, entry_row, lut_row_count, lut_repeats, {1, 1, 8, 0});
+    for (int32_t b_ii = N_B_MAX - 2; b_ii >= 0; --b_ii) {
+        Adds(lut_row_idxs, lut_row_idxs, -static_cast<int32_t>(sizeof(half)), lut_row_count);
+        Gather(bin_row, enc_bins, lut_row_idxs.ReinterpretCast<uint32_t>(), 0, lut_row_count);
+        Gather(entry_row, entries_h, lut_row_idxs.ReinterpretCast<uint32_t>(), 0, lut_row_count);
+        Compare(lut_mask, byte_vals, bin_row, CMPMODE::GE, lut_row_count, lut_repeats, {1, 1, 1, 8, 8, 0});
+        Select(dec_lut, lut_mask, entry_row, dec_lut, SELMODE::VSEL_TENSOR_TENSOR_MODE, lut_row_count, lut_repeats, {1, 1, 1, 8, 0, 8});
     }
 
     // --------
     // Phase: Prepare temporaries for decode
     // --------
-    uint32_t curr_dec_val_sz = ceil_32(N_C_PER_BLOCK * sizeof(half));
-    LocalTensor<half> curr_dec_val = calcBuf.GetWithOffset<half>(N_C_PER_BLOCK, calc_buf_offset);
-    calc_buf_offset += curr_dec_val_sz;
+    uint32_t i32_lanes_sz = ceil_32(n_lanes * sizeof(int32_t));
+    LocalTensor<int32_t> bits_used = calcBuf.GetWithOffset<int32_t>(n_lanes, calc_buf_offset);
+    calc_buf_offset += i32_lanes_sz;
+
+    LocalTensor<int32_t> bits_used_bcast = calcBuf.GetWithOffset<int32_t>(2 * n_lanes, calc_buf_offset);
+    calc_buf_offset += 2 * i32_lanes_sz;
+
+    // Offset of each lane's channel into a row of the lookup table
+    LocalTensor<int32_t> lut_lane_offsets = calcBuf.GetWithOffset<int32_t>(n_lanes, calc_buf_offset);
+    calc_buf_offset += i32_lanes_sz;
+    for (auto s_ii = 0; s_ii < n_sub_streams; ++s_ii) {
+        CreateVecIndex(lut_lane_offsets[s_ii * N_C_PER_BLOCK], 0, N_C_PER_BLOCK);
+    }
+    Muls(lut_lane_offsets, lut_lane_offsets, static_cast<int32_t>(sizeof(half)), n_lanes);
+
+    uint32_t h_lanes_sz = ceil_32(n_lanes * sizeof(half));
+    LocalTensor<half> dec_entries = calcBuf.GetWithOffset<half>(n_lanes, calc_buf_offset);
+    calc_buf_offset += h_lanes_sz;
+
+    LocalTensor<uint32_t> tmp_1 = calcBuf.GetWithOffset<uint32_t>(2 * n_lanes, calc_buf_offset);
+    calc_buf_offset += 2 * i32_lanes_sz;
+
+    LocalTensor<uint32_t> tmp_2 = calcBuf.GetWithOffset<uint32_t>(n_lanes, calc_buf_offset);
+    calc_buf_offset += i32_lanes_sz;
+
+    LocalTensor<uint32_t> duplicate_2_gather = calcBuf.GetWithOffset<uint32_t>(2 * n_lanes, calc_buf_offset);
+    calc_buf_offset += 2 * i32_lanes_sz;
+    CreateVecIndex(duplicate_2_gather.ReinterpretCast<int32_t>(), 0, n_lanes * 2);
+    ShiftRight(duplicate_2_gather, duplicate_2_gather, static_cast<uint32_t>(1), n_lanes * 2); // in idxs 0, 0, 1, 1, 2, 2, ...
+    ShiftLeft(duplicate_2_gather, duplicate_2_gather, static_cast<uint32_t>(2), n_lanes * 2); // in bytes (x4) 0, 0, 4, 4, 8, 8, ...
+
+    // Start of every sub-stream within its channel's stream, [n_sub_streams, N_C_PER_BLOCK]
+    LocalTensor<int32_t> sub_offsets = calcBuf.GetWithOffset<int32_t>(n_lanes, calc_buf_offset);
+    calc_buf_offset += i32_lanes_sz;
+
+    LocalTensor<uint32_t> bit_offsets = calcBuf.GetWithOffset<uint32_t>(2 * n_lanes, calc_buf_offset);
+    calc_buf_offset += 2 * i32_lanes_sz;
+
+    uint32_t raw_merge_sz = ceil_32(N_RAW_MERGE_COUNT * sizeof(half));
+    LocalTensor<half> raw_merged = calcBuf.GetWithOffset<half>(N_RAW_MERGE_COUNT, calc_buf_offset);
+    calc_buf_offset += raw_merge_sz;
+    LocalTensor<half> raw_bit_vals = calcBuf.GetWithOffset<half>(N_RAW_MERGE_COUNT, calc_buf_offset);
+    calc_buf_offset += raw_merge_sz;
+
+    // Prediction is undone on the whole batch in half, ping-ponging between pred_syms and pred_tmp. The byte values
+    // are built once per core and shared by every decode() call, they are not scratch
+    uint32_t batch_half_sz = ceil_32(N_C_PER_BLOCK * N_T_MAX * sizeof(half));
+    LocalTensor<half> pred_syms_buf = calcBuf.GetWithOffset<half>(N_C_PER_BLOCK * N_T_MAX, calc_buf_offset);
+    calc_buf_offset += batch_half_sz;
+    LocalTensor<half> pred_tmp = calcBuf.GetWithOffset<half>(N_C_PER_BLOCK * N_T_MAX, calc_buf_offset);
+    calc_buf_offset += batch_half_sz;
+    LocalTensor<half> anchor_row = calcBuf.GetWithOffset<half>(128, calc_buf_offset);
+    calc_buf_offset += ceil_32(128 * sizeof(half));
+    LocalTensor<uint8_t> pred_wrap = calcBuf.GetWithOffset<uint8_t>(N_C_PER_BLOCK * N_T_MAX / 8, calc_buf_offset);
+    calc_buf_offset += ceil_32(N_C_PER_BLOCK * N_T_MAX / 8);
+
+    // Batches of N_T_MAX tokens were encoded as rows of their own, layer_id * n_batches + batch
+    int32_t last_batch = (t_range_end - 1) / N_T_MAX;
+    for (int32_t b_ii = t_range_start / N_T_MAX; b_ii <= last_batch; ++b_ii) {
+        // Tokens of the batch up to the end of the range are decoded, those before its start are dropped
+        int32_t batch_start = N_T_MAX * b_ii;
+        int32_t n_batch_tokens = t_range_end - batch_start < N_T_MAX ? t_range_end - batch_start : N_T_MAX;
+        int32_t n_skipped = t_range_start > batch_start ? t_range_start - batch_start : 0;
+        uint32_t offset_idx = (layer_id * n_batches + b_ii) * n_channels + channel_start_id;
+
+        // --------
+        // Phase: Copy IN
+        // --------
+        // [end of the channel before the block | ends of the channels of this block], low and high words
+        auto lens = lensInQ.AllocTensor<uint32_t>();
+        uint32_t valid_bytes = n_valid * sizeof(uint32_t);
+        DataCopyPadExtParams<uint32_t> pad_params = {false, 0, 0, 0};
+        if (offset_idx == 0) {
+            Duplicate(lens.ReinterpretCast<int32_t>(), 0, 2 * N_C_PER_BLOCK);
+        } else {
+            DataCopyExtParams prev_params = {1, sizeof(uint64_t), 0, 0, 0};
+            DataCopyPad(lens, gm_cum_lens[2 * (offset_idx - 1)], prev_params, pad_params);
+        }
+        DataCopyExtParams lens_params = {1, static_cast<uint32_t>(n_valid * sizeof(uint64_t)), 0, 0, 0};
+        DataCopyPad(lens[2 * N_C_PER_BLOCK], gm_cum_lens[2 * offset_idx], lens_params, pad_params);
+
+        lensInQ.EnQue(lens);
+        lens = lensInQ.DeQue<uint32_t>();
+
+        if (n_sub_streams == 1) {
+            Duplicate(sub_offsets, 0, N_C_PER_BLOCK);
+        } else {
+            // Padding channels of a tail block keep a zero offset
+            if (n_valid < N_C_PER_BLOCK) {
+                Duplicate(sub_offsets, 0, n_lanes);
+                PipeBarrier<PIPE_ALL>();
+            }
+            uint32_t src_stride = (n_channels - n_valid) * sizeof(uint32_t);
+            uint32_t dst_stride = (N_C_PER_BLOCK * sizeof(uint32_t) - ceil_32(valid_bytes)) / DATABLOCK_BYTES;
+            DataCopyExtParams sub_offsets_params = {static_cast<uint16_t>(n_sub_streams), valid_bytes, src_stride, dst_stride, 0};
+            DataCopyPad(sub_offsets.ReinterpretCast<uint32_t>(), gm_sub_offsets[(offset_idx - channel_start_id) * n_sub_streams + channel_start_id], sub_offsets_params, pad_params);
+        }
 
-    uint32_t curr_dec_val_bcast_sz = ceil_32(bins_per_block * sizeof(half));
-    LocalTensor<half> curr_dec_val_bcast = calcBuf.GetWithOffset<half>(bins_per_block, calc_buf_offset);
-    calc_buf_offset += curr_dec_val_bcast_sz;
+        auto bytestream = byteStreamInQ.AllocTensor<uint8_t>();
+        if (n_valid < N_C_PER_BLOCK) {
+            Duplicate(bytestream[n_valid * N_T_MAX].ReinterpretCast<int16_t>(), static_cast<int16_t>(0), (N_C_PER_BLOCK - n_valid) * N_T_MAX / 2);
+        }
+        PipeBarrier<PIPE_ALL>();
+        DataSyncBarrier<MemDsbT::ALL>();
+        uint64_t offset_start = (static_cast<uint64_t>(lens.GetValue(1)) << 32) | lens.GetValue(0);
+        for (auto c_ii = 0; c_ii < n_valid; ++c_ii) {
+            auto end_words = 2 * (N_C_PER_BLOCK + c_ii);
+            uint64_t offset_end = (static_cast<uint64_t>(lens.GetValue(end_words + 1)) << 32) | lens.GetValue(end_words);
+            uint32_t copy_len = ceil_32(offset_end - offset_start);
+            DataCopy(bytestream[c_ii * N_T_MAX], gm_bytestream[offset_start], copy_len);
+            offset_start = offset_end;
+            PipeBarrier<PIPE_ALL>();
+            DataSyncBarrier<MemDsbT::ALL>();
+        }
+        byteStreamInQ.EnQue(bytestream);
+        bytestream = byteStreamInQ.DeQue<uint8_t>();
+        lensInQ.FreeTensor(lens);
 
-    byteStreamInQ.FreeTensor(bytestream);
+        Duplicate(bits_used, 0, n_lanes);
 
-    uint32_t i32_NC_sz = ceil_32(N_C_PER_BLOCK * sizeof(int32_t));
-    LocalTensor<int32_t> bits_used = calcBuf.GetWithOffset<int32_t>(N_C_PER_BLOCK, calc_buf_offset);
-    calc_buf_offset += i32_NC_sz;
-    Duplicate(bits_used, 0, N_C_PER_BLOCK);
+        // Lanes start at their channel's bytes plus the sub-stream offset, in bits
+        for (auto s_ii = 0; s_ii < n_sub_streams; ++s_ii) {
+            CreateVecIndex(bit_offsets[2 * N_C_PER_BLOCK * s_ii].ReinterpretCast<int32_t>(), 0, N_C_PER_BLOCK * 2);
+        }
+        ShiftRight(bit_offsets, bit_offsets, static_cast<uint32_t>(1), n_lanes * 2);
+        Muls(bit_offsets.ReinterpretCast<int32_t>(), bit_offsets.ReinterpretCast<int32_t>(), static_cast<int32_t>(N_T_MAX * 8), n_lanes * 2);
+        Muls(sub_offsets, sub_offsets, 8, n_lanes);
+        Gather(bits_used_bcast, sub_offsets, duplicate_2_gather, 0, 2 * n_lanes);
+        Add(bit_offsets.ReinterpretCast<int32_t>(), bit_offsets.ReinterpretCast<int32_t>(), bits_used_bcast, 2 * n_lanes);
+
+        LocalTensor<uint8_t> syms_out = symOutQ.AllocTensor<uint8_t>();
+
+        // --------
+        // Phase: Iteratively decode
+        // --------
+        // Token t is position t / n_sub_streams of sub-stream t % n_sub_streams, so the lanes of one step decode
+        // n_sub_streams consecutive tokens. Tokens past n_batch_tokens in the last step are decoded but never copied out.
+        for (int t_ii = 0; t_ii < n_batch_tokens; t_ii += n_sub_streams) {
+            // Read the next byte
+            Gather(bits_used_bcast, bits_used, duplicate_2_gather.ReinterpretCast<uint32_t>(), 0, 2 * n_lanes);
+            Add(bit_offsets.ReinterpretCast<int32_t>(), bit_offsets.ReinterpretCast<int32_t>(), bits_used_bcast, 2 * n_lanes);
+            for (auto s_ii = 0; s_ii < n_sub_streams; ++s_ii) {
+                auto s_bit_offsets = bit_offsets[2 * N_C_PER_BLOCK * s_ii];
+                auto s_tmp_1 = tmp_1[2 * N_C_PER_BLOCK * s_ii];
+                auto s_next_byte = tmp_2[N_C_PER_BLOCK * s_ii];
+                read_unaligned_u8(
+                    bytestream,
+                    s_bit_offsets,
+                    s_next_byte,
+                    s_tmp_1,
+                    pows_2,
+                    N_C_PER_BLOCK
+                );
+            }
+
+            // Look the byte up in the lane's table
+            Muls(tmp_2.ReinterpretCast<int32_t>(), tmp_2.ReinterpretCast<int32_t>(), static_cast<int32_t>(N_C_PER_BLOCK * sizeof(half)), n_lanes);
+            Add(tmp_2.ReinterpretCast<int32_t>(), tmp_2.ReinterpretCast<int32_t>(), lut_lane_offsets, n_lanes);
+            Gather(dec_entries, dec_lut, tmp_2, 0, n_lanes);
+
+            // Bits consumed are the low bits of the entry
+            Cast(bits_used, dec_entries, RoundMode::CAST_RINT, n_lanes);
+            ShiftLeft(bits_used.ReinterpretCast<uint32_t>(), bits_used.ReinterpretCast<uint32_t>(), static_cast<uint32_t>(32 - DEC_LUT_LEN_BITS), n_lanes);
+            ShiftRight(bits_used.ReinterpretCast<uint32_t>(), bits_used.ReinterpretCast<uint32_t>(), static_cast<uint32_t>(32 - DEC_LUT_LEN_BITS), n_lanes);
+
+            // Symbol is the rest, converted to byte (desired output type)
+            Muls(dec_entries, dec_entries, static_cast<half>(1.0 / (1 << DEC_LUT_LEN_BITS)), n_lanes);
+            Cast(syms_out[(t_ii * N_C_PER_BLOCK)], dec_entries, RoundMode::CAST_FLOOR, n_lanes);
+        }
 
-    LocalTensor<int32_t> bits_used_bcast = calcBuf.GetWithOffset<int32_t>(2 * N_C_PER_BLOCK, calc_buf_offset);
-    calc_buf_offset += 2 * i32_NC_sz;
-    Duplicate(bits_used_bcast, 0, 2 * N_C_PER_BLOCK);
+        byteStreamInQ.FreeTensor(bytestream);
+
+        // --------
+        // Phase: Merge raw low bits, symbol = top * 2^n_raw_bits + low
+        // --------
+        if (n_raw_bits > 0) {
+            auto raw_bits = rawBitsInQ.AllocTensor<uint8_t>();
+            uint32_t plane_block_id = (layer_id * n_batches + b_ii) * n_c_blocks + channel_start_id / N_C_PER_BLOCK;
+            DataCopy(raw_bits, gm_raw_bits[plane_block_id * n_raw_bits * N_RAW_PLANE_BYTES], n_raw_bits * N_RAW_PLANE_BYTES);
+            rawBitsInQ.EnQue(raw_bits);
+            raw_bits = rawBitsInQ.DeQue<uint8_t>();
+
+            half raw_scale = static_cast<half>(1 << n_raw_bits);
+            half zero = 0.;
+            int32_t n_merges = (n_batch_tokens * N_C_PER_BLOCK + N_RAW_MERGE_COUNT - 1) / N_RAW_MERGE_COUNT;
+            for (auto m_ii = 0; m_ii < n_merges; ++m_ii) {
+                Cast(raw_merged, syms_out[m_ii * N_RAW_MERGE_COUNT], RoundMode::CAST_NONE, N_RAW_MERGE_COUNT);
+                Muls(raw_merged, raw_merged, raw_scale, N_RAW_MERGE_COUNT);
+                for (auto k_ii = 0; k_ii < n_raw_bits; ++k_ii) {
+                    Duplicate(raw_bit_vals, static_cast<half>(1 << k_ii), N_RAW_MERGE_COUNT);
+                    auto plane = raw_bits[k_ii * N_RAW_PLANE_BYTES + m_ii * N_RAW_MERGE_COUNT / 8];
+                    Select(raw_bit_vals, plane, raw_bit_vals, zero, SELMODE::VSEL_TENSOR_SCALAR_MODE, N_RAW_MERGE_COUNT);
+                    Add(raw_merged, raw_merged, raw_bit_vals, N_RAW_MERGE_COUNT);
+                }
+                Cast(syms_out[m_ii * N_RAW_MERGE_COUNT], raw_merged, RoundMode::CAST_RINT, N_RAW_MERGE_COUNT);
+            }
+            rawBitsInQ.FreeTensor(raw_bits);
+        }
 
-    LocalTensor<int32_t> channel_offsets = calcBuf.GetWithOffset<int32_t>(N_C_PER_BLOCK, calc_buf_offset);
-    calc_buf_offset += i32_NC_sz;
-    CreateVecIndex(channel_offsets, 0, N_C_PER_BLOCK);
-    Muls(channel_offsets, channel_offsets, N_C_PER_BLOCK, N_C_PER_BLOCK);
+        // --------
+        // Phase: Undo the prediction, symbol = residual + prediction modulo n_bins
+        // --------
+        if (pred_group != PRED_NONE) {
+            uint32_t batch_count = N_C_PER_BLOCK * N_T_MAX;
+            half n_syms = static_cast<half>(static_cast<int32_t>(n_bins));
+            half neg_n_syms = static_cast<half>(-static_cast<int32_t>(n_bins));
+            LocalTensor<half> pred_syms = pred_syms_buf;
+            LocalTensor<half> pred_next = pred_tmp;
+            Cast(pred_syms, syms_out, RoundMode::CAST_NONE, batch_count);
+            if (pred_group == PRED_PREV) {
+                // Every token is the sum of the residuals before it, a log step prefix sum down the tokens with a
+                // wrap after every step
+                for (int32_t n_rows = 1; n_rows < n_batch_tokens; n_rows *= 2) {
+                    Adds(pred_next, pred_syms, static_cast<half>(0), n_rows * N_C_PER_BLOCK);
+                    Add(pred_next[n_rows * N_C_PER_BLOCK], pred_syms[n_rows * N_C_PER_BLOCK], pred_syms, (N_T_MAX - n_rows) * N_C_PER_BLOCK);
+                    CompareScalar(pred_wrap, pred_next, n_syms, CMPMODE::GE, batch_count);
+                    Adds(pred_syms, pred_next, neg_n_syms, batch_count);
+                    Select(pred_next, pred_wrap, pred_syms, pred_next, SELMODE::VSEL_TENSOR_TENSOR_MODE, batch_count);
+                    LocalTensor<half> swap = pred_syms;
+                    pred_syms = pred_next;
+                    pred_next = swap;
+                }
+            } else {
+                // The first row of a group is its anchor, added to every other row of the group
+                BinaryRepeatParams row_repeat_params = {1, 1, 1, 8, 8, 0};
+                uint8_t group_repeats = static_cast<uint8_t>(pred_group * N_C_PER_BLOCK / 128);
+                for (int32_t g_start = 0; g_start < n_batch_tokens; g_start += pred_group) {
+                    auto group = pred_syms[g_start * N_C_PER_BLOCK];
+                    Gather(anchor_row, pred_syms, pred_anchor_i16_idxs.ReinterpretCast<uint32_t>(), g_start * N_C_PER_BLOCK * sizeof(half), 128);
+                    Add(group, group, anchor_row, 128, group_repeats, row_repeat_params);
+                    Sub(group, group, anchor_row, N_C_PER_BLOCK);
+                }
+                CompareScalar(pred_wrap, pred_syms, n_syms, CMPMODE::GE, batch_count);
+                Adds(pred_next, pred_syms, neg_n_syms, batch_count);
+                Select(pred_syms, pred_wrap, pred_next, pred_syms, SELMODE::VSEL_TENSOR_TENSOR_MODE, batch_count);
+            }
+            Cast(syms_out, pred_syms, RoundMode::CAST_RINT, batch_count);
+        }
 
-    LocalTensor<int32_t> tmp_sym = calcBuf.GetWithOffset<int32_t>(N_C_PER_BLOCK, calc_buf_offset);
-    calc_buf_offset += i32_NC_sz;
+        // --------
+        // Phase: Copy Out
+        // --------
+        symOutQ.EnQue(syms_out);
+        syms_out = symOutQ.DeQue<uint8_t>();
+        writer.write(syms_out[n_skipped * N_C_PER_BLOCK], layer_id, batch_start + n_skipped, n_batch_tokens - n_skipped,
+            channel_start_id, n_valid);
+        symOutQ.FreeTensor(syms_out);
+    }
+}
 
-    LocalTensor<uint32_t> tmp_1 = calcBuf.GetWithOffset<uint32_t>(2 * N_C_PER_BLOCK, calc_buf_offset);
-    calc_buf_offset += 2 * i32_NC_sz;
+// Writes the decoded symbols as they are, [n_layers, n_tokens, n_channels] uint8 of the decoded layer and token
+// ranges, which start at layer_start and token_start of the chunk
+class PacSymbolWriter {
+public:
+    __aicore__ inline PacSymbolWriter(GM_ADDR output_data_ptr, int32_t n_tokens, int32_t n_layers, int32_t n_channels,
+            int32_t layer_start, int32_t token_start):
+            n_tokens(n_tokens),
+            n_channels(n_channels),
+            layer_start(layer_start),
+            token_start(token_start) {
+        gm_output_data.SetGlobalBuffer(reinterpret_cast<__gm__ uint8_t*>(output_data_ptr), n_layers * n_channels * n_tokens);
+    }
 
-    LocalTensor<uint32_t> tmp_2 = calcBuf.GetWithOffset<uint32_t>(N_C_PER_BLOCK, calc_buf_offset);
-    calc_buf_offset += i32_NC_sz;
+    // syms holds [n_batch_tokens, N_C_PER_BLOCK] symbols of the block starting at channel_start_id
+    __aicore__ inline void write(const LocalTensor<uint8_t>& syms, int32_t layer_id, int32_t token_start,
+            int32_t n_batch_tokens, int32_t channel_start_id, int32_t n_valid) {
+        // Token rows are n_channels apart, the padding channels of a tail block are dropped
+        DataCopyExtParams copy_params = {static_cast<uint16_t>(n_batch_tokens), static_cast<uint32_t>(n_valid), 0,
+            static_cast<uint32_t>(n_channels - n_valid), 0};
+        uint32_t out_offset = ((layer_id - layer_start) * n_tokens + token_start - this->token_start) * n_channels;
+        DataCopyPad(gm_output_data[out_offset + channel_start_id], syms, copy_params);
+    }
 
-    LocalTensor<uint32_t> bit_offsets = calcBuf.GetWithOffset<uint32_t>(2 * N_C_PER_BLOCK, calc_buf_offset);
-    calc_buf_offset += 2 * i32_NC_sz;
-    CreateVecIndex(bit_offsets.ReinterpretCast<int32_t>(), 0, N_C_PER_BLOCK * 2);
-    ShiftRight(bit_offsets, bit_offsets, static_cast<uint32_t>(1), N_C_PER_BLOCK * 2);
-    Muls(bit_offsets.ReinterpretCast<int32_t>(), bit_offsets.ReinterpretCast<int32_t>(), static_cast<int32_t>(N_T_MAX * 8), N_C_PER_BLOCK * 2);
+private:
+    AscendC::GlobalTensor<uint8_t> gm_output_data;
+    int32_t n_tokens;
+    int32_t n_channels;
+    int32_t layer_start;
+    int32_t token_start;
+};
 
-    LocalTensor<uint32_t> duplicate_2_gather = calcBuf.GetWithOffset<uint32_t>(2 * N_C_PER_BLOCK, calc_buf_offset);
-    calc_buf_offset += 2 * i32_NC_sz;
-    CreateVecIndex(duplicate_2_gather.ReinterpretCast<int32_t>(), 0, N_C_PER_BLOCK * 2);
-    ShiftRight(duplicate_2_gather, duplicate_2_gather, static_cast<uint32_t>(1), N_C_PER_BLOCK * 2); // in idxs 0, 0, 1, 1, 2, 2, ...
-    ShiftLeft(duplicate_2_gather, duplicate_2_gather, static_cast<uint32_t>(2), N_C_PER_BLOCK * 2); // in bytes (x4) 0, 0, 4, 4, 8, 8, ...
+// Dequantizes the decoded symbols in UB, x = (sym - zero_point) * scale per channel, and scatters them
+// straight into the paged KV cache. PAC layer l is cache component l / n_cache_layers of layer
+// l % n_cache_layers, i.e. the [kvs, n_cache_layers, n_tokens, n_channels] layout of the L2Page copy with
+// n_channels the hidden dims of a cache component. slot_mapping_ptr holds the slots of the decoded token range,
+// starting at token_start of the chunk. Tokens with a negative slot are skipped.
+template <typename scalar_t, typename slot_t, KVCacheFormat fmt>
+class PacPagedKVWriter {
+public:
+    __aicore__ inline PacPagedKVWriter(
+            GM_ADDR paged_kv_caches, // Pointer table of the paged caches, see GetLayerBasePtr
+            GM_ADDR slot_mapping_ptr, // In slots of the decoded tokens [n_tokens], slot_t
+            GM_ADDR scales_ptr, // In dequant scales [n_layers, n_channels], float
+            GM_ADDR zero_points_ptr, // In dequant zero-points [n_layers, n_channels], float
+            AscendC::TPipe& pipe,
+            int32_t n_tokens,
+            int32_t n_layers,
+            int32_t n_channels,
+            int32_t n_cache_layers,
+            int64_t page_buff_size, // Pages * page size, MERGED_KV only
+            int32_t token_start):
+            paged_kv_caches(paged_kv_caches),
+            slot_token_start(token_start),
+            n_channels(n_channels),
+            n_cache_layers(n_cache_layers),
+            page_buff_size(page_buff_size) {
+        gm_slots.SetGlobalBuffer(reinterpret_cast<__gm__ slot_t*>(slot_mapping_ptr), n_tokens);
+        gm_scales.SetGlobalBuffer(reinterpret_cast<__gm__ float*>(scales_ptr), n_layers * n_channels);
+        gm_zero_points.SetGlobalBuffer(reinterpret_cast<__gm__ float*>(zero_points_ptr), n_layers * n_channels);
+
+        pipe.InitBuffer(slotsBuf, ceil_32(N_T_MAX * sizeof(slot_t)));
+        pipe.InitBuffer(paramsBuf, 2 * PARAM_ELEMS * sizeof(float));
+        pipe.InitBuffer(halfBuf, N_T_PER_TILE * N_C_PER_BLOCK * sizeof(half));
+        pipe.InitBuffer(floatBuf, N_T_PER_TILE * N_C_PER_BLOCK * sizeof(float));
+        pipe.InitBuffer(kvOutQ, 1, N_T_PER_TILE * N_C_PER_BLOCK * sizeof(scalar_t));
+        slots = slotsBuf.Get<slot_t>();
+    }
 
-    LocalTensor<uint8_t> syms_out = symOutQ.AllocTensor<uint8_t>();
+    __aicore__ inline void write(const LocalTensor<uint8_t>& syms, int32_t layer_id, int32_t token_start,
+            int32_t n_batch_tokens, int32_t channel_start_id, int32_t n_valid) {
+        DataCopyExtParams slots_params = {1, static_cast<uint32_t>(n_batch_tokens * sizeof(slot_t)), 0, 0, 0};
+        DataCopyPadExtParams<slot_t> slots_pad = {false, 0, 0, 0};
+        DataCopyPad(slots, gm_slots[token_start - slot_token_start], slots_params, slots_pad);
+        load_params(layer_id, channel_start_id, n_valid);
+
+        int32_t kv_idx = layer_id / n_cache_layers;
+        __gm__ uint8_t* layer_base = GetLayerBasePtr<fmt>(paged_kv_caches, layer_id % n_cache_layers, kv_idx);
+        __gm__ scalar_t* kv_base = reinterpret_cast<__gm__ scalar_t*>(layer_base) + channel_start_id;
+        if constexpr (fmt == KVCacheFormat::MERGED_KV) {
+            kv_base += kv_idx * page_buff_size * n_channels;
+        }
 
-    // --------
-    // Phase: Iteratively decode
-    // --------
-    for (int t_ii = 0; t_ii < n_tokens; ++t_ii) {
-        // Read the next byte
-        Gather(bits_used_bcast, bits_used, duplicate_2_gather.ReinterpretCast<uint32_t>(), 0, 2 * N_C_PER_BLOCK);
-        Add(bit_offsets.ReinterpretCast<int32_t>(), bit_offsets.ReinterpretCast<int32_t>(), bits_used_bcast, 2 * N_C_PER_BLOCK);
-        read_unaligned_u8_2_half(
-            bytestream,
-            bit_offsets,
-            curr_dec_val,
-            tmp_1,
-            tmp_2,
-            pows_2,
-            N_C_PER_BLOCK
-        );
-
-        // Identify the last bin that is less than that byte thus identifying the encoded symbol
-        Gather(curr_dec_val_bcast, curr_dec_val, duplicating_gather_idxs.ReinterpretCast<uint32_t>(), 0, bins_per_block);
-        Compare(cmp_mask, curr_dec_val_bcast, enc_bins, CMPMODE::LT, bins_per_block);
-        ShiftRight(cmp_mask.ReinterpretCast<uint32_t>(), cmp_mask.ReinterpretCast<uint32_t>(), static_cast<uint32_t>(1), bins_per_block / 32);
-        Adds(cmp_mask.ReinterpretCast<int32_t>(), cmp_mask.ReinterpretCast<int32_t>(), 1, bins_per_block / 32);
-        repeats = N_C_PER_BLOCK / (256 / 32);
-        gmp = {
-            1,
-            static_cast<uint8_t>(1),
-            8,
-            1
-        };
+        for (int32_t t_start = 0; t_start < n_batch_tokens; t_start += N_T_PER_TILE) {
+            int32_t n_tile_tokens = n_batch_tokens - t_start < N_T_PER_TILE ? n_batch_tokens - t_start : N_T_PER_TILE;
+            auto kv_out = kvOutQ.AllocTensor<scalar_t>();
+            dequantize(syms[t_start * N_C_PER_BLOCK], kv_out, n_tile_tokens);
+            kvOutQ.EnQue(kv_out);
+            kv_out = kvOutQ.DeQue<scalar_t>();
+            scatter(kv_out, kv_base, t_start, n_tile_tokens, n_valid);
+            kvOutQ.FreeTensor(kv_out);
+        }
+    }
 
-        for(auto repeat_ii = 0; repeat_ii < repeats; ++repeat_ii) {
-            GatherMask(tmp_sym[8 * repeat_ii], enc_syms[N_B_MAX * repeat_ii * 8], cmp_mask.ReinterpretCast<uint32_t>()[8 * repeat_ii], true, 256, gmp, _rsvd);
+private:
+    // Tokens dequantized at a time, N_C_PER_BLOCK floats of a token row are 4 data blocks
+    static constexpr int32_t N_T_PER_TILE = 128;
+    // Float lanes of a vector repeat, the parameters of the block repeated for the 2 tokens of a repeat
+    static constexpr int32_t PARAM_ELEMS = 2 * N_C_PER_BLOCK;
+
+    // [scale | zero-point] of the block, each repeated for PARAM_ELEMS / N_C_PER_BLOCK tokens
+    __aicore__ inline void load_params(int32_t layer_id, int32_t channel_start_id, int32_t n_valid) {
+        LocalTensor<float> params = paramsBuf.Get<float>();
+        if (n_valid < N_C_PER_BLOCK) {
+            Duplicate(params, 0.0f, 2 * PARAM_ELEMS);
+            PipeBarrier<PIPE_ALL>();
         }
+        DataCopyExtParams params_params = {1, static_cast<uint32_t>(n_valid * sizeof(float)), 0, 0, 0};
+        DataCopyPadExtParams<float> pad_params = {false, 0, 0, 0};
+        uint32_t param_offset = layer_id * n_channels + channel_start_id;
+        DataCopyPad(params, gm_scales[param_offset], params_params, pad_params);
+        DataCopyPad(params[PARAM_ELEMS], gm_zero_points[param_offset], params_params, pad_params);
+        PipeBarrier<PIPE_ALL>();
+        DataCopy(params[N_C_PER_BLOCK], params, N_C_PER_BLOCK);
+        DataCopy(params[PARAM_ELEMS + N_C_PER_BLOCK], params[PARAM_ELEMS], N_C_PER_BLOCK);
+        PipeBarrier<PIPE_ALL>();
+    }
 
-        // Convert to byte (desired output type)
-        Cast(tmp_2.ReinterpretCast<half>(), tmp_sym, RoundMode::CAST_NONE, N_C_PER_BLOCK);
-        Cast(syms_out[(t_ii * N_C_PER_BLOCK)], tmp_2.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
+    __aicore__ inline void dequantize(const LocalTensor<uint8_t>& syms, LocalTensor<scalar_t>& kv_out, int32_t n_tile_tokens) {
+        LocalTensor<float> params = paramsBuf.Get<float>();
+        LocalTensor<half> syms_half = halfBuf.Get<half>();
+        LocalTensor<float> vals = floatBuf.Get<float>();
+        uint32_t count = n_tile_tokens * N_C_PER_BLOCK;
+
+        Cast(syms_half, syms, RoundMode::CAST_NONE, count);
+        PipeBarrier<PIPE_V>();
+        Cast(vals, syms_half, RoundMode::CAST_NONE, count);
+        PipeBarrier<PIPE_V>();
+
+        // Every repeat covers 2 tokens, the parameters are re-read for each (src1 repeat stride 0)
+        uint8_t repeats = static_cast<uint8_t>((count + PARAM_ELEMS - 1) / PARAM_ELEMS);
+        BinaryRepeatParams bcast_params = {1, 1, 1, 8, 8, 0};
+        Sub(vals, vals, params[PARAM_ELEMS], PARAM_ELEMS, repeats, bcast_params);
+        PipeBarrier<PIPE_V>();
+        Mul(vals, vals, params, PARAM_ELEMS, repeats, bcast_params);
+        PipeBarrier<PIPE_V>();
+
+        if constexpr (IsSameType<scalar_t, half>::value) {
+            Cast(kv_out, vals, RoundMode::CAST_NONE, count);
+        } else {
+            Cast(kv_out, vals, RoundMode::CAST_RINT, count);
+        }
+        PipeBarrier<PIPE_V>();
+    }
 
-        // Pick out bits consumed from encode lens
-        Add(tmp_sym, tmp_sym, channel_offsets, N_C_PER_BLOCK);
-        Muls(tmp_sym, tmp_sym, 4, N_C_PER_BLOCK);
-        Gather(bits_used, enc_lens_32, tmp_sym.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK);
+    // Runs of consecutive slots are consecutive cache rows and go out as one strided copy
+    __aicore__ inline void scatter(const LocalTensor<scalar_t>& kv_out, __gm__ scalar_t* kv_base,
+            int32_t t_start, int32_t n_tile_tokens, int32_t n_valid) {
+        uint32_t valid_bytes = n_valid * sizeof(scalar_t);
+        uint32_t row_gap_bytes = (n_channels - n_valid) * sizeof(scalar_t);
+        uint32_t src_stride = (N_C_PER_BLOCK * sizeof(scalar_t) - ceil_32(valid_bytes)) / DATABLOCK_BYTES;
+
+        int32_t t_ii = 0;
+        while (t_ii < n_tile_tokens) {
+            int64_t slot = static_cast<int64_t>(slots.GetValue(t_start + t_ii));
+            int32_t run = 1;
+            while (slot >= 0 && t_ii + run < n_tile_tokens &&
+                    static_cast<int64_t>(slots.GetValue(t_start + t_ii + run)) == slot + run) {
+                ++run;
+            }
+            if (slot >= 0) {
+                AscendC::GlobalTensor<scalar_t> paged;
+                paged.SetGlobalBuffer(kv_base + slot * n_channels, run * n_channels);
+                DataCopyExtParams copy_params = {static_cast<uint16_t>(run), valid_bytes, src_stride, row_gap_bytes, 0};
+                DataCopyPad(paged, kv_out[t_ii * N_C_PER_BLOCK], copy_params);
+            }
+            t_ii += run;
+        }
     }
 
-    // --------
-    // Phase: Copy Out
-    // --------
-    symOutQ.EnQue(syms_out);
-    syms_out = symOutQ.DeQue<uint8_t>();
+    GM_ADDR paged_kv_caches;
+    AscendC::GlobalTensor<slot_t> gm_slots;
+    AscendC::GlobalTensor<float> gm_scales;
+    AscendC::GlobalTensor<float> gm_zero_points;
 
-    uint16_t dst_stride = N_DBs_PER_BLOCK * ((n_channels / N_C_PER_BLOCK) - 1);
-    DataCopyParams repeatParams = {static_cast<uint16_t>(n_tokens), N_DBs_PER_BLOCK, 0, dst_stride};
-    DataCopy(gm_output_data[(layer_id * n_channels * n_tokens) + channel_start_id], syms_out, repeatParams);
+    TBuf<TPosition::VECCALC> slotsBuf;
+    TBuf<TPosition::VECCALC> paramsBuf;
+    TBuf<TPosition::VECCALC> halfBuf;
+    TBuf<TPosition::VECCALC> floatBuf;
+    AscendC::TQue<AscendC::TPosition::VECOUT, 1> kvOutQ;
+    LocalTensor<slot_t> slots;
+    int32_t slot_token_start;
 
-    symOutQ.FreeTensor(syms_out);
-}
+    int32_t n_channels;
+    int32_t n_cache_layers;
+    int64_t page_buff_size;
+};
 } // namespace impl
 } // namespace pac_coder
 } // namespace kvcache_ops
@@ -408,12 +832,20 @@ __aicore__ inline void PacDecoder::decode(int layer_id, int channel_start_id) {
 extern "C" __global__ __aicore__ void pac_decode_kernel (
     GM_ADDR meta_data_ptr,
     GM_ADDR cum_lens_ptr,
+    GM_ADDR sub_offsets_ptr,
+    GM_ADDR raw_bits_ptr,
     GM_ADDR bytestream_ptr,
     GM_ADDR output_data_ptr,
     const uint32_t n_bins,
     const int n_tokens,
     const int n_layers,
-    const int n_channels
+    const int n_channels,
+    const int n_sub_streams,
+    const int pred_group,
+    const int layer_start,
+    const int layer_end,
+    const int token_start,
+    const int token_end
 ) {
     KERNEL_TASK_TYPE_DEFAULT(KERNEL_TYPE_AIV_ONLY);
 
@@ -422,32 +854,179 @@ extern "C" __global__ __aicore__ void pac_decode_kernel (
     kvcache_ops::pac_coder::impl::PacDecoder decoder {
         meta_data_ptr,
         cum_lens_ptr,
+        sub_offsets_ptr,
+        raw_bits_ptr,
         bytestream_ptr,
-        output_data_ptr,
         pipe,
         n_tokens,
         n_layers,
         n_channels,
-        n_bins};
+        n_bins,
+        n_sub_streams,
+        pred_group,
+        token_start,
+        token_end};
+    int n_range_layers = layer_end - layer_start;
+    kvcache_ops::pac_coder::impl::PacSymbolWriter writer {output_data_ptr, token_end - token_start, n_range_layers,
+        n_channels, layer_start, token_start};
 
-    int max_work_idx = n_layers * n_channels / kvcache_ops::pac_coder::N_C_PER_BLOCK;
+    int n_c_blocks = (n_channels + kvcache_ops::pac_coder::N_C_PER_BLOCK - 1) / kvcache_ops::pac_coder::N_C_PER_BLOCK;
+    int max_work_idx = n_range_layers * n_c_blocks;
 
     int32_t coreIdx = AscendC::GetBlockIdx();
     int32_t launchedCores = AscendC::GetBlockNum();
 
     for (int work_idx = coreIdx; work_idx < max_work_idx; work_idx += launchedCores) {
-        int layer_id = work_idx % n_layers;
-        int channel_id = kvcache_ops::pac_coder::N_C_PER_BLOCK * (work_idx / n_layers);
-        decoder.decode(layer_id, channel_id);
+        int layer_id = layer_start + work_idx % n_range_layers;
+        int channel_id = kvcache_ops::pac_coder::N_C_PER_BLOCK * (work_idx / n_range_layers);
+        decoder.decode(layer_id, channel_id, writer);
+    }
+}
+
+// pac_decode_kernel over n_chunks whole chunks of the same n_layers and n_channels in one launch, the
+// (chunk, layer, block) work items of all chunks are spread over the cores
+extern "C" __global__ __aicore__ void pac_decode_batched_kernel (
+    GM_ADDR desc_ptr,
+    GM_ADDR chunk_tokens_ptr,
+    const uint32_t n_bins,
+    const int n_tokens_max,
+    const int n_chunks,
+    const int n_layers,
+    const int n_channels,
+    const int n_sub_streams,
+    const int pred_group
+) {
+    KERNEL_TASK_TYPE_DEFAULT(KERNEL_TYPE_AIV_ONLY);
+
+    AscendC::TPipe pipe{};
+
+    constexpr int32_t desc_words = kvcache_ops::pac_coder::PAC_DEC_DESC_WORDS;
+    AscendC::GlobalTensor<uint64_t> gm_desc;
+    gm_desc.SetGlobalBuffer(reinterpret_cast<__gm__ uint64_t*>(desc_ptr), n_chunks * desc_words);
+    AscendC::GlobalTensor<int32_t> gm_chunk_tokens;
+    gm_chunk_tokens.SetGlobalBuffer(reinterpret_cast<__gm__ int32_t*>(chunk_tokens_ptr), n_chunks);
+
+    int n_c_blocks = (n_channels + kvcache_ops::pac_coder::N_C_PER_BLOCK - 1) / kvcache_ops::pac_coder::N_C_PER_BLOCK;
+    int chunk_work_items = n_layers * n_c_blocks;
+    int max_work_idx = n_chunks * chunk_work_items;
+
+    int32_t coreIdx = AscendC::GetBlockIdx();
+    int32_t launchedCores = AscendC::GetBlockNum();
+
+    int work_idx = kvcache_ops::pac_coder::impl::next_chunk_work(
+        gm_chunk_tokens, coreIdx, max_work_idx, chunk_work_items, launchedCores, n_tokens_max);
+    if (work_idx >= max_work_idx) {
+        return;
+    }
+
+    // The decoder is only re-pointed when a core crosses into the next chunk
+    int loaded_chunk = work_idx / chunk_work_items;
+    int n_tokens = gm_chunk_tokens.GetValue(loaded_chunk);
+    kvcache_ops::pac_coder::impl::PacDecoder decoder {
+        kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, loaded_chunk, 0),
+        kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, loaded_chunk, 1),
+        kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, loaded_chunk, 2),
+        kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, loaded_chunk, 3),
+        kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, loaded_chunk, 4),
+        pipe,
+        n_tokens,
+        n_layers,
+        n_channels,
+        n_bins,
+        n_sub_streams,
+        pred_group,
+        0,
+        n_tokens};
+
+    for (; work_idx < max_work_idx; work_idx = kvcache_ops::pac_coder::impl::next_chunk_work(
+            gm_chunk_tokens, work_idx + launchedCores, max_work_idx, chunk_work_items, launchedCores, n_tokens_max)) {
+        int chunk_id = work_idx / chunk_work_items;
+        if (chunk_id != loaded_chunk) {
+            n_tokens = gm_chunk_tokens.GetValue(chunk_id);
+            decoder.set_chunk(
+                kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, chunk_id, 0),
+                kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, chunk_id, 1),
+                kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, chunk_id, 2),
+                kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, chunk_id, 3),
+                kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, chunk_id, 4),
+                n_tokens,
+                0,
+                n_tokens);
+            loaded_chunk = chunk_id;
+        }
+        kvcache_ops::pac_coder::impl::PacSymbolWriter writer {
+            kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, chunk_id, 5), n_tokens, n_layers, n_channels, 0, 0};
+
+        int chunk_work_idx = work_idx % chunk_work_items;
+        int layer_id = chunk_work_idx % n_layers;
+        int channel_id = kvcache_ops::pac_coder::N_C_PER_BLOCK * (chunk_work_idx / n_layers);
+        decoder.decode(layer_id, channel_id, writer);
     }
 }
 
+#define PAC_DECODE_PAGED_KERNEL_NAME(TYPE, SLOTTYPE, FMT) \
+    pac_decode_paged_##TYPE##_##SLOTTYPE##_##FMT
+
+#define PAC_DECODE_PAGED_DECLARE(TYPE, SLOTTYPE, FMT)                                                   \
+    extern "C" __global__ __aicore__ void PAC_DECODE_PAGED_KERNEL_NAME(TYPE, SLOTTYPE, FMT)(          \
+        GM_ADDR meta_data_ptr, GM_ADDR cum_lens_ptr, GM_ADDR sub_offsets_ptr, GM_ADDR raw_bits_ptr,     \
+        GM_ADDR bytestream_ptr, GM_ADDR paged_kv_caches, GM_ADDR slot_mapping_ptr,                      \
+        GM_ADDR scales_ptr, GM_ADDR zero_points_ptr,                                                    \
+        const uint32_t n_bins, const int n_tokens, const int n_layers, const int n_channels,            \
+        const int n_sub_streams, const int pred_group, const int n_cache_layers,                        \
+        const int64_t page_buff_size,                                                                   \
+        const int layer_start, const int layer_end, const int token_start, const int token_end)         \
+    {                                                                                                   \
+        KERNEL_TASK_TYPE_DEFAULT(KERNEL_TYPE_AIV_ONLY);                                                 \
+        AscendC::TPipe pipe{};                                                                          \
+        kvcache_ops::pac_coder::impl::PacDecoder decoder {                                              \
+            meta_data_ptr, cum_lens_ptr, sub_offsets_ptr, raw_bits_ptr, bytestream_ptr, pipe,           \
+            n_tokens, n_layers, n_channels, n_bins, n_sub_streams, pred_group, token_start, token_end}; \
+        kvcache_ops::pac_coder::impl::PacPagedKVWriter<TYPE, SLOTTYPE, kvcache_ops::KVCacheFormat::FMT> writer { \
+            paged_kv_caches, slot_mapping_ptr, scales_ptr, zero_points_ptr, pipe,                       \
+            token_end - token_start, n_layers, n_channels, n_cache_layers, page_buff_size, token_start}; \
+        int n_range_layers = layer_end - layer_start;                                                   \
+        int n_c_blocks = (n_channels + kvcache_ops::pac_coder::N_C_PER_BLOCK - 1) / kvcache_ops::pac_coder::N_C_PER_BLOCK; \
+        int max_work_idx = n_range_layers * n_c_blocks;                                                 \
+        int32_t coreIdx = AscendC::GetBlockIdx();                                                       \
+        int32_t launchedCores = AscendC::GetBlockNum();                                                 \
+        for (int work_idx = coreIdx; work_idx < max_work_idx; work_idx += launchedCores) {              \
+            int layer_id = layer_start + work_idx % n_range_layers;                                     \
+            int channel_id = kvcache_ops::pac_coder::N_C_PER_BLOCK * (work_idx / n_range_layers);       \
+            decoder.decode(layer_id, channel_id, writer);                                               \
+        }                                                                                               \
+    }
+
+// MLA_KV and DSA_KV cache components differ in hidden dims, they do not map onto the channels of one chunk
+#define EXPAND_FMT_PAC_DECODE_PAGED(TYPE, SLOTTYPE) \
+    PAC_DECODE_PAGED_DECLARE(TYPE, SLOTTYPE, MERGED_KV) \
+    PAC_DECODE_PAGED_DECLARE(TYPE, SLOTTYPE, SEPARATE_KV)
+
+#define EXPAND_SLOT_PAC_DECODE_PAGED(TYPE) \
+    EXPAND_FMT_PAC_DECODE_PAGED(TYPE, int32_t) \
+    EXPAND_FMT_PAC_DECODE_PAGED(TYPE, int64_t)
+
+EXPAND_SLOT_PAC_DECODE_PAGED(half)
+#if (__CCE_AICORE__ >= 220)
+EXPAND_SLOT_PAC_DECODE_PAGED(bfloat16_t)
+#endif
+
 namespace kvcache_ops {
 namespace pac_coder {
 
-void pac_decode(
+// Decodes streams written by pac_encode() with the same n_tokens and n_sub_streams, sub_offsets_ptr is only
+// read for more than one sub-stream. Chunks longer than N_T_MAX tokens are read as their batches. n_bins above
+// N_B_MAX takes the low bits of the symbols from raw_bits_ptr.
+// Only layers [layer_start, layer_end) and tokens [token_start, token_end) of the chunk are decoded, into a
+// [layer_end - layer_start, token_end - token_start, n_channels] output_data_ptr. The uint64 cumulative lengths
+// are the seek index: a block is read from the first batch of N_T_MAX tokens overlapping the token range up to its
+// last token, so a range costs in proportion to its layers and to its tokens rounded out to batches.
+// pred_group is that of pac_encode(), the residuals are turned back into symbols on chip.
+void pac_decode_range(
     uint8_t* meta_data_ptr,
     uint8_t* cum_lens_ptr,
+    uint8_t* sub_offsets_ptr,
+    uint8_t* raw_bits_ptr,
     uint8_t* bytestream_ptr,
     uint8_t* output_data_ptr,
     void* stream,
@@ -455,19 +1034,269 @@ void pac_decode(
     const int n_bins,
     const int n_tokens,
     const int n_layers,
-    const int n_channels) {
+    const int n_channels,
+    const int n_sub_streams,
+    const int pred_group,
+    const int layer_start,
+    const int layer_end,
+    const int token_start,
+    const int token_end) {
+
+    check_pac_params(n_bins, n_sub_streams, pred_group, raw_bits_ptr != nullptr);
+
+    if (layer_start < 0 || layer_start >= layer_end || layer_end > n_layers ||
+            token_start < 0 || token_start >= token_end || token_end > n_tokens) {
+        ASCENDC_REPORT_NOT_SUPPORT(false, "PAC decode range out of the chunk.");
+        throw std::runtime_error("layers: [" + std::to_string(layer_start) + ", " + std::to_string(layer_end) +
+            "), tokens: [" + std::to_string(token_start) + ", " + std::to_string(token_end) + ") not supported.");
+    }
 
-    int blockDim = n_layers * (n_channels / N_C_PER_BLOCK) < n_aiv ? n_layers * (n_channels / N_C_PER_BLOCK) : n_aiv;
+    int n_c_blocks = (n_channels + N_C_PER_BLOCK - 1) / N_C_PER_BLOCK;
+    int n_range_blocks = (layer_end - layer_start) * n_c_blocks;
+    int blockDim = n_range_blocks < n_aiv ? n_range_blocks : n_aiv;
 
     pac_decode_kernel<<<blockDim, nullptr, stream>>>(
         meta_data_ptr,
         cum_lens_ptr,
+        sub_offsets_ptr,
+        raw_bits_ptr,
         bytestream_ptr,
         output_data_ptr,
         n_bins,
         n_tokens,
         n_layers,
-        n_channels);
+        n_channels,
+        n_sub_streams,
+        pred_group,
+        layer_start,
+        layer_end,
+        token_start,
+        token_end);
+}
+
+void pac_decode(
+    uint8_t* meta_data_ptr,
+    uint8_t* cum_lens_ptr,
+    uint8_t* sub_offsets_ptr,
+    uint8_t* raw_bits_ptr,
+    uint8_t* bytestream_ptr,
+    uint8_t* output_data_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bins,
+    const int n_tokens,
+    const int n_layers,
+    const int n_channels,
+    const int n_sub_streams) {
+    pac_decode_range(meta_data_ptr, cum_lens_ptr, sub_offsets_ptr, raw_bits_ptr, bytestream_ptr, output_data_ptr, stream,
+        n_aiv, n_bins, n_tokens, n_layers, n_channels, n_sub_streams, PRED_NONE, 0, n_layers, 0, n_tokens);
+}
+
+void pac_decode(
+    uint8_t* meta_data_ptr,
+    uint8_t* cum_lens_ptr,
+    uint8_t* bytestream_ptr,
+    uint8_t* output_data_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bins,
+    const int n_tokens,
+    const int n_layers,
+    const int n_channels) {
+    pac_decode(meta_data_ptr, cum_lens_ptr, nullptr, nullptr, bytestream_ptr, output_data_ptr, stream,
+        n_aiv, n_bins, n_tokens, n_layers, n_channels, 1);
+}
+
+// pac_decode() of n_chunks whole chunks in a single launch, for many short chunks that each fill only a few cores.
+// desc_ptr is a device array [n_chunks, PAC_DEC_DESC_WORDS] of uint64 device addresses, per chunk the
+// meta_data_ptr, cum_lens_ptr, sub_offsets_ptr, raw_bits_ptr, bytestream_ptr and output_data_ptr of its own
+// pac_decode() (unused ones may be 0). chunk_tokens_ptr is a device array [n_chunks] of int32, every chunk's
+// n_tokens, none past n_tokens_max. The chunks share n_layers, n_channels, n_bins, sub-streams and prediction, as
+// written by pac_encode_batched() or by separate pac_encode() calls. Chunks of n_tokens outside [1, n_tokens_max]
+// are skipped, their outputs are left untouched.
+void pac_decode_batched(
+    uint8_t* desc_ptr,
+    uint8_t* chunk_tokens_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bins,
+    const int n_tokens_max,
+    const int n_chunks,
+    const int n_layers,
+    const int n_channels,
+    const int n_sub_streams,
+    const int pred_group) {
+
+    check_pac_params(n_bins, n_sub_streams, pred_group);
+
+    if (n_tokens_max < 1 || n_tokens_max > N_T_CHUNK_MAX) {
+        ASCENDC_REPORT_NOT_SUPPORT(false, "Unsupported number of PAC tokens.");
+        throw std::runtime_error("n_tokens_max: " + std::to_string(n_tokens_max) + " not supported.");
+    }
+
+    if (n_chunks < 1) {
+        ASCENDC_REPORT_NOT_SUPPORT(false, "Unsupported number of PAC chunks.");
+        throw std::runtime_error("n_chunks: " + std::to_string(n_chunks) + " not supported.");
+    }
+
+    int n_c_blocks = (n_channels + N_C_PER_BLOCK - 1) / N_C_PER_BLOCK;
+    int64_t n_work_items = static_cast<int64_t>(n_chunks) * n_layers * n_c_blocks;
+    int blockDim = n_work_items < n_aiv ? static_cast<int>(n_work_items) : n_aiv;
+
+    pac_decode_batched_kernel<<<blockDim, nullptr, stream>>>(
+        desc_ptr,
+        chunk_tokens_ptr,
+        n_bins,
+        n_tokens_max,
+        n_chunks,
+        n_layers,
+        n_channels,
+        n_sub_streams,
+        pred_group);
+}
+
+void pac_decode_batched(
+    uint8_t* desc_ptr,
+    uint8_t* chunk_tokens_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bins,
+    const int n_tokens_max,
+    const int n_chunks,
+    const int n_layers,
+    const int n_channels) {
+    pac_decode_batched(desc_ptr, chunk_tokens_ptr, stream, n_aiv, n_bins, n_tokens_max, n_chunks, n_layers, n_channels,
+        1, PRED_NONE);
+}
+
+#define PAC_DECODE_PAGED_LAUNCH(TYPE, SLOTTYPE, FMT)                                                    \
+    PAC_DECODE_PAGED_KERNEL_NAME(TYPE, SLOTTYPE, FMT)<<<blockDim, nullptr, stream>>>(                   \
+        meta_data_ptr, cum_lens_ptr, sub_offsets_ptr, raw_bits_ptr, bytestream_ptr,                     \
+        paged_kv_caches, slot_mapping_ptr, scales_ptr, zero_points_ptr,                                 \
+        n_bins, n_tokens, n_layers, n_channels, n_sub_streams, pred_group, n_cache_layers, page_buff_size, \
+        layer_start, layer_end, token_start, token_end)
+
+#define PAC_DECODE_PAGED_DISPATCH_FMT(TYPE, SLOTTYPE)                                                   \
+    switch (kvcacheFormat) {                                                                            \
+        case KVCacheFormat::MERGED_KV:                                                                  \
+            PAC_DECODE_PAGED_LAUNCH(TYPE, SLOTTYPE, MERGED_KV);                                         \
+            break;                                                                                      \
+        case KVCacheFormat::SEPARATE_KV:                                                                \
+            PAC_DECODE_PAGED_LAUNCH(TYPE, SLOTTYPE, SEPARATE_KV);                                       \
+            break;                                                                                      \
+        default:                                                                                        \
+            ASCENDC_REPORT_NOT_SUPPORT(false, "Unsupported KVCacheFormat for the paged PAC decode.");  \
+            throw std::runtime_error("KVCacheFormat: " + std::to_string(static_cast<int>(kvcacheFormat)) + " not supported."); \
+    }
+
+#define PAC_DECODE_PAGED_DISPATCH_SLOT(TYPE)                                                            \
+    switch (slotType) {                                                                                 \
+        case AscendType::INT32:                                                                         \
+            PAC_DECODE_PAGED_DISPATCH_FMT(TYPE, int32_t)                                                \
+            break;                                                                                      \
+        case AscendType::INT64:                                                                         \
+            PAC_DECODE_PAGED_DISPATCH_FMT(TYPE, int64_t)                                                \
+            break;                                                                                      \
+        default:                                                                                        \
+            ASCENDC_REPORT_NOT_SUPPORT(false, std::to_string(static_cast<int>(slotType)) + " is not supported.") \
+            throw std::runtime_error("Slot type: " + std::to_string(static_cast<int>(slotType)) + " not supported."); \
+    }
+
+// Decodes like pac_decode() but dequantizes the symbols on chip, x = (sym - zero_point) * scale with the
+// [n_layers, n_channels] float scales and zero-points, and scatters them into the paged KV cache through
+// slot_mapping_ptr, so a compressed chunk is reloaded in a single pass. The chunk is the [kvs, n_cache_layers,
+// n_tokens, n_channels] layout of the L2Page copy (n_layers = kvs * n_cache_layers, n_channels the hidden dims),
+// page_buff_size is pages * page size. type is the cache dtype (FP16 / BF16), slotType INT32 / INT64.
+// Layer and token ranges as for pac_decode_range(), slot_mapping_ptr holds the slots of the token range only.
+void pac_decode_paged_range(
+    AscendType type,
+    AscendType slotType,
+    KVCacheFormat kvcacheFormat,
+    uint8_t* meta_data_ptr,
+    uint8_t* cum_lens_ptr,
+    uint8_t* sub_offsets_ptr,
+    uint8_t* raw_bits_ptr,
+    uint8_t* bytestream_ptr,
+    uint8_t* paged_kv_caches,
+    uint8_t* slot_mapping_ptr,
+    uint8_t* scales_ptr,
+    uint8_t* zero_points_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bins,
+    const int n_tokens,
+    const int n_layers,
+    const int n_channels,
+    const int n_sub_streams,
+    const int pred_group,
+    const int n_cache_layers,
+    const int64_t page_buff_size,
+    const int layer_start,
+    const int layer_end,
+    const int token_start,
+    const int token_end) {
+
+    check_pac_params(n_bins, n_sub_streams, pred_group, raw_bits_ptr != nullptr);
+
+    int n_kvs = n_cache_layers > 0 ? n_layers / n_cache_layers : 0;
+    int n_kvs_max = kvcacheFormat == KVCacheFormat::MERGED_KV || kvcacheFormat == KVCacheFormat::SEPARATE_KV ? 2 : 0;
+    if (n_kvs < 1 || n_kvs > n_kvs_max || n_layers % n_cache_layers != 0) {
+        ASCENDC_REPORT_NOT_SUPPORT(false, "PAC layers do not map onto the paged cache layers.");
+        throw std::runtime_error("n_layers: " + std::to_string(n_layers) + " with n_cache_layers: " +
+            std::to_string(n_cache_layers) + " not supported.");
+    }
+
+    if (layer_start < 0 || layer_start >= layer_end || layer_end > n_layers ||
+            token_start < 0 || token_start >= token_end || token_end > n_tokens) {
+        ASCENDC_REPORT_NOT_SUPPORT(false, "PAC decode range out of the chunk.");
+        throw std::runtime_error("layers: [" + std::to_string(layer_start) + ", " + std::to_string(layer_end) +
+            "), tokens: [" + std::to_string(token_start) + ", " + std::to_string(token_end) + ") not supported.");
+    }
+
+    int n_c_blocks = (n_channels + N_C_PER_BLOCK - 1) / N_C_PER_BLOCK;
+    int n_range_blocks = (layer_end - layer_start) * n_c_blocks;
+    int blockDim = n_range_blocks < n_aiv ? n_range_blocks : n_aiv;
+
+    switch (type) {
+        case AscendType::FP16:
+            PAC_DECODE_PAGED_DISPATCH_SLOT(half)
+            break;
+#if (ASCEND_AICORE_ARCH >= 220)
+        case AscendType::BF16:
+            PAC_DECODE_PAGED_DISPATCH_SLOT(bfloat16_t)
+            break;
+#endif
+        default:
+            ASCENDC_REPORT_NOT_SUPPORT(false, std::to_string(static_cast<int>(type)) + " is not supported.")
+            throw std::runtime_error("Scalar type: " + std::to_string(static_cast<int>(type)) + " not supported.");
+    }
+}
+
+void pac_decode_paged(
+    AscendType type,
+    AscendType slotType,
+    KVCacheFormat kvcacheFormat,
+    uint8_t* meta_data_ptr,
+    uint8_t* cum_lens_ptr,
+    uint8_t* sub_offsets_ptr,
+    uint8_t* raw_bits_ptr,
+    uint8_t* bytestream_ptr,
+    uint8_t* paged_kv_caches,
+    uint8_t* slot_mapping_ptr,
+    uint8_t* scales_ptr,
+    uint8_t* zero_points_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bins,
+    const int n_tokens,
+    const int n_layers,
+    const int n_channels,
+    const int n_sub_streams,
+    const int n_cache_layers,
+    const int64_t page_buff_size) {
+    pac_decode_paged_range(type, slotType, kvcacheFormat, meta_data_ptr, cum_lens_ptr, sub_offsets_ptr, raw_bits_ptr,
+        bytestream_ptr, paged_kv_caches, slot_mapping_ptr, scales_ptr, zero_points_ptr, stream, n_aiv, n_bins, n_tokens,
+        n_layers, n_channels, n_sub_streams, PRED_NONE, n_cache_layers, page_buff_size, 0, n_layers, 0, n_tokens);
 }
 } // namespace pac_coder
 } // namespace kvcache_ops
\ No newline at end of file
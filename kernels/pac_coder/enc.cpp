@@ -1,39 +1,47 @@
 #include "kernel_operator.h"
+#include "pac_common.h"
+#include <stdexcept>
+#include <string>
 using namespace AscendC;
 
 namespace kvcache_ops {
 namespace pac_coder {
 
-constexpr int32_t DATABLOCK_BYTES = 32;
-constexpr int32_t N_C_PER_BLOCK = 32;
-static_assert(N_C_PER_BLOCK % DATABLOCK_BYTES == 0);
+constexpr int32_t N_C_MAX = 4096;
 
-// Some intializations implicitly assume 32 channels - update as appropriate before changing this assert
-static_assert(N_C_PER_BLOCK == 32);
+constexpr int32_t N_T_PER_BATCH = N_T_MAX * N_C_PER_BLOCK;
+constexpr int32_t N_RAW_PLANE_BYTES = N_T_PER_BATCH / 8; // One bit per symbol of a batch
 
-constexpr int32_t N_DBs_PER_BLOCK = N_C_PER_BLOCK / DATABLOCK_BYTES; // Data blocks per copy block (assuming u8)
-constexpr int32_t N_C_MAX = 4096;
+// Histogram of meta_data_build(): symbols of N_HIST_ROWS tokens at a time are looked up as one-hots over
+// N_HIST_WORDS uint32 words of 4 bit counters. A table holds N_B_MAX + 1 entries, the last for dummy tokens.
+constexpr int32_t N_HIST_ROWS = 64;
+constexpr int32_t N_HIST_WORDS = 4;
+constexpr int32_t HIST_TABLE_STRIDE = 40;
+static_assert(N_T_MAX / N_HIST_ROWS < 16 && N_B_MAX == 8 * N_HIST_WORDS);
 
-constexpr int32_t N_T_MAX = 256;
-static_assert(N_T_MAX % 256 == 0);
+// Sub-streams split a batch into whole data blocks
+static_assert(N_T_MAX % (DATABLOCK_BYTES * N_SUB_STREAMS_MAX) == 0);
 
-constexpr int32_t N_B_MAX = 32;
-static_assert(N_B_MAX % 32 == 0);
+// A prediction group fills whole 128 element repeats
+static_assert(PRED_GROUP_MIN * N_C_PER_BLOCK % 128 == 0);
 
-constexpr int32_t N_T_PER_BATCH = N_T_MAX * N_C_PER_BLOCK;
+// Upper bound of launched vector cores, sizes the SyncAll area at the start of the encode workspace
+constexpr int32_t N_AIV_MAX = 40;
 
-namespace impl {
-__aicore__ inline auto ceil_32(int32_t size) -> uint32_t {
-    return size % 32 == 0 ? size : 32 * (1 + (size / 32));
-};
+// Batched launches take PAC_ENC_DESC_WORDS device addresses per chunk, in the order pac_encode_with_meta() takes
+// them: input, meta, output, output lengths, sub-stream offsets and raw bit planes
+constexpr int32_t PAC_ENC_DESC_WORDS = 6;
 
+namespace impl {
 class PacEncoder {
 public:
     __aicore__ inline PacEncoder(
         GM_ADDR in_syms, // In symbols [n_layers, n_tokens, n_channels], uint8
         GM_ADDR out_meta, // Out meta [n_layers, n_channels, n_bins], uint16
-        GM_ADDR out_bytes, // Out bytes [n_layers, n_channels, batch_size], uint8
-        GM_ADDR out_lens, // Out lengths [n_layers, n_channels], uint32
+        GM_ADDR out_bytes, // Out bytes [n_layers, n_batches, n_channels, N_T_MAX], uint8
+        GM_ADDR out_lens, // Out lengths [n_layers, n_batches, n_channels], uint64
+        GM_ADDR out_sub_offsets, // Out sub-stream offsets [n_layers, n_batches, n_sub_streams, n_channels], uint32
+        GM_ADDR out_raw_bits, // Out raw bit planes [n_layers, n_batches, ceil(n_channels / 32), n_raw_bits, N_RAW_PLANE_BYTES], uint8
 
         TPipe& pipe,
 
@@ -42,11 +50,48 @@ public:
         int32_t n_channels,
         uint32_t n_bins,
         int32_t chunk_size,
+        int32_t n_sub_streams,
+        int32_t pred_group, // PRED_NONE, PRED_PREV or the tokens of a group coded against its first
         half scale_factor);
 
     __aicore__ inline void meta_data_calc(int layer_id, int channel_start_id);
     __aicore__ inline void encode(int layer_id, int channel_id);
+    // meta_data_calc() and encode() in one pass, the tables and the last batch of symbols never leave UB
+    __aicore__ inline void encode_with_meta(int layer_id, int channel_start_id);
+    // encode() from the cached tables in meta while they still fit the chunk. Falls back to encode_with_meta(),
+    // overwriting the cached tables, once a channel of the block codes to more than cost_limit bits or meets a
+    // symbol the tables can't encode
+    __aicore__ inline void encode_adaptive(int layer_id, int channel_start_id, int32_t cost_limit);
+    // Coded bits of every channel of the block under the tables meta_data_calc() would build, raw bits included,
+    // into out_lens [n_layers, n_channels]. Nothing else is written
+    __aicore__ inline void estimate(int layer_id, int channel_start_id);
+    // Moves on to another chunk of the same n_layers, n_channels and coding, see pac_encode_batched()
+    __aicore__ inline void set_chunk(
+        GM_ADDR in_syms,
+        GM_ADDR out_meta,
+        GM_ADDR out_bytes,
+        GM_ADDR out_lens,
+        GM_ADDR out_sub_offsets,
+        GM_ADDR out_raw_bits,
+        int32_t n_tokens,
+        half scale_factor);
 private:
+    // Casts a batch of up to N_T_MAX tokens to half at the start of calcBuf, returns the number of real tokens.
+    // Only the coded top bits are left, emit_raw_bits writes the low bits out as well.
+    __aicore__ inline int32_t load_batch(int layer_id, int batch_id, int channel_start_id, bool emit_raw_bits);
+    __aicore__ inline void split_raw_bits(int row_id, int channel_start_id, bool emit_raw_bits);
+    __aicore__ inline void predict_batch();
+    // Leaves the block's last batch as load_batch() does
+    __aicore__ inline void meta_data_build(int layer_id, int channel_start_id, const LocalTensor<int16_t>& meta_out, bool emit_raw_bits);
+    // One bin of the 2^n alignment passes for all channels: new_high = low + the widest power of 2 that low is aligned
+    // to and that fits below high. scratch holds 3 * N_C_PER_BLOCK, new_high may alias high
+    __aicore__ inline void align_bin(const LocalTensor<int16_t>& new_high, const LocalTensor<int16_t>& low, const LocalTensor<int16_t>& high, const LocalTensor<int16_t>& scratch);
+    // Adds the coded bits of the loaded batch under lens [channel, bin] to cost and its longest code to max_len, per
+    // channel. Leaves the loaded batch as is
+    __aicore__ inline void coded_cost(const LocalTensor<int16_t>& lens, int32_t n_batch_tokens, const LocalTensor<int16_t>& cost, const LocalTensor<int16_t>& max_len);
+    // Encodes the loaded batch into row layer_id * n_batches + batch_id of the output
+    __aicore__ inline void encode_symbols(int row_id, int channel_start_id, int32_t n_batch_tokens, const LocalTensor<uint16_t>& meta_info);
+
     // Input Queues
     TQue<TPosition::VECIN, 1> symInQ;
     GlobalTensor<uint8_t> g_syms;
@@ -57,6 +102,8 @@ private:
 
     TQue<TPosition::VECOUT, 1> lensOutQ;
     GlobalTensor<uint32_t> g_out_lens;
+    GlobalTensor<uint32_t> g_sub_offsets;
+    GlobalTensor<uint8_t> g_raw_bits;
 
     TQue<TPosition::VECOUT, 1> metaDataOutQ;
     TQue<TPosition::VECIN, 1> metaDataInQ;
@@ -70,10 +117,15 @@ private:
     int32_t n_channels;
     uint32_t n_bins;
     int32_t chunk_size;
+    int32_t n_sub_streams;
+    int32_t pred_group;
 
     half scale_factor;
 
     int32_t n_tokens_per_layer;
+    int32_t n_batches;
+    int32_t n_c_blocks; // The last block is a masked tail when n_channels % N_C_PER_BLOCK != 0
+    int32_t n_raw_bits;
 
     // Intermediate buffers
     TBuf<TPosition::VECCALC> calcBuf; // For transient (per `encode()`) tensors
@@ -92,16 +144,19 @@ private:
     LocalTensor<int32_t> swap_channel_token_i16_idxs; // N_TOKENS [0, 32, 64, ... ] x sizeof(i16)
     LocalTensor<int32_t> broadcast_i32_over_8_idxs; // 8 * N_C_PER_BLOCK [0, 0, 0, ... | 1, 1, 1  |  ] x sizeof(i32)
 
-    LocalTensor<int32_t> l_pows_2_arr; // N_C_PER_BLOCK * 8 (max enc length) [2^7, 2^6, ... 2^0| 2^7, 2^6, ... ]
-    LocalTensor<int16_t> l_pows_2_mask_arr; // N_C_PER_BLOCK * 2 * 8 (max enc length) [0b1..10, 0b1..10 | 0b1..100, 0b1..100, ... ]
-    LocalTensor<int16_t> l_pows_2_mask_arr_ii; // N_C_PER_BLOCK * 2 * 8 (max enc length) [0b1..10, 0b1..100, 0b1..1000, ... | 0b1..10, ... ]
-    LocalTensor<half> ones; // 256 (arbitrary) [1, 1, 1, ... ]
-    LocalTensor<half> zeroes; // 256 (arbitrary) [0, 0, 0, ... ]
-    LocalTensor<half> bin_floats; // N_B_MAX [0.0, 1.0, 2.0, ... ]
+    LocalTensor<int16_t> bin_exp_mask; // 128 [0xFC00, ... ]
+    LocalTensor<int16_t> bin_width_cap; // 128 [64, ... ]
+    LocalTensor<int32_t> pred_anchor_i16_idxs; // 128 [0, 1, ... 31 | 0, 1, ... ] x sizeof(i16), a token row over a repeat
+    LocalTensor<half> cost_lens_i16_offsets; // 128 [0, 32, 64, ... 992 | 0, 32, ... ] x sizeof(i16), lens row of each channel
+    LocalTensor<int32_t> hist_one_hot_tables; // N_HIST_WORDS x HIST_TABLE_STRIDE [1, 0, 0, 0, 16, 0, ... | 0, 1, 0, ... ]
+    LocalTensor<int32_t> hist_unpack_i16_idxs; // N_C_PER_BLOCK x N_B_MAX, packed counter of every (channel, bin) x sizeof(i16)
+    LocalTensor<uint16_t> hist_nibble_mask; // 128 [0x0F0F, ... ]
+    LocalTensor<uint16_t> hist_byte_mask; // 128 [0x00FF, ... ]
 
     LocalTensor<int32_t> p2s_32_arr; // 32 [2^0, 2^1, 2^2 ... ]
     LocalTensor<int32_t> duplicating_gather_i16_idxs; // 2 * N_C_PER_BLOCK [0, 0, 2, 2, 4, 4, ... ] - only care about every other elem
     LocalTensor<int32_t> reducing_gather_i16_idxs; // N_C_PER_BLOCK [2, 6, 10, ... ] - only care about every other elem
+    LocalTensor<int32_t> widen_u32_idxs; // 2 * N_C_PER_BLOCK [0, 0, 4, 4, 8, 8, ... ] - every u32 as both words of a u64
 
     // Class has no known need to support move or copy operations
     PacEncoder(const PacEncoder&) = delete;
@@ -115,34 +170,42 @@ __aicore__ inline PacEncoder::PacEncoder(
     GM_ADDR out_meta,
     GM_ADDR out_bytes,
     GM_ADDR out_lens,
+    GM_ADDR out_sub_offsets,
+    GM_ADDR out_raw_bits,
     TPipe& _pipe,
     int32_t n_tokens,
     int32_t n_layers,
     int32_t n_channels,
     uint32_t n_bins,
     int32_t chunk_size,
+    int32_t n_sub_streams,
+    int32_t pred_group,
     half scale_factor):
         pipe(_pipe),
-        n_tokens(n_tokens),
         n_layers(n_layers),
         n_channels(n_channels),
         n_bins(n_bins),
         chunk_size(chunk_size),
-        scale_factor(scale_factor) {
+        n_sub_streams(n_sub_streams),
+        pred_group(pred_group) {
 
     half deq_scale = 1.0;
     SetDeqScale(deq_scale);
 
-    n_tokens_per_layer = n_channels * n_tokens;
+    n_c_blocks = (n_channels + N_C_PER_BLOCK - 1) / N_C_PER_BLOCK;
 
-    g_syms.SetGlobalBuffer(reinterpret_cast<__gm__ uint8_t*>(in_syms), n_layers * n_tokens * n_channels);
-    gm_meta_data.SetGlobalBuffer(reinterpret_cast<__gm__ uint16_t*>(out_meta), n_layers * n_channels * n_bins);
-    g_out_bytes.SetGlobalBuffer(reinterpret_cast<__gm__ uint8_t*>(out_bytes), n_layers * n_channels * chunk_size);
-    g_out_lens.SetGlobalBuffer(reinterpret_cast<__gm__ uint32_t*>(out_lens), n_layers * n_channels);
+    // Bins past N_B_MAX are low bits carried raw, the tables only ever see the top bits
+    n_raw_bits = 0;
+    while ((N_B_MAX << n_raw_bits) < n_bins) {
+        ++n_raw_bits;
+    }
+    this->n_bins = n_bins >> n_raw_bits;
+
+    set_chunk(in_syms, out_meta, out_bytes, out_lens, out_sub_offsets, out_raw_bits, n_tokens, scale_factor);
 
     pipe.InitBuffer(symInQ, 1, N_T_PER_BATCH);
     pipe.InitBuffer(byteStreamOutQ, 1, N_T_PER_BATCH);
-    pipe.InitBuffer(lensOutQ, 1, N_C_PER_BLOCK * sizeof(int32_t));
+    pipe.InitBuffer(lensOutQ, 1, 3 * N_C_PER_BLOCK * sizeof(int32_t));
     pipe.InitBuffer(metaDataOutQ, 1, N_C_PER_BLOCK * N_B_MAX * sizeof(int16_t));
     pipe.InitBuffer(metaDataInQ, 1, N_C_PER_BLOCK * N_B_MAX * sizeof(int16_t));
 
@@ -212,79 +275,72 @@ __aicore__ inline PacEncoder::PacEncoder(
     CreateVecIndex(swap_channel_token_i16_idxs, 0, N_T_MAX);
     Muls(swap_channel_token_i16_idxs, swap_channel_token_i16_idxs, static_cast<int32_t>(N_C_PER_BLOCK * sizeof(half)), N_T_MAX);
 
-    // LocalTensor<int32_t> l_pows_2_arr; // N_C_PER_BLOCK * 8 (max enc length) [2^0, 2^1, ... 2^7 | 2^0, 2^1, ... ]
-    uint32_t l_pows_2_arr_count = 8 * N_C_PER_BLOCK;
-    uint32_t l_pows_2_arr_sz = ceil_32(l_pows_2_arr_count * sizeof(int32_t));
-    l_pows_2_arr = utilsCalcBuf.GetWithOffset<int32_t>(l_pows_2_arr_sz, utils_calc_buf_offset);
-    utils_calc_buf_offset += l_pows_2_arr_sz;
-    for (auto b_ii = 0; b_ii < 8; ++b_ii) {
-        int32_t p2 = (0x1 << b_ii) >> 1;
-        l_pows_2_arr.SetValue(b_ii, p2);
+    // Bin alignment masks, sign and exponent of a half (its value rounded down to a power of 2) and the widest bin
+    // the alignment passes hand out (a 2 bit code)
+    uint32_t bin_mask_count = 128;
+    uint32_t bin_mask_sz = ceil_32(bin_mask_count * sizeof(int16_t));
+    bin_exp_mask = utilsCalcBuf.GetWithOffset<int16_t>(bin_mask_count, utils_calc_buf_offset);
+    utils_calc_buf_offset += bin_mask_sz;
+    Duplicate(bin_exp_mask, static_cast<int16_t>(0xFC00), bin_mask_count);
+    bin_width_cap = utilsCalcBuf.GetWithOffset<int16_t>(bin_mask_count, utils_calc_buf_offset);
+    utils_calc_buf_offset += bin_mask_sz;
+    Duplicate(bin_width_cap, static_cast<int16_t>(64), bin_mask_count);
+
+    uint32_t pred_anchor_i16_idxs_count = 128;
+    uint32_t pred_anchor_i16_idxs_sz = ceil_32(pred_anchor_i16_idxs_count * sizeof(int32_t));
+    pred_anchor_i16_idxs = utilsCalcBuf.GetWithOffset<int32_t>(pred_anchor_i16_idxs_count, utils_calc_buf_offset);
+    utils_calc_buf_offset += pred_anchor_i16_idxs_sz;
+    CreateVecIndex(pred_anchor_i16_idxs, 0, pred_anchor_i16_idxs_count);
+    ShiftLeft(pred_anchor_i16_idxs.ReinterpretCast<uint32_t>(), pred_anchor_i16_idxs.ReinterpretCast<uint32_t>(), static_cast<uint32_t>(27), pred_anchor_i16_idxs_count);
+    ShiftRight(pred_anchor_i16_idxs.ReinterpretCast<uint32_t>(), pred_anchor_i16_idxs.ReinterpretCast<uint32_t>(), static_cast<uint32_t>(27), pred_anchor_i16_idxs_count);
+    Muls(pred_anchor_i16_idxs, pred_anchor_i16_idxs, static_cast<int32_t>(sizeof(half)), pred_anchor_i16_idxs_count);
+
+    // Token major, 128 elements are N_C_PER_BLOCK channels of 4 tokens
+    uint32_t cost_lens_i16_offsets_count = 128;
+    uint32_t cost_lens_i16_offsets_sz = ceil_32(cost_lens_i16_offsets_count * sizeof(half));
+    cost_lens_i16_offsets = utilsCalcBuf.GetWithOffset<half>(cost_lens_i16_offsets_count, utils_calc_buf_offset);
+    utils_calc_buf_offset += cost_lens_i16_offsets_sz;
+    for (int32_t i_ii = 0; i_ii < static_cast<int32_t>(cost_lens_i16_offsets_count); ++i_ii) {
+        cost_lens_i16_offsets.SetValue(i_ii, static_cast<half>((i_ii % N_C_PER_BLOCK) * N_B_MAX * static_cast<int32_t>(sizeof(int16_t))));
     }
-    Copy(l_pows_2_arr[1 * 8], l_pows_2_arr, 8, 1, {1, 1, 8, 8});
-    Copy(l_pows_2_arr[2 * 8], l_pows_2_arr, 16, 1, {1, 1, 8, 8});
-    Copy(l_pows_2_arr[4 * 8], l_pows_2_arr, 32, 1, {1, 1, 8, 8});
-    Copy(l_pows_2_arr[8 * 8], l_pows_2_arr, 32, 1, {1, 1, 8, 8});
-    Copy(l_pows_2_arr[12 * 8], l_pows_2_arr, 32, 1, {1, 1, 8, 8});
-    Copy(l_pows_2_arr[16 * 8], l_pows_2_arr, 32, 1, {1, 1, 8, 8});
-    Copy(l_pows_2_arr[20 * 8], l_pows_2_arr, 32, 1, {1, 1, 8, 8});
-    Copy(l_pows_2_arr[24 * 8], l_pows_2_arr, 32, 1, {1, 1, 8, 8});
-    Copy(l_pows_2_arr[28 * 8], l_pows_2_arr, 32, 1, {1, 1, 8, 8});
-
-    // LocalTensor<int16_t> l_pows_2_mask_arr; // N_C_PER_BLOCK * 2 * 8 (max enc length * 2 because of an i32/i16) [0b1..11, 0b1..11 | 0b1..110, 0b1..110, ... ]
-    uint32_t l_pows_2_mask_arr_count = 2 * 8 * N_C_PER_BLOCK;
-    uint32_t l_pows_2_mask_arr_sz = ceil_32(l_pows_2_mask_arr_count * sizeof(int16_t));
-    l_pows_2_mask_arr = utilsCalcBuf.GetWithOffset<int16_t>(l_pows_2_mask_arr_count, utils_calc_buf_offset);
-    utils_calc_buf_offset += l_pows_2_mask_arr_sz;
-    for (auto b_ii = 0; b_ii < 8; ++b_ii) {
-        int16_t mask = (0xFFFFFFFF >> b_ii) << b_ii;
-        // To Brcb to N_C_PER_BLOCK positions. Repeat the mask N_C_PER_BLOCK / 16 times given N_C_PER_BLOCK == 32 per
-        // module assertion
-        register_bins.ReinterpretCast<int16_t>().SetValue((4 * b_ii) + 0, mask);
-        register_bins.ReinterpretCast<int16_t>().SetValue((4 * b_ii) + 1, mask);
-        register_bins.ReinterpretCast<int16_t>().SetValue((4 * b_ii) + 2, mask);
-        register_bins.ReinterpretCast<int16_t>().SetValue((4 * b_ii) + 3, mask);
+
+    // Symbol s is counter s / 4 of word s % 4, bins past n_bins and the dummy entry count nothing
+    uint32_t hist_one_hot_tables_count = N_HIST_WORDS * HIST_TABLE_STRIDE;
+    uint32_t hist_one_hot_tables_sz = ceil_32(hist_one_hot_tables_count * sizeof(int32_t));
+    hist_one_hot_tables = utilsCalcBuf.GetWithOffset<int32_t>(hist_one_hot_tables_count, utils_calc_buf_offset);
+    utils_calc_buf_offset += hist_one_hot_tables_sz;
+    for (int32_t w_ii = 0; w_ii < N_HIST_WORDS; ++w_ii) {
+        for (int32_t s_ii = 0; s_ii < HIST_TABLE_STRIDE; ++s_ii) {
+            bool hit = s_ii < static_cast<int32_t>(this->n_bins) && s_ii % N_HIST_WORDS == w_ii;
+            hist_one_hot_tables.SetValue(w_ii * HIST_TABLE_STRIDE + s_ii, hit ? 1 << (4 * (s_ii / N_HIST_WORDS)) : 0);
+        }
     }
-    Brcb(l_pows_2_mask_arr, register_bins.ReinterpretCast<int16_t>(), 8, {1, 8});
-
-    // LocalTensor<int16_t> l_pows_2_mask_arr_ii; // N_C_PER_BLOCK * 2 * 8 (max enc length) [0b1..10, 0b1..100, 0b1..1000, ... | 0b1..10, ... ]
-    uint32_t l_pows_2_mask_arr_ii_count = 2 * 8 * N_C_PER_BLOCK;
-    uint32_t l_pows_2_mask_arr_ii_sz = ceil_32(l_pows_2_mask_arr_ii_count * sizeof(int16_t));
-    l_pows_2_mask_arr_ii = utilsCalcBuf.GetWithOffset<int16_t>(l_pows_2_mask_arr_ii_count, utils_calc_buf_offset);
-    utils_calc_buf_offset += l_pows_2_mask_arr_ii_sz;
-    // Set the first 32 B, then copy into the rest. Target is 0b111111111, 0b111111110, 0b111111100 ...
-    int16_t base_m = 0xffff;
-    for (auto b_ii = 0; b_ii < 8; ++b_ii) {
-        l_pows_2_mask_arr_ii.ReinterpretCast<int32_t>().SetValue(b_ii + 0 * 8, (base_m >> b_ii) << b_ii);
-        l_pows_2_mask_arr_ii.ReinterpretCast<int32_t>().SetValue(b_ii + 1 * 8, (base_m >> b_ii) << b_ii);
+
+    // Follows the counters through the widening of meta_data_build(): 4 bit counter j of word w becomes byte j / 2 of
+    // word 2w + j % 2, byte k of word v becomes the 16 bit counter k / 2 of word 2v + k % 2
+    uint32_t hist_unpack_i16_idxs_count = N_C_PER_BLOCK * N_B_MAX;
+    uint32_t hist_unpack_i16_idxs_sz = ceil_32(hist_unpack_i16_idxs_count * sizeof(int32_t));
+    hist_unpack_i16_idxs = utilsCalcBuf.GetWithOffset<int32_t>(hist_unpack_i16_idxs_count, utils_calc_buf_offset);
+    utils_calc_buf_offset += hist_unpack_i16_idxs_sz;
+    for (int32_t b_ii = 0; b_ii < N_B_MAX; ++b_ii) {
+        int32_t nibble = b_ii / N_HIST_WORDS;
+        int32_t byte_word = 2 * (b_ii % N_HIST_WORDS) + nibble % 2;
+        int32_t byte = nibble / 2;
+        int32_t word = 2 * byte_word + byte % 2;
+        for (int32_t c_ii = 0; c_ii < N_C_PER_BLOCK; ++c_ii) {
+            int32_t i16_idx = 2 * (word * N_C_PER_BLOCK + c_ii) + byte / 2;
+            hist_unpack_i16_idxs.SetValue(c_ii * N_B_MAX + b_ii, i16_idx * static_cast<int32_t>(sizeof(int16_t)));
+        }
     }
 
-    Copy(l_pows_2_mask_arr_ii.ReinterpretCast<int32_t>()[2 * 8], l_pows_2_mask_arr_ii.ReinterpretCast<int32_t>(), 16, 1, {1, 1, 8, 8});
-    Copy(l_pows_2_mask_arr_ii.ReinterpretCast<int32_t>()[4 * 8], l_pows_2_mask_arr_ii.ReinterpretCast<int32_t>(), 32, 1, {1, 1, 8, 8});
-    Copy(l_pows_2_mask_arr_ii.ReinterpretCast<int32_t>()[8 * 8], l_pows_2_mask_arr_ii.ReinterpretCast<int32_t>(), 64, 1, {1, 1, 8, 8});
-    Copy(l_pows_2_mask_arr_ii.ReinterpretCast<int32_t>()[8 * 8], l_pows_2_mask_arr_ii.ReinterpretCast<int32_t>(), 64, 1, {1, 1, 8, 8});
-    Copy(l_pows_2_mask_arr_ii.ReinterpretCast<int32_t>()[16 * 8], l_pows_2_mask_arr_ii.ReinterpretCast<int32_t>(), 64, 1, {1, 1, 8, 8});
-    Copy(l_pows_2_mask_arr_ii.ReinterpretCast<int32_t>()[24 * 8], l_pows_2_mask_arr_ii.ReinterpretCast<int32_t>(), 64, 1, {1, 1, 8, 8});
-
-    uint32_t zeroes_count = 256;
-    uint32_t zeroes_sz = ceil_32(zeroes_count * sizeof(half));
-    zeroes = utilsCalcBuf.GetWithOffset<half>(zeroes_count, utils_calc_buf_offset);
-    utils_calc_buf_offset += zeroes_sz;
-    half zero = 0.0;
-    Duplicate(zeroes, zero, zeroes_count);
-
-    uint32_t ones_count = 256;
-    uint32_t ones_sz = ceil_32(ones_count * sizeof(half));
-    ones = utilsCalcBuf.GetWithOffset<half>(ones_count, utils_calc_buf_offset);
-    utils_calc_buf_offset += ones_sz;
-    half one = 1.0;
-    Duplicate(ones, one, ones_count);
-
-    uint32_t bin_floats_count = N_B_MAX;
-    uint32_t bin_floats_sz = ceil_32(bin_floats_count * sizeof(half));
-    bin_floats = utilsCalcBuf.GetWithOffset<half>(bin_floats_count, utils_calc_buf_offset);
-    utils_calc_buf_offset += bin_floats_sz;
-    Cast(bin_floats, indexes_0_31_x_32, RoundMode::CAST_NONE, N_B_MAX);
+    uint32_t hist_mask_count = 128;
+    uint32_t hist_mask_sz = ceil_32(hist_mask_count * sizeof(uint16_t));
+    hist_nibble_mask = utilsCalcBuf.GetWithOffset<uint16_t>(hist_mask_count, utils_calc_buf_offset);
+    utils_calc_buf_offset += hist_mask_sz;
+    Duplicate(hist_nibble_mask, static_cast<uint16_t>(0x0F0F), hist_mask_count);
+    hist_byte_mask = utilsCalcBuf.GetWithOffset<uint16_t>(hist_mask_count, utils_calc_buf_offset);
+    utils_calc_buf_offset += hist_mask_sz;
+    Duplicate(hist_byte_mask, static_cast<uint16_t>(0x00FF), hist_mask_count);
 
     uint32_t broadcast_i32_over_8_idxs_count = 8 * N_C_PER_BLOCK;
     uint32_t broadcast_i32_over_8_idxs_sz = ceil_32(broadcast_i32_over_8_idxs_count * sizeof(int32_t));
@@ -317,36 +373,177 @@ __aicore__ inline PacEncoder::PacEncoder(
     CreateVecIndex(reducing_gather_i16_idxs, 0, N_C_PER_BLOCK); // 0, 1, 2, 3 ...
     Muls(reducing_gather_i16_idxs, reducing_gather_i16_idxs, static_cast<int32_t>(2 * sizeof(uint16_t)), N_C_PER_BLOCK);
     Adds(reducing_gather_i16_idxs, reducing_gather_i16_idxs, static_cast<int32_t>(sizeof(uint16_t)), N_C_PER_BLOCK);
+    utils_calc_buf_offset += reducing_gather_i16_idxs_sz;
+
+    uint32_t widen_u32_idxs_count = 2 * N_C_PER_BLOCK;
+    uint32_t widen_u32_idxs_sz = ceil_32(widen_u32_idxs_count * sizeof(int32_t));
+    widen_u32_idxs = utilsCalcBuf.GetWithOffset<int32_t>(widen_u32_idxs_count, utils_calc_buf_offset);
+    utils_calc_buf_offset += widen_u32_idxs_sz;
+    Muls(widen_u32_idxs, duplicating_gather_i16_idxs, static_cast<int32_t>(sizeof(uint32_t) / sizeof(uint16_t)), 2 * N_C_PER_BLOCK);
 }
 
-__aicore__ inline void PacEncoder::meta_data_calc(int layer_id, int channel_start_id) {
-    uint32_t n_T_chunks = n_tokens / N_T_MAX;
-    n_T_chunks = n_tokens % N_T_MAX == 0 ? n_T_chunks : n_T_chunks + 1;
+__aicore__ inline void PacEncoder::set_chunk(
+    GM_ADDR in_syms,
+    GM_ADDR out_meta,
+    GM_ADDR out_bytes,
+    GM_ADDR out_lens,
+    GM_ADDR out_sub_offsets,
+    GM_ADDR out_raw_bits,
+    int32_t n_tokens,
+    half scale_factor) {
+    this->n_tokens = n_tokens;
+    this->scale_factor = scale_factor;
+    n_tokens_per_layer = n_channels * n_tokens;
+    n_batches = (n_tokens + N_T_MAX - 1) / N_T_MAX;
+
+    g_syms.SetGlobalBuffer(reinterpret_cast<__gm__ uint8_t*>(in_syms), n_layers * n_tokens * n_channels);
+    gm_meta_data.SetGlobalBuffer(reinterpret_cast<__gm__ uint16_t*>(out_meta), n_layers * n_channels * N_B_MAX);
+    g_out_bytes.SetGlobalBuffer(reinterpret_cast<__gm__ uint8_t*>(out_bytes), static_cast<uint64_t>(n_layers) * n_channels * chunk_size);
+    g_out_lens.SetGlobalBuffer(reinterpret_cast<__gm__ uint32_t*>(out_lens), 2 * n_layers * n_batches * n_channels);
+    g_sub_offsets.SetGlobalBuffer(reinterpret_cast<__gm__ uint32_t*>(out_sub_offsets), n_layers * n_batches * n_sub_streams * n_channels);
+    g_raw_bits.SetGlobalBuffer(reinterpret_cast<__gm__ uint8_t*>(out_raw_bits),
+        n_layers * n_batches * n_c_blocks * n_raw_bits * N_RAW_PLANE_BYTES);
+}
+
+__aicore__ inline int32_t PacEncoder::load_batch(int layer_id, int batch_id, int channel_start_id, bool emit_raw_bits) {
+    int32_t n_batch_tokens = N_T_MAX * (batch_id + 1) > n_tokens ? n_tokens - (N_T_MAX * batch_id) : N_T_MAX;
+
+    LocalTensor<uint8_t> l_syms = symInQ.AllocTensor<uint8_t>();
+    auto sym_offset =
+        n_tokens_per_layer * layer_id +
+        n_channels * N_T_MAX * batch_id +
+        channel_start_id;
+
+    // Token rows of the block are n_channels apart, padding channels of a tail block read as symbol 0
+    int32_t n_valid = block_channels(n_channels, channel_start_id);
+    DataCopyExtParams copy_params = {static_cast<uint16_t>(n_batch_tokens), static_cast<uint32_t>(n_valid),
+        static_cast<uint32_t>(n_channels - n_valid), 0, 0};
+    DataCopyPadExtParams<uint8_t> pad_params = {true, 0, static_cast<uint8_t>(N_C_PER_BLOCK - n_valid), 0};
+    DataCopyPad(l_syms, g_syms[sym_offset], copy_params, pad_params);
+
+    symInQ.EnQue(l_syms);
+    l_syms = symInQ.DeQue<uint8_t>();
+
+    LocalTensor<half> cast_input = calcBuf.GetWithOffset<half>(N_T_MAX * N_C_PER_BLOCK, 0);
+    Cast(cast_input, l_syms, RoundMode::CAST_NONE, n_batch_tokens * N_C_PER_BLOCK);
+    symInQ.FreeTensor(l_syms);
+
+    if (pred_group != PRED_NONE) {
+        predict_batch();
+    }
+
+    // Defensive, ensure any dummy tokens are intialized to invalid token values
+    half inval = 999.;
+    Duplicate(cast_input[n_batch_tokens * N_C_PER_BLOCK], inval, (N_T_MAX - n_batch_tokens) * N_C_PER_BLOCK);
+
+    if (n_raw_bits > 0) {
+        split_raw_bits(layer_id * n_batches + batch_id, channel_start_id, emit_raw_bits);
+    }
+
+    return n_batch_tokens;
+}
+
+// Splits the loaded symbols into top = floor(sym / 2^n_raw_bits), which replaces them, and the low bits.
+// Low bit k of every symbol becomes one compare mask, the plane is the mask as is: bit i is symbol i of the
+// token major batch. Dummy tokens stay above the coded bins and their planes are never read back.
+__aicore__ inline void PacEncoder::split_raw_bits(int row_id, int channel_start_id, bool emit_raw_bits) {
+    uint32_t calc_buf_offset = 0;
+    uint32_t batch_half_sz = ceil_32(N_T_PER_BATCH * sizeof(half));
+    LocalTensor<half> cast_input = calcBuf.GetWithOffset<half>(N_T_PER_BATCH, calc_buf_offset);
+    calc_buf_offset += batch_half_sz;
+    // The histogram scratch of meta_data_build(), unused by encode_symbols()
+    LocalTensor<half> top = calcBuf.GetWithOffset<half>(N_T_PER_BATCH, calc_buf_offset);
+    calc_buf_offset += batch_half_sz;
+    LocalTensor<uint8_t> plane = calcBuf.GetWithOffset<uint8_t>(N_RAW_PLANE_BYTES, calc_buf_offset);
+    calc_buf_offset += ceil_32(N_RAW_PLANE_BYTES);
+    LocalTensor<half> low_tmp = calcBuf.GetWithOffset<half>(N_T_PER_BATCH, calc_buf_offset);
+
+    half raw_scale = static_cast<half>(1 << n_raw_bits);
+    half raw_scale_inv = static_cast<half>(1.0f / (1 << n_raw_bits));
+    Muls(top, cast_input, raw_scale_inv, N_T_PER_BATCH);
+    Cast(top.ReinterpretCast<int16_t>(), top, RoundMode::CAST_FLOOR, N_T_PER_BATCH);
+    Cast(top, top.ReinterpretCast<int16_t>(), RoundMode::CAST_NONE, N_T_PER_BATCH);
+
+    if (emit_raw_bits) {
+        // cast_input becomes the low bits, planes peeled off from the most significant one down
+        Muls(low_tmp, top, raw_scale, N_T_PER_BATCH);
+        Sub(cast_input, cast_input, low_tmp, N_T_PER_BATCH);
+
+        uint32_t plane_offset = (row_id * n_c_blocks + channel_start_id / N_C_PER_BLOCK) * n_raw_bits * N_RAW_PLANE_BYTES;
+        for (int32_t k_ii = n_raw_bits - 1; k_ii >= 0; --k_ii) {
+            half bit_val = static_cast<half>(1 << k_ii);
+            CompareScalar(plane, cast_input, bit_val, CMPMODE::GE, N_T_PER_BATCH);
+            Adds(low_tmp, cast_input, static_cast<half>(-(1 << k_ii)), N_T_PER_BATCH);
+            Select(cast_input, plane, low_tmp, cast_input, SELMODE::VSEL_TENSOR_TENSOR_MODE, N_T_PER_BATCH);
+
+            PipeBarrier<PIPE_ALL>();
+            DataCopy(g_raw_bits[plane_offset + k_ii * N_RAW_PLANE_BYTES], plane, N_RAW_PLANE_BYTES);
+            PipeBarrier<PIPE_ALL>();
+        }
+    }
+
+    Adds(cast_input, top, static_cast<half>(0), N_T_PER_BATCH);
+}
+
+// Replaces the loaded symbols by their residuals against a prediction from an earlier token of the channel, taken
+// modulo the symbol range so they stay symbols of it. The first token of a batch (of a group) is its own prediction
+// and stays as is, batches stay independently decodable. Runs on the whole batch, rows past its tokens are reset
+// by load_batch() afterwards.
+__aicore__ inline void PacEncoder::predict_batch() {
+    uint32_t calc_buf_offset = 0;
+    uint32_t batch_half_sz = ceil_32(N_T_PER_BATCH * sizeof(half));
+    LocalTensor<half> cast_input = calcBuf.GetWithOffset<half>(N_T_PER_BATCH, calc_buf_offset);
+    calc_buf_offset += batch_half_sz;
+    // The histogram scratch of meta_data_build(), as for split_raw_bits()
+    LocalTensor<half> pred = calcBuf.GetWithOffset<half>(N_T_PER_BATCH, calc_buf_offset);
+    calc_buf_offset += batch_half_sz;
+    LocalTensor<half> anchor_row = calcBuf.GetWithOffset<half>(128, calc_buf_offset);
+    calc_buf_offset += ceil_32(128 * sizeof(half));
+    LocalTensor<uint8_t> wrap = calcBuf.GetWithOffset<uint8_t>(N_T_PER_BATCH / 8, calc_buf_offset);
+
+    if (pred_group == PRED_PREV) {
+        Adds(pred, cast_input, static_cast<half>(0), N_T_PER_BATCH);
+        Sub(cast_input[N_C_PER_BLOCK], cast_input[N_C_PER_BLOCK], pred, N_T_PER_BATCH - N_C_PER_BLOCK);
+    } else {
+        // The group's first row repeated over a 128 element row broadcasts down the group, its own row is added back
+        BinaryRepeatParams row_repeat_params = BinaryRepeatParams(1, 1, 1, 8, 8, 0);
+        uint8_t group_repeats = static_cast<uint8_t>(pred_group * N_C_PER_BLOCK / 128);
+        for (int32_t g_ii = 0; g_ii < N_T_MAX / pred_group; ++g_ii) {
+            auto group = cast_input[g_ii * pred_group * N_C_PER_BLOCK];
+            uint32_t anchor_offset = g_ii * pred_group * N_C_PER_BLOCK * sizeof(half);
+            Gather(anchor_row, cast_input, pred_anchor_i16_idxs.ReinterpretCast<uint32_t>(), anchor_offset, 128);
+            Sub(group, group, anchor_row, 128, group_repeats, row_repeat_params);
+            Add(group, group, anchor_row, N_C_PER_BLOCK);
+        }
+    }
+
+    // Residuals in (-n_syms, n_syms) wrap to [0, n_syms)
+    int32_t n_syms = static_cast<int32_t>(n_bins << n_raw_bits);
+    Adds(cast_input, cast_input, static_cast<half>(n_syms), N_T_PER_BATCH);
+    CompareScalar(wrap, cast_input, static_cast<half>(n_syms), CMPMODE::GE, N_T_PER_BATCH);
+    Adds(pred, cast_input, static_cast<half>(-n_syms), N_T_PER_BATCH);
+    Select(cast_input, wrap, pred, cast_input, SELMODE::VSEL_TENSOR_TENSOR_MODE, N_T_PER_BATCH);
+}
 
+__aicore__ inline void PacEncoder::meta_data_build(int layer_id, int channel_start_id, const LocalTensor<int16_t>& meta_out, bool emit_raw_bits) {
     uint32_t calc_buf_offset = 0;
     uint32_t cast_input_count = N_T_MAX * N_C_PER_BLOCK;
     uint32_t cast_input_sz = ceil_32(cast_input_count * sizeof(half));
     LocalTensor<half> cast_input = calcBuf.GetWithOffset<half>(cast_input_count, calc_buf_offset);
     calc_buf_offset += cast_input_sz;
 
-    uint32_t swapped_input_count = N_T_MAX * N_C_PER_BLOCK;
-    uint32_t swapped_input_sz = ceil_32(swapped_input_count * sizeof(half));
-    LocalTensor<half> swapped_input = calcBuf.GetWithOffset<half>(swapped_input_count, calc_buf_offset);
-    calc_buf_offset += swapped_input_sz;
-
-    uint32_t bin_cmp_mask_sz = ceil_32(N_T_PER_BATCH / (8 * sizeof(int8_t)));
-    LocalTensor<uint8_t> bin_cmp_mask = calcBuf.GetWithOffset<uint8_t>(bin_cmp_mask_sz, calc_buf_offset);
-    calc_buf_offset += bin_cmp_mask_sz;
-
-    uint32_t bin_cmp_as_elem_count = N_T_PER_BATCH;
-    uint32_t bin_cmp_as_elem_sz = ceil_32(bin_cmp_as_elem_count  * sizeof(half));
-    LocalTensor<half> bin_cmp_as_elem = calcBuf.GetWithOffset<half>(bin_cmp_as_elem_count, calc_buf_offset);
-    calc_buf_offset += bin_cmp_as_elem_sz;
-
-    uint32_t count_count = N_B_MAX * N_C_PER_BLOCK;
-    uint32_t count_sz = ceil_32(count_count * sizeof(half));
-    LocalTensor<half> count = calcBuf.GetWithOffset<half>(count_count, calc_buf_offset);
-    calc_buf_offset += count_sz;
+    // Histogram scratch, a slice of N_HIST_ROWS tokens: the clamped symbols, their table offsets, a looked up one-hot
+    // word and the N_HIST_WORDS accumulated words
+    uint32_t hist_slice_count = N_HIST_ROWS * N_C_PER_BLOCK;
+    uint32_t hist_slice_i32_sz = ceil_32(hist_slice_count * sizeof(int32_t));
+    LocalTensor<half> hist_syms = calcBuf.GetWithOffset<half>(hist_slice_count, calc_buf_offset);
+    calc_buf_offset += ceil_32(hist_slice_count * sizeof(half));
+    LocalTensor<int32_t> hist_idxs = calcBuf.GetWithOffset<int32_t>(hist_slice_count, calc_buf_offset);
+    calc_buf_offset += hist_slice_i32_sz;
+    LocalTensor<int32_t> hist_one_hot = calcBuf.GetWithOffset<int32_t>(hist_slice_count, calc_buf_offset);
+    calc_buf_offset += hist_slice_i32_sz;
+    LocalTensor<int32_t> hist_acc = calcBuf.GetWithOffset<int32_t>(N_HIST_WORDS * hist_slice_count, calc_buf_offset);
+    calc_buf_offset += N_HIST_WORDS * hist_slice_i32_sz;
 
     uint32_t swapped_count_count = N_B_MAX * N_C_PER_BLOCK;
     uint32_t swapped_count_sz = ceil_32(swapped_count_count * sizeof(half));
@@ -357,57 +554,73 @@ __aicore__ inline void PacEncoder::meta_data_calc(int layer_id, int channel_star
     half zero = 0.;
     Duplicate(swapped_count, zero, N_B_MAX * N_C_PER_BLOCK);
 
-    uint32_t intermediate_count_count = 2 * N_C_PER_BLOCK;
-    uint32_t intermediate_count_sz = ceil_32(intermediate_count_count * sizeof(half));
-    LocalTensor<half> intermediate_count = calcBuf.GetWithOffset<half>(intermediate_count_count, calc_buf_offset);
-    calc_buf_offset += intermediate_count_sz;
+    // Masks are re-read for every repeat of 128 uint16
+    BinaryRepeatParams mask_repeat_params = BinaryRepeatParams(
+        1, // dstBlkStrideIn
+        1, // src0BlkStrideIn
+        1, // src1BlkStrideIn
+        8, // dstRepStrideIn
+        8, // src0RepStrideIn
+        0 // src1RepStrideIn
+    );
+    uint32_t half_slice_count = hist_slice_count / 2;
 
     // Tally all tokens in layer and chunk of channels startign from channel start index
-    for (uint32_t T_chunk_idx = 0; T_chunk_idx < n_T_chunks; ++T_chunk_idx) {
-
-        int32_t n_tokens_in_chunk = N_T_MAX * (T_chunk_idx + 1) > n_tokens ? n_tokens - (N_T_MAX * T_chunk_idx) : N_T_MAX;
-
-        LocalTensor<uint8_t> l_syms = symInQ.AllocTensor<uint8_t>();
-        auto sym_offset =
-            n_tokens_per_layer * layer_id +
-            n_channels * N_T_MAX * T_chunk_idx +
-            channel_start_id;
-
-        uint16_t src_stride = N_DBs_PER_BLOCK * ((n_channels / N_C_PER_BLOCK) - 1);
-        DataCopyParams repeatParams = {static_cast<uint16_t>(n_tokens_in_chunk), N_DBs_PER_BLOCK, src_stride, 0};
-        DataCopy(l_syms, g_syms[sym_offset], repeatParams);
-
-        symInQ.EnQue(l_syms);
-        l_syms = symInQ.DeQue<uint8_t>();
-
-        Cast(cast_input, l_syms, RoundMode::CAST_NONE, n_tokens_in_chunk * N_C_PER_BLOCK);
-        symInQ.FreeTensor(l_syms);
+    for (int32_t T_chunk_idx = 0; T_chunk_idx < n_batches; ++T_chunk_idx) {
+        load_batch(layer_id, T_chunk_idx, channel_start_id, emit_raw_bits && T_chunk_idx == n_batches - 1);
+
+        // One pass over the token major batch, every slice adds its one-hots to the 4 bit counters (<= 4 per slice
+        // position). Dummy tokens clamp to the all-zero table entry.
+        for (int32_t s_ii = 0; s_ii < N_T_MAX / N_HIST_ROWS; ++s_ii) {
+            Mins(hist_syms, cast_input[s_ii * hist_slice_count], static_cast<half>(N_B_MAX), hist_slice_count);
+            Cast(hist_idxs, hist_syms, RoundMode::CAST_RINT, hist_slice_count);
+            Muls(hist_idxs, hist_idxs, static_cast<int32_t>(sizeof(int32_t)), hist_slice_count);
+            for (int32_t w_ii = 0; w_ii < N_HIST_WORDS; ++w_ii) {
+                auto acc_w = hist_acc[w_ii * hist_slice_count];
+                uint32_t table_offset = w_ii * HIST_TABLE_STRIDE * sizeof(int32_t);
+                if (s_ii == 0) {
+                    Gather(acc_w, hist_one_hot_tables, hist_idxs.ReinterpretCast<uint32_t>(), table_offset, hist_slice_count);
+                } else {
+                    Gather(hist_one_hot, hist_one_hot_tables, hist_idxs.ReinterpretCast<uint32_t>(), table_offset, hist_slice_count);
+                    Add(acc_w, acc_w, hist_one_hot, hist_slice_count);
+                }
+            }
+        }
 
-        // Defensive, ensure any dummy tokens are intialized to invalid token values
-        half inval = 999.;
-        Duplicate(cast_input[n_tokens_in_chunk * N_C_PER_BLOCK], inval, (N_T_MAX - n_tokens_in_chunk) * N_C_PER_BLOCK);
+        // Widen to 8 bit counters while folding the slice in two: even counters stay, odd ones shift down. Word w
+        // becomes words 2w, 2w + 1 of N_HIST_ROWS / 2 positions, in place.
+        auto lo = hist_idxs.ReinterpretCast<uint16_t>();
+        auto hi = hist_one_hot.ReinterpretCast<uint16_t>();
+        uint8_t slice_mask_repeats = static_cast<uint8_t>(2 * hist_slice_count / 128);
+        for (int32_t w_ii = 0; w_ii < N_HIST_WORDS; ++w_ii) {
+            auto acc_w = hist_acc[w_ii * hist_slice_count];
+            And(lo, acc_w.ReinterpretCast<uint16_t>(), hist_nibble_mask, 128, slice_mask_repeats, mask_repeat_params);
+            ShiftRight(hi, acc_w.ReinterpretCast<uint16_t>(), static_cast<uint16_t>(4), 2 * hist_slice_count);
+            And(hi, hi, hist_nibble_mask, 128, slice_mask_repeats, mask_repeat_params);
+            Add(acc_w, lo.ReinterpretCast<int32_t>(), lo.ReinterpretCast<int32_t>()[half_slice_count], half_slice_count);
+            Add(acc_w[half_slice_count], hi.ReinterpretCast<int32_t>(), hi.ReinterpretCast<int32_t>()[half_slice_count], half_slice_count);
+        }
 
-        for (int32_t c_ii = 0; c_ii < N_C_PER_BLOCK; ++c_ii) {
-            Gather(swapped_input[N_T_MAX * c_ii], cast_input, swap_channel_token_i16_idxs.ReinterpretCast<uint32_t>(), sizeof(half) * c_ii, N_T_MAX);
+        // Fold down to 2 positions, the 8 bit counters reach at most N_T_MAX / 2
+        for (int32_t n_rows = N_HIST_ROWS / 4; n_rows >= 2; n_rows /= 2) {
+            for (int32_t w_ii = 0; w_ii < 2 * N_HIST_WORDS; ++w_ii) {
+                auto acc_w = hist_acc[w_ii * half_slice_count];
+                Add(acc_w, acc_w, acc_w[n_rows * N_C_PER_BLOCK], n_rows * N_C_PER_BLOCK);
+            }
         }
 
-        for (int b_ii = 0; b_ii < n_bins; ++b_ii) {
-            CompareScalar(bin_cmp_mask, swapped_input, bin_floats(b_ii), CMPMODE::EQ, N_T_PER_BATCH);
-
-            BinaryRepeatParams select_repeat_params = BinaryRepeatParams(
-                1, // dstBlkStrideIn
-                1, // src0BlkStrideIn /
-                1, // src1BlkStrideIn
-                8, // dstRepStrideIn
-                0, // src0RepStrideIn
-                0 // src1RepStrideIn
-            );
-
-            Select(bin_cmp_as_elem, bin_cmp_mask, ones, zeroes, SELMODE::VSEL_TENSOR_TENSOR_MODE, 128, N_T_PER_BATCH / 128, select_repeat_params);
-            RepeatReduceSum(intermediate_count, bin_cmp_as_elem, N_T_PER_BATCH / 128, 128, 0, 1, 1, 8);
-            PairReduceSum(count[b_ii * N_B_MAX], intermediate_count, 1, 64, 1, 1, 8);
+        // Widen to 16 bit counters with the last fold, [4 * N_HIST_WORDS words, N_C_PER_BLOCK] into hist_idxs
+        LocalTensor<int32_t> hist_counts = hist_idxs;
+        for (int32_t w_ii = 0; w_ii < 2 * N_HIST_WORDS; ++w_ii) {
+            auto acc_w = hist_acc[w_ii * half_slice_count];
+            And(hi, acc_w.ReinterpretCast<uint16_t>(), hist_byte_mask, 128, 1, mask_repeat_params);
+            ShiftRight(hi[128], acc_w.ReinterpretCast<uint16_t>(), static_cast<uint16_t>(8), 128);
+            Add(hist_counts[2 * w_ii * N_C_PER_BLOCK], hist_one_hot, hist_one_hot[N_C_PER_BLOCK], N_C_PER_BLOCK);
+            Add(hist_counts[(2 * w_ii + 1) * N_C_PER_BLOCK], hist_one_hot[2 * N_C_PER_BLOCK], hist_one_hot[3 * N_C_PER_BLOCK], N_C_PER_BLOCK);
         }
-        Gather(swapped_count_tmp, count, swap_channel_bin_i16_idxs.ReinterpretCast<uint32_t>(), 0, N_B_MAX * N_C_PER_BLOCK);
+
+        Gather(swapped_count_tmp.ReinterpretCast<int16_t>(), hist_counts.ReinterpretCast<int16_t>(), hist_unpack_i16_idxs.ReinterpretCast<uint32_t>(), 0, N_B_MAX * N_C_PER_BLOCK);
+        Cast(swapped_count_tmp, swapped_count_tmp.ReinterpretCast<int16_t>(), RoundMode::CAST_NONE, N_B_MAX * N_C_PER_BLOCK);
         Add(swapped_count, swapped_count, swapped_count_tmp, N_B_MAX * N_C_PER_BLOCK);
     }
     Muls(swapped_count, swapped_count, scale_factor, N_B_MAX * N_C_PER_BLOCK);
@@ -484,93 +697,20 @@ __aicore__ inline void PacEncoder::meta_data_calc(int layer_id, int channel_star
     LocalTensor<int16_t> low_o_ii = calcBuf.GetWithOffset<int16_t>(N_C_PER_BLOCK * N_B_MAX, calc_buf_offset);
     calc_buf_offset += low_o_sz;
 
-    uint32_t low_sz = ceil_32(N_C_PER_BLOCK  * sizeof(int16_t));
-    LocalTensor<int16_t> low = calcBuf.GetWithOffset<int16_t>(N_C_PER_BLOCK , calc_buf_offset);
-    calc_buf_offset += low_sz;
+    uint32_t first_low_sz = ceil_32(N_C_PER_BLOCK * sizeof(int16_t));
+    LocalTensor<int16_t> first_low = calcBuf.GetWithOffset<int16_t>(N_C_PER_BLOCK, calc_buf_offset);
+    calc_buf_offset += first_low_sz;
 
-    uint32_t high_sz = ceil_32(N_C_PER_BLOCK * sizeof(int16_t));
-    LocalTensor<int16_t> high = calcBuf.GetWithOffset<int16_t>(N_C_PER_BLOCK, calc_buf_offset);
-    calc_buf_offset += high_sz;
-
-    uint32_t low_bcast_sz = ceil_32(8 * N_C_PER_BLOCK * sizeof(int32_t));
-    LocalTensor<int32_t> low_bcast = calcBuf.GetWithOffset<int32_t>(8 * N_C_PER_BLOCK , calc_buf_offset);
-    calc_buf_offset += low_bcast_sz;
-
-    uint32_t high_bcast_sz = ceil_32(8 * N_C_PER_BLOCK * sizeof(int16_t));
-    LocalTensor<int16_t> high_bcast = calcBuf.GetWithOffset<int16_t>(8 * N_C_PER_BLOCK , calc_buf_offset);
-    calc_buf_offset += high_bcast_sz;
-
-    uint32_t c_block_sz = ceil_32(N_C_PER_BLOCK * sizeof(int16_t));
-    LocalTensor<int8_t> alignment_mask = calcBuf.GetWithOffset<int8_t>(N_C_PER_BLOCK , calc_buf_offset);
-    calc_buf_offset += c_block_sz;
-    LocalTensor<int16_t> alignment_mask_i16 = calcBuf.GetWithOffset<int16_t>(N_C_PER_BLOCK , calc_buf_offset);
-    calc_buf_offset += c_block_sz;
-    LocalTensor<int8_t> exceeds_high_mask = calcBuf.GetWithOffset<int8_t>(N_C_PER_BLOCK , calc_buf_offset);
-    calc_buf_offset += c_block_sz;
-    LocalTensor<int16_t> exceeds_high_mask_i16 = calcBuf.GetWithOffset<int16_t>(N_C_PER_BLOCK , calc_buf_offset);
-    calc_buf_offset += c_block_sz;
+    uint32_t align_scratch_sz = ceil_32(3 * N_C_PER_BLOCK * sizeof(int16_t));
+    LocalTensor<int16_t> align_scratch = calcBuf.GetWithOffset<int16_t>(3 * N_C_PER_BLOCK, calc_buf_offset);
+    calc_buf_offset += align_scratch_sz;
 
     Gather(low_o, swapped_count_i16, swap_channel_bin_i16_idxs.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK * N_C_PER_BLOCK);
 
+    // Bins are rows of low_o. Every boundary depends on the one aligned before it, so the passes step a bin at a time
+    // over all channels
     for (auto bin_ii = 0; bin_ii < (N_B_MAX - 1); ++bin_ii) {
-        Copy(low, low_o[N_C_PER_BLOCK * bin_ii], N_C_PER_BLOCK, 1, {1, 1, 8, 8});
-        Copy(high, low_o[N_C_PER_BLOCK * (bin_ii + 1)], N_C_PER_BLOCK, 1, {1, 1, 8, 8});
-
-        Brcb(register_bins_x_channels, indexes_0_31_x_32, N_C_PER_BLOCK / 8, {1, 8});
-
-        Muls(register_bins_x_channels, register_bins_x_channels, 2, N_C_PER_BLOCK * (32 / sizeof(int32_t)));
-        Gather(high_bcast, high, register_bins_x_channels.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK * (32 / sizeof(int32_t)));
-
-        // Broadcast Low over 8 positions. One for each possible power 2 alignment. It will be involved in a compare so,
-        // owing to type cosntraints, needs to be i32. (half would work for the compare but we also want to do bitwise
-        // logical operations)
-        Cast(low.ReinterpretCast<half>(), low, RoundMode::CAST_NONE, N_C_PER_BLOCK);
-        Cast(register_bins, low.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
-        Muls(register_bins_x_channels, register_bins_x_channels, 2, N_C_PER_BLOCK * (32 / sizeof(int32_t)));
-        Gather(low_bcast, register_bins, register_bins_x_channels.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK * (32 / sizeof(int32_t)));
-
-        // Identify trailing zero's of low - while tight packing bins this bounds the bin width that can be allocated
-        And(register_bins_x_channels.ReinterpretCast<int16_t>(), low_bcast.ReinterpretCast<int16_t>(), l_pows_2_mask_arr_ii, 2 * 8 * N_C_PER_BLOCK);
-        Compare(alignment_mask, low_bcast, register_bins_x_channels, CMPMODE::EQ, N_C_PER_BLOCK * 8);
-
-        Cast(alignment_mask_i16.ReinterpretCast<half>(), alignment_mask.ReinterpretCast<uint8_t>(), RoundMode::CAST_NONE, N_C_PER_BLOCK);
-        Cast(alignment_mask_i16, alignment_mask_i16.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
-        ShiftLeft(alignment_mask_i16, alignment_mask_i16, static_cast<int16_t>(1), N_C_PER_BLOCK);
-        Adds(alignment_mask_i16, alignment_mask_i16, static_cast<int16_t>(1), N_C_PER_BLOCK);
-
-        // Propose a series of new highs by adding 2^n to low
-        auto proposed_high = low_bcast; // Buffer re-use
-        Add(proposed_high, low_bcast, l_pows_2_arr, 8 * N_C_PER_BLOCK);
-
-        Cast(proposed_high.ReinterpretCast<half>(), proposed_high, RoundMode::CAST_NONE, N_C_PER_BLOCK * 8);
-        Cast(high_bcast.ReinterpretCast<half>(), high_bcast, RoundMode::CAST_NONE, N_C_PER_BLOCK * 8);
-
-        // Pick the proposed bin that doesn't exceed high and satisfies alignment requirements
-        Compare(exceeds_high_mask, proposed_high.ReinterpretCast<half>(), high_bcast.ReinterpretCast<half>(), CMPMODE::LE, N_C_PER_BLOCK * 8);
-
-        Cast(exceeds_high_mask_i16.ReinterpretCast<half>(), exceeds_high_mask.ReinterpretCast<uint8_t>(), RoundMode::CAST_NONE, N_C_PER_BLOCK);
-        Cast(exceeds_high_mask_i16, exceeds_high_mask_i16.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
-
-        And(exceeds_high_mask_i16, exceeds_high_mask_i16, alignment_mask_i16, N_C_PER_BLOCK);
-        Adds(exceeds_high_mask_i16, exceeds_high_mask_i16, static_cast<int16_t>(0x0001), N_C_PER_BLOCK);
-        ShiftRight(exceeds_high_mask_i16, exceeds_high_mask_i16, static_cast<int16_t>(1), N_C_PER_BLOCK);
-
-        Cast(exceeds_high_mask_i16.ReinterpretCast<half>(), exceeds_high_mask_i16, RoundMode::CAST_NONE, N_C_PER_BLOCK);
-        Cast(exceeds_high_mask.ReinterpretCast<uint8_t>(), exceeds_high_mask_i16.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
-
-        // Update the bins and move on to next low/high pair
-        uint64_t _rsvd = 0;
-        auto repeats = 1;
-        gmp = {
-            1, // src0BlockStride. 1 - Continuous data
-            static_cast<uint8_t>(repeats),
-            8, // src0RepeatStride - Continuous Data
-            0 // src1RepeatStride - not used
-        };
-        auto new_high = low; // Buffer reuse
-        GatherMask(new_high.ReinterpretCast<half>(), proposed_high.ReinterpretCast<half>(), exceeds_high_mask.ReinterpretCast<uint16_t>(), true, 256, gmp, _rsvd);
-
-        Cast(low_o[N_C_PER_BLOCK * (bin_ii + 1)], new_high.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
+        align_bin(low_o[N_C_PER_BLOCK * (bin_ii + 1)], low_o[N_C_PER_BLOCK * bin_ii], low_o[N_C_PER_BLOCK * (bin_ii + 1)], align_scratch);
     }
     Gather(low_o_ii, low_o, swap_channel_bin_i16_idxs.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK * N_C_PER_BLOCK);
     Gather(low_o_ii, low_o_ii, inverter_32_elem_x32_i16_idxs.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK * N_B_MAX);
@@ -585,114 +725,85 @@ __aicore__ inline void PacEncoder::meta_data_calc(int layer_id, int channel_star
     // --------
     // Phase: Align boundaries to 2^n boundaries - pass 2 (most common to least common)
     // --------
+    // The first bin starts at 0, the last ends at 256
+    Duplicate(first_low, static_cast<int16_t>(0), N_C_PER_BLOCK);
+    Duplicate(low_o[N_C_PER_BLOCK * (N_B_MAX - 1)], static_cast<int16_t>(256), N_C_PER_BLOCK);
     for (auto bin_ii = 0; bin_ii < N_B_MAX; ++bin_ii) {
-        if (bin_ii == 0) {
-            Duplicate(low, static_cast<int16_t>(0), N_C_PER_BLOCK);
-        } else {
-            Copy(low, low_o[N_C_PER_BLOCK * (bin_ii - 1)], N_C_PER_BLOCK, 1, {1, 1, 8, 8});
-        }
-
-        if (bin_ii == (N_B_MAX - 1)) {
-            Duplicate(high, static_cast<int16_t>(256), N_C_PER_BLOCK);
-        } else {
-            Copy(high, low_o[N_C_PER_BLOCK * bin_ii], N_C_PER_BLOCK, 1, {1, 1, 8, 8});
-        }
-
-        Brcb(register_bins_x_channels, indexes_0_31_x_32, N_C_PER_BLOCK / 8, {1, 8});
-
-        Muls(register_bins_x_channels, register_bins_x_channels, 2, N_C_PER_BLOCK * (32 / sizeof(int32_t)));
-        Gather(high_bcast, high, register_bins_x_channels.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK * (32 / sizeof(int32_t)));
-
-        Muls(register_bins_x_channels, register_bins_x_channels, 2, N_C_PER_BLOCK * (32 / sizeof(int32_t)));
-        Cast(low.ReinterpretCast<half>(), low, RoundMode::CAST_NONE, N_C_PER_BLOCK);
-        Cast(register_bins, low.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
-        Gather(low_bcast, register_bins, register_bins_x_channels.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK * (32 / sizeof(int32_t)));
-
-        // Identify trailing zero's of low - while tight packing bins this bounds the bin width that can be allocated
-        And(register_bins_x_channels.ReinterpretCast<int16_t>(), low_bcast.ReinterpretCast<int16_t>(), l_pows_2_mask_arr_ii, 2 * 8 * N_C_PER_BLOCK);
-        Compare(alignment_mask, low_bcast, register_bins_x_channels, CMPMODE::EQ, N_C_PER_BLOCK * 8);
-
-        Cast(alignment_mask_i16.ReinterpretCast<half>(), alignment_mask.ReinterpretCast<uint8_t>(), RoundMode::CAST_NONE, N_C_PER_BLOCK);
-        Cast(alignment_mask_i16, alignment_mask_i16.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
-        ShiftLeft(alignment_mask_i16, alignment_mask_i16, static_cast<int16_t>(1), N_C_PER_BLOCK);
-        Adds(alignment_mask_i16, alignment_mask_i16, static_cast<int16_t>(1), N_C_PER_BLOCK);
-
-        // Propose a series of new highs by adding 2^n to low
-        auto proposed_high = low_bcast; // Buffer re-use
-        Add(proposed_high, proposed_high, l_pows_2_arr, 8 * N_C_PER_BLOCK);
-
-        Cast(proposed_high.ReinterpretCast<half>(), low_bcast, RoundMode::CAST_NONE, N_C_PER_BLOCK * 8);
-        Cast(high_bcast.ReinterpretCast<half>(), high_bcast, RoundMode::CAST_NONE, N_C_PER_BLOCK * 8);
-
-        // Pick the proposed bin that doesn't exceed high and satisfies alignment requirements
-        Compare(exceeds_high_mask, proposed_high.ReinterpretCast<half>(), high_bcast.ReinterpretCast<half>(), CMPMODE::LE, N_C_PER_BLOCK * 8);
-
-        Cast(exceeds_high_mask_i16.ReinterpretCast<half>(), exceeds_high_mask.ReinterpretCast<uint8_t>(), RoundMode::CAST_NONE, N_C_PER_BLOCK);
-        Cast(exceeds_high_mask_i16, exceeds_high_mask_i16.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
-
-        And(exceeds_high_mask_i16, exceeds_high_mask_i16, alignment_mask_i16, N_C_PER_BLOCK);
-        Adds(exceeds_high_mask_i16, exceeds_high_mask_i16, static_cast<int16_t>(0x0001), N_C_PER_BLOCK);
-        ShiftRight(exceeds_high_mask_i16, exceeds_high_mask_i16, static_cast<int16_t>(1), N_C_PER_BLOCK);
-
-        Cast(exceeds_high_mask_i16.ReinterpretCast<half>(), exceeds_high_mask_i16, RoundMode::CAST_NONE, N_C_PER_BLOCK);
-        Cast(exceeds_high_mask.ReinterpretCast<uint8_t>(), exceeds_high_mask_i16.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
-
-        // Update the bins and move on to next low/high pair
-        uint64_t _rsvd = 0;
-        auto repeats = 1;
-        gmp = {
-            1, // src0BlockStride. 1 - Continuous data
-            static_cast<uint8_t>(repeats),
-            8, // src0RepeatStride - Continuous Data
-            0 // src1RepeatStride - not used
-        };
-        auto new_high = low; // Buffer reuse
-        GatherMask(new_high.ReinterpretCast<half>(), proposed_high.ReinterpretCast<half>(), exceeds_high_mask.ReinterpretCast<uint16_t>(), true, 256, gmp, _rsvd);
-        Cast(low_o[N_C_PER_BLOCK * (bin_ii)], new_high.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
+        auto low = bin_ii == 0 ? first_low : low_o[N_C_PER_BLOCK * (bin_ii - 1)];
+        align_bin(low_o[N_C_PER_BLOCK * bin_ii], low, low_o[N_C_PER_BLOCK * bin_ii], align_scratch);
     }
 
     // --------
     // Phase: Determine minimum encode lengths given aligned bins
     // --------
+    // Still bins as rows of low_o, every (bin, channel) at once. Symbol s codes [low, high), low being the high of
+    // symbol s - 1
     uint32_t lens_sz = ceil_32(N_C_PER_BLOCK * N_B_MAX * sizeof(int16_t));
-    LocalTensor<int16_t> lens = calcBuf.GetWithOffset<int16_t>(N_C_PER_BLOCK * N_B_MAX , calc_buf_offset);
+    LocalTensor<int16_t> lens = calcBuf.GetWithOffset<int16_t>(N_C_PER_BLOCK * N_B_MAX, calc_buf_offset);
+    calc_buf_offset += lens_sz;
+    LocalTensor<int16_t> sym_low = calcBuf.GetWithOffset<int16_t>(N_C_PER_BLOCK * N_B_MAX, calc_buf_offset);
+    calc_buf_offset += lens_sz;
+    LocalTensor<int16_t> lens_tmp = calcBuf.GetWithOffset<int16_t>(N_C_PER_BLOCK * N_B_MAX, calc_buf_offset);
     calc_buf_offset += lens_sz;
 
-    const int max_symbol = N_B_MAX - 1;
-    for (auto c_ii = 0; c_ii < N_C_PER_BLOCK; ++c_ii) {
-        for (uint8_t mock_sym = 0; mock_sym < N_B_MAX; mock_sym++) {
-            uint16_t c_low = mock_sym == 0 ? 0 : low_o(c_ii + N_B_MAX * (mock_sym - 1));
-            uint16_t c_high = low_o(c_ii + N_B_MAX * mock_sym);
-
-            if (c_low == static_cast<uint16_t>(256)) {
-                // All remaining symbols are un-encodable
-                for (; mock_sym < N_B_MAX; mock_sym++)
-                {
-                    lens.SetValue(c_ii + N_B_MAX * mock_sym, 9);
-                    low_o.SetValue(c_ii + N_B_MAX * mock_sym, static_cast<int16_t>(512)); // Break sorting ties
-                }
-                continue;
-            }
-
-            c_low <<= 8;
-            c_high <<= 8;
+    uint8_t bin_mask_repeats = (N_C_PER_BLOCK * N_B_MAX) / 128;
+    Duplicate(sym_low, static_cast<int16_t>(0), N_C_PER_BLOCK);
+    Copy(sym_low[N_C_PER_BLOCK], low_o, N_C_PER_BLOCK, N_B_MAX - 1, {1, 1, 2, 2});
+
+    // Top bit set in high but not in low, as a mask of the bits below it. An empty bin has no such bit and keeps
+    // every bit
+    Not(lens_tmp, sym_low, N_C_PER_BLOCK * N_B_MAX);
+    And(lens_tmp, lens_tmp, low_o, N_C_PER_BLOCK * N_B_MAX);
+    Cast(lens_tmp.ReinterpretCast<half>(), lens_tmp, RoundMode::CAST_NONE, N_C_PER_BLOCK * N_B_MAX);
+    And(lens_tmp, lens_tmp, bin_exp_mask, 128, bin_mask_repeats, mask_repeat_params);
+    Cast(lens_tmp, lens_tmp.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK * N_B_MAX);
+    Adds(lens_tmp, lens_tmp, static_cast<int16_t>(-1), N_C_PER_BLOCK * N_B_MAX);
+
+    // The top bit of low left clear under that mask sets the length, 8 - its position read off the exponent of a
+    // half. Low can't be told apart below 2^-8 so no such bit is a length of 9. (low == 256 is dealt with below)
+    Muls(lens, sym_low, static_cast<int16_t>(-1), N_C_PER_BLOCK * N_B_MAX);
+    Adds(lens, lens, static_cast<int16_t>(255), N_C_PER_BLOCK * N_B_MAX);
+    And(lens, lens, lens_tmp, N_C_PER_BLOCK * N_B_MAX);
+    Cast(lens.ReinterpretCast<half>(), lens, RoundMode::CAST_NONE, N_C_PER_BLOCK * N_B_MAX);
+    ShiftRight(lens.ReinterpretCast<uint16_t>(), lens.ReinterpretCast<uint16_t>(), static_cast<uint16_t>(10), N_C_PER_BLOCK * N_B_MAX);
+    Muls(lens, lens, static_cast<int16_t>(-1), N_C_PER_BLOCK * N_B_MAX);
+    Adds(lens, lens, static_cast<int16_t>(8 + 15), N_C_PER_BLOCK * N_B_MAX);
+    Mins(lens, lens, static_cast<int16_t>(9), N_C_PER_BLOCK * N_B_MAX);
+
+    // A length comes down by one unless that takes it below the length of the symbol before. That chains down the
+    // bins, step a bin at a time over all channels
+    Adds(lens, lens, static_cast<int16_t>(-1), N_C_PER_BLOCK);
+    for (auto bin_ii = 1; bin_ii < N_B_MAX; ++bin_ii) {
+        auto len = lens[N_C_PER_BLOCK * bin_ii];
+        auto drop = lens_tmp[N_C_PER_BLOCK * bin_ii];
+        Sub(drop, len, lens[N_C_PER_BLOCK * (bin_ii - 1)], N_C_PER_BLOCK);
+        Adds(drop, drop, static_cast<int16_t>(1), N_C_PER_BLOCK);
+        Maxs(drop, drop, static_cast<int16_t>(0), N_C_PER_BLOCK);
+        Mins(drop, drop, static_cast<int16_t>(1), N_C_PER_BLOCK);
+        Sub(len, len, drop, N_C_PER_BLOCK);
+    }
 
-            uint16_t next_pos = AscendC::ScalarCountLeadingZero(static_cast<uint64_t>(c_high & (~c_low))) - 47;
-            uint8_t len_base = static_cast<uint8_t>(next_pos);
+    // All symbols from the first with low == 256 on are un-encodable, their highs pushed to 512 to break sorting ties
+    auto unencodable = lens_tmp;
+    Adds(unencodable, sym_low, static_cast<int16_t>(-255), N_C_PER_BLOCK * N_B_MAX);
+    Maxs(unencodable, unencodable, static_cast<int16_t>(0), N_C_PER_BLOCK * N_B_MAX);
+    Mins(unencodable, unencodable, static_cast<int16_t>(1), N_C_PER_BLOCK * N_B_MAX);
 
-            uint16_t base_encode = (c_low >> (16 - len_base)) << (16 - len_base);
-            uint16_t lower = base_encode + ((1 << (16 - len_base))) - 1;
-            uint8_t len_break_lower = AscendC::ScalarCountLeadingZero(static_cast<uint64_t>(lower & ~c_low)) - 47;
+    Muls(sym_low, lens, static_cast<int16_t>(-1), N_C_PER_BLOCK * N_B_MAX);
+    Adds(sym_low, sym_low, static_cast<int16_t>(9), N_C_PER_BLOCK * N_B_MAX);
+    Mul(sym_low, sym_low, unencodable, N_C_PER_BLOCK * N_B_MAX);
+    Add(lens, lens, sym_low, N_C_PER_BLOCK * N_B_MAX);
 
-            if (mock_sym == 0 || len_break_lower >= lens.GetValue(c_ii + N_B_MAX * (mock_sym - 1))) {
-                len_break_lower -= 1;
-            }
+    Muls(sym_low, low_o, static_cast<int16_t>(-1), N_C_PER_BLOCK * N_B_MAX);
+    Adds(sym_low, sym_low, static_cast<int16_t>(512), N_C_PER_BLOCK * N_B_MAX);
+    Mul(sym_low, sym_low, unencodable, N_C_PER_BLOCK * N_B_MAX);
+    Add(low_o, low_o, sym_low, N_C_PER_BLOCK * N_B_MAX);
 
-            lens.SetValue(c_ii + N_B_MAX * mock_sym, len_break_lower);
-        }
-    }
+    // Symbols encode from the high of the symbol before
+    Duplicate(sym_low, static_cast<int16_t>(0), N_C_PER_BLOCK);
+    Copy(sym_low[N_C_PER_BLOCK], low_o, N_C_PER_BLOCK, N_B_MAX - 1, {1, 1, 2, 2});
 
-    Gather(low_o_ii, low_o, swap_channel_bin_i16_idxs.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK * N_C_PER_BLOCK);
+    Gather(low_o_ii, sym_low, swap_channel_bin_i16_idxs.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK * N_C_PER_BLOCK);
     Gather(register_bins_x_channels.ReinterpretCast<int16_t>(), lens, swap_channel_bin_i16_idxs.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK * N_C_PER_BLOCK);
 
     // --------
@@ -701,101 +812,247 @@ __aicore__ inline void PacEncoder::meta_data_calc(int layer_id, int channel_star
     // --------
     auto resorted_counts = register_bins_x_channels_x_2.ReinterpretCast<half>();
 
-    for(auto c_ii = 0; c_ii < N_C_PER_BLOCK; ++c_ii) {
-        Cast(register_bins.ReinterpretCast<half>(), sorted_count_idx[c_ii * N_B_MAX], RoundMode::CAST_RINT, N_C_PER_BLOCK);
-        Sort32(resorted_counts[N_B_MAX * c_ii * (8 / sizeof(half))], register_bins.ReinterpretCast<half>(), indexes_0_31_x_32.ReinterpretCast<uint32_t>(), N_B_MAX / 32);
-    }
+    // Sorting the sorted order by symbol inverts it, all channels in one Sort32
+    Cast(lens_tmp.ReinterpretCast<half>(), sorted_count_idx, RoundMode::CAST_RINT, N_C_PER_BLOCK * N_B_MAX);
+    Sort32(resorted_counts, lens_tmp.ReinterpretCast<half>(), indexes_0_31_x_32.ReinterpretCast<uint32_t>(), N_C_PER_BLOCK);
 
     _rsvd = 0;
-    elems_per_256 = 256 / 8;
-    repeats = (N_B_MAX * N_C_PER_BLOCK) / elems_per_256;
     gmp = {
         1, // src0BlockStride. 1 - Continuous data
-        static_cast<uint8_t>(1),
+        static_cast<uint8_t>(repeats),
         8, // src0RepeatStride - Continuous Data
         0 // src1RepeatStride - not used
     };
-    auto tmp_rsvd = _rsvd;
-    for (auto rep_ii = 0; rep_ii < repeats; ++rep_ii) {
-        GatherMask(sorted_count_idx[elems_per_256 * rep_ii], resorted_counts.ReinterpretCast<int32_t>()[2 * elems_per_256 * rep_ii], 2, false, 0, gmp, tmp_rsvd);
-        _rsvd += tmp_rsvd;
-    }
+    GatherMask(sorted_count_idx, resorted_counts.ReinterpretCast<int32_t>(), 2, false, 0, gmp, _rsvd);
+
+    // Offset each channel's indexes to its row, sizeof(i16) x (N_B_MAX * c_ii + idx). The inverter is sizeof(i16) x
+    // (N_B_MAX * c_ii + 31 - b_ii), adding b_ii back in leaves the row base
+    Add(sorted_count_idx, sorted_count_idx, indexes_0_31_x_32, N_C_PER_BLOCK * N_B_MAX);
+    Muls(sorted_count_idx, sorted_count_idx, 2, N_C_PER_BLOCK * N_B_MAX);
+    Add(sorted_count_idx, sorted_count_idx, inverter_32_elem_x32_i16_idxs, N_C_PER_BLOCK * N_B_MAX);
+    Adds(sorted_count_idx, sorted_count_idx, -2 * (N_B_MAX - 1), N_C_PER_BLOCK * N_B_MAX);
 
-    for (auto c_ii = 0; c_ii < N_C_PER_BLOCK; ++c_ii) {
-        Adds(sorted_count_idx[c_ii * N_C_PER_BLOCK], sorted_count_idx[c_ii * N_C_PER_BLOCK], 32 * c_ii, N_C_PER_BLOCK);
-    }
-    Muls(sorted_count_idx, sorted_count_idx, 2, N_C_PER_BLOCK * N_C_PER_BLOCK);
     Gather(lens, register_bins_x_channels.ReinterpretCast<int16_t>(), sorted_count_idx.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK * N_C_PER_BLOCK);
     Gather(lens, lens, inverter_32_elem_x32_i16_idxs.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK * N_C_PER_BLOCK);
 
-    Gather(low_o, low_o_ii, sorted_count_idx.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK * N_C_PER_BLOCK);
-    Gather(low_o, low_o, inverter_32_elem_x32_i16_idxs.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK * N_C_PER_BLOCK);
-
-    for (auto c_ii = 0; c_ii < N_C_PER_BLOCK; ++c_ii) {
-        int16_t next = 0;
-        auto last = 0;
-        for (auto b_ii = 0; b_ii < N_B_MAX; ++b_ii) {
-            next = last;
-            last = low_o_ii.GetValue(c_ii * N_B_MAX + b_ii);
-            low_o_ii.SetValue(c_ii * N_B_MAX + b_ii, next);
-        }
-    }
-
     Gather(low_o, low_o_ii, sorted_count_idx.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK * N_C_PER_BLOCK);
     Gather(low_o, low_o, inverter_32_elem_x32_i16_idxs.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK * N_C_PER_BLOCK);
     auto enc = low_o;
 
-    auto meta_out = metaDataOutQ.AllocTensor<int16_t>();
     ShiftLeft(meta_out, enc, static_cast<int16_t>(8), N_C_PER_BLOCK * N_B_MAX);
     Or(meta_out, meta_out, lens, N_C_PER_BLOCK * N_B_MAX);
+}
+
+__aicore__ inline void PacEncoder::align_bin(const LocalTensor<int16_t>& new_high, const LocalTensor<int16_t>& low, const LocalTensor<int16_t>& high, const LocalTensor<int16_t>& scratch) {
+    auto width = scratch;
+    auto align = scratch[N_C_PER_BLOCK];
+    auto neg_align = scratch[2 * N_C_PER_BLOCK];
+
+    // Widest power of 2 that fits, high - low rounded down through the exponent of a half. An empty bin stays empty
+    Sub(width, high, low, N_C_PER_BLOCK);
+    Cast(width.ReinterpretCast<half>(), width, RoundMode::CAST_NONE, N_C_PER_BLOCK);
+    And(width, width, bin_exp_mask, N_C_PER_BLOCK);
+    Cast(width, width.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
+
+    // Widest power of 2 low is aligned to, its lowest set bit. Setting the cap bit first bounds it, low == 0 included
+    Or(align, low, bin_width_cap, N_C_PER_BLOCK);
+    Muls(neg_align, align, static_cast<int16_t>(-1), N_C_PER_BLOCK);
+    And(align, align, neg_align, N_C_PER_BLOCK);
+
+    Min(width, width, align, N_C_PER_BLOCK);
+    Add(new_high, low, width, N_C_PER_BLOCK);
+}
+
+__aicore__ inline void PacEncoder::meta_data_calc(int layer_id, int channel_start_id) {
+    auto meta_out = metaDataOutQ.AllocTensor<int16_t>();
+    meta_data_build(layer_id, channel_start_id, meta_out, false);
+
+    metaDataOutQ.EnQue(meta_out);
+    meta_out = metaDataOutQ.DeQue<int16_t>();
+    DataCopy(gm_meta_data[layer_id * n_channels * N_B_MAX + channel_start_id * N_B_MAX], meta_out.ReinterpretCast<uint16_t>(), block_channels(n_channels, channel_start_id) * N_B_MAX);
+    metaDataOutQ.FreeTensor(meta_out);
+}
+
+__aicore__ inline void PacEncoder::encode_with_meta(int layer_id, int channel_start_id) {
+    auto meta_out = metaDataOutQ.AllocTensor<int16_t>();
+    meta_data_build(layer_id, channel_start_id, meta_out, true);
 
+    // The tables are still needed by the decoder, write them out but keep encoding from the UB copy
     metaDataOutQ.EnQue(meta_out);
     meta_out = metaDataOutQ.DeQue<int16_t>();
-    DataCopy(gm_meta_data[layer_id * n_channels * N_B_MAX + channel_start_id * N_B_MAX], meta_out.ReinterpretCast<uint16_t>(), N_C_PER_BLOCK * N_B_MAX);
+    DataCopy(gm_meta_data[layer_id * n_channels * N_B_MAX + channel_start_id * N_B_MAX], meta_out.ReinterpretCast<uint16_t>(), block_channels(n_channels, channel_start_id) * N_B_MAX);
+
+    // The last batch is still loaded from the tally, earlier batches are loaded again
+    int32_t last_batch = n_batches - 1;
+    int32_t n_last_tokens = n_tokens - N_T_MAX * last_batch;
+    encode_symbols(layer_id * n_batches + last_batch, channel_start_id, n_last_tokens, meta_out.ReinterpretCast<uint16_t>());
+    for (int32_t b_ii = 0; b_ii < last_batch; ++b_ii) {
+        int32_t n_batch_tokens = load_batch(layer_id, b_ii, channel_start_id, true);
+        encode_symbols(layer_id * n_batches + b_ii, channel_start_id, n_batch_tokens, meta_out.ReinterpretCast<uint16_t>());
+    }
     metaDataOutQ.FreeTensor(meta_out);
 }
 
+__aicore__ inline void PacEncoder::coded_cost(const LocalTensor<int16_t>& lens, int32_t n_batch_tokens, const LocalTensor<int16_t>& cost, const LocalTensor<int16_t>& max_len) {
+    uint32_t calc_buf_offset = 0;
+    uint32_t batch_half_sz = ceil_32(N_T_PER_BATCH * sizeof(half));
+    LocalTensor<half> cast_input = calcBuf.GetWithOffset<half>(N_T_PER_BATCH, calc_buf_offset);
+    calc_buf_offset += batch_half_sz;
+    LocalTensor<half> sym_idxs_h = calcBuf.GetWithOffset<half>(N_T_PER_BATCH, calc_buf_offset);
+    calc_buf_offset += batch_half_sz;
+    LocalTensor<int32_t> sym_idxs = calcBuf.GetWithOffset<int32_t>(N_T_PER_BATCH, calc_buf_offset);
+    calc_buf_offset += ceil_32(N_T_PER_BATCH * sizeof(int32_t));
+    LocalTensor<int16_t> sym_lens = calcBuf.GetWithOffset<int16_t>(N_T_PER_BATCH, calc_buf_offset);
+    calc_buf_offset += ceil_32(N_T_PER_BATCH * sizeof(int16_t));
+    LocalTensor<int16_t> sym_max = calcBuf.GetWithOffset<int16_t>(N_T_PER_BATCH / 2, calc_buf_offset);
+
+    // Byte offset of every symbol's entry in its channel's row of lens, exact in half (< 2048). Dummy tokens clamp
+    // to the last bin and are zeroed once looked up
+    BinaryRepeatParams row_repeat_params = BinaryRepeatParams(1, 1, 1, 8, 8, 0);
+    Mins(sym_idxs_h, cast_input, static_cast<half>(N_B_MAX - 1), N_T_PER_BATCH);
+    Muls(sym_idxs_h, sym_idxs_h, static_cast<half>(sizeof(int16_t)), N_T_PER_BATCH);
+    Add(sym_idxs_h, sym_idxs_h, cost_lens_i16_offsets, 128, static_cast<uint8_t>(N_T_PER_BATCH / 128), row_repeat_params);
+    Cast(sym_idxs, sym_idxs_h, RoundMode::CAST_RINT, N_T_PER_BATCH);
+    Gather(sym_lens, lens, sym_idxs.ReinterpretCast<uint32_t>(), 0, N_T_PER_BATCH);
+    if (n_batch_tokens < N_T_MAX) {
+        Duplicate(sym_lens[n_batch_tokens * N_C_PER_BLOCK], static_cast<int16_t>(0), (N_T_MAX - n_batch_tokens) * N_C_PER_BLOCK);
+    }
+
+    // Fold the tokens down to a row per channel, a batch sums to at most N_T_MAX * 9 bits
+    uint32_t half_count = N_T_PER_BATCH / 2;
+    Max(sym_max, sym_lens, sym_lens[half_count], half_count);
+    Add(sym_lens, sym_lens, sym_lens[half_count], half_count);
+    for (int32_t n_rows = N_T_MAX / 4; n_rows >= 1; n_rows /= 2) {
+        Max(sym_max, sym_max, sym_max[n_rows * N_C_PER_BLOCK], n_rows * N_C_PER_BLOCK);
+        Add(sym_lens, sym_lens, sym_lens[n_rows * N_C_PER_BLOCK], n_rows * N_C_PER_BLOCK);
+    }
+    Add(cost, cost, sym_lens, N_C_PER_BLOCK);
+    Max(max_len, max_len, sym_max, N_C_PER_BLOCK);
+}
+
+__aicore__ inline void PacEncoder::encode_adaptive(int layer_id, int channel_start_id, int32_t cost_limit) {
+    int32_t n_valid = block_channels(n_channels, channel_start_id);
+    auto meta_info = metaDataInQ.AllocTensor<uint16_t>();
+    if (n_valid < N_C_PER_BLOCK) {
+        fill_tail_meta(meta_info, n_valid);
+    }
+    DataCopy(meta_info, gm_meta_data[(layer_id * n_channels + channel_start_id) * N_B_MAX], n_valid * N_B_MAX);
+    metaDataInQ.EnQue(meta_info);
+    meta_info = metaDataInQ.DeQue<uint16_t>();
+
+    // Code lengths of the cached tables, the low byte of every entry
+    auto lens = register_bins_x_channels.ReinterpretCast<int16_t>();
+    ShiftLeft(lens.ReinterpretCast<uint16_t>(), meta_info, static_cast<uint16_t>(8), N_C_PER_BLOCK * N_B_MAX);
+    ShiftRight(lens.ReinterpretCast<uint16_t>(), lens.ReinterpretCast<uint16_t>(), static_cast<uint16_t>(8), N_C_PER_BLOCK * N_B_MAX);
+
+    // A chunk of up to N_T_CHUNK_MAX tokens codes to at most 9 * N_T_CHUNK_MAX bits per channel, within int16
+    auto cost = register_bins.ReinterpretCast<int16_t>();
+    auto max_len = cost[N_C_PER_BLOCK];
+    Duplicate(cost, static_cast<int16_t>(0), 2 * N_C_PER_BLOCK);
+
+    // Measure the whole chunk before writing anything, the last batch is left loaded as encode_with_meta() expects
+    int32_t last_batch = n_batches - 1;
+    for (int32_t b_ii = 0; b_ii < n_batches; ++b_ii) {
+        int32_t n_batch_tokens = load_batch(layer_id, b_ii, channel_start_id, b_ii == last_batch);
+        coded_cost(lens, n_batch_tokens, cost, max_len);
+    }
+
+    PipeBarrier<PIPE_ALL>();
+    bool stale = false;
+    for (int32_t c_ii = 0; c_ii < n_valid && !stale; ++c_ii) {
+        stale = cost.GetValue(c_ii) > cost_limit || max_len.GetValue(c_ii) > 8;
+    }
+    if (stale) {
+        metaDataInQ.FreeTensor(meta_info);
+        encode_with_meta(layer_id, channel_start_id);
+        return;
+    }
+
+    int32_t n_last_tokens = n_tokens - N_T_MAX * last_batch;
+    encode_symbols(layer_id * n_batches + last_batch, channel_start_id, n_last_tokens, meta_info);
+    for (int32_t b_ii = 0; b_ii < last_batch; ++b_ii) {
+        int32_t n_batch_tokens = load_batch(layer_id, b_ii, channel_start_id, true);
+        encode_symbols(layer_id * n_batches + b_ii, channel_start_id, n_batch_tokens, meta_info);
+    }
+    metaDataInQ.FreeTensor(meta_info);
+}
+
+// The histogram and table build of meta_data_calc() and the cost pass of encode_adaptive(), without the symbol
+// coding and the rectification of an encode. Adds the table of every channel and a bound on the slot rounding of
+// encode_symbols(): each non empty sub-stream of a batch takes at most one more uint16 slot than its bits
+__aicore__ inline void PacEncoder::estimate(int layer_id, int channel_start_id) {
+    auto meta_out = metaDataOutQ.AllocTensor<int16_t>();
+    meta_data_build(layer_id, channel_start_id, meta_out, false);
+
+    // Code lengths of the fresh tables, the low byte of every entry
+    auto lens = register_bins_x_channels.ReinterpretCast<int16_t>();
+    ShiftLeft(lens.ReinterpretCast<uint16_t>(), meta_out.ReinterpretCast<uint16_t>(), static_cast<uint16_t>(8), N_C_PER_BLOCK * N_B_MAX);
+    ShiftRight(lens.ReinterpretCast<uint16_t>(), lens.ReinterpretCast<uint16_t>(), static_cast<uint16_t>(8), N_C_PER_BLOCK * N_B_MAX);
+    metaDataOutQ.FreeTensor(meta_out);
+
+    // Within int16 as for encode_adaptive(), max_len is unused: the tables encode every symbol they were built from
+    auto cost = register_bins.ReinterpretCast<int16_t>();
+    auto max_len = cost[N_C_PER_BLOCK];
+    Duplicate(cost, static_cast<int16_t>(0), 2 * N_C_PER_BLOCK);
+
+    // The last batch is still loaded from the tally, earlier batches are loaded again
+    int32_t last_batch = n_batches - 1;
+    coded_cost(lens, n_tokens - N_T_MAX * last_batch, cost, max_len);
+    for (int32_t b_ii = 0; b_ii < last_batch; ++b_ii) {
+        int32_t n_batch_tokens = load_batch(layer_id, b_ii, channel_start_id, false);
+        coded_cost(lens, n_batch_tokens, cost, max_len);
+    }
+
+    constexpr int32_t slot_bits = 8 * sizeof(uint16_t);
+    int32_t extra_bits = n_raw_bits * n_tokens + N_B_MAX * slot_bits;
+    for (int32_t b_ii = 0; b_ii < n_batches; ++b_ii) {
+        int32_t n_batch_tokens = n_tokens - N_T_MAX * b_ii < N_T_MAX ? n_tokens - N_T_MAX * b_ii : N_T_MAX;
+        extra_bits += (n_batch_tokens < n_sub_streams ? n_batch_tokens : n_sub_streams) * slot_bits;
+    }
+
+    auto bits_out = lensOutQ.AllocTensor<int32_t>();
+    Cast(bits_out, cost, RoundMode::CAST_NONE, N_C_PER_BLOCK);
+    Adds(bits_out, bits_out, extra_bits, N_C_PER_BLOCK);
+    lensOutQ.EnQue(bits_out);
+    bits_out = lensOutQ.DeQue<int32_t>();
+    int32_t n_valid = block_channels(n_channels, channel_start_id);
+    DataCopyExtParams copy_params = {1, static_cast<uint32_t>(n_valid * sizeof(uint32_t)), 0, 0, 0};
+    DataCopyPad(g_out_lens[layer_id * n_channels + channel_start_id], bits_out.ReinterpretCast<uint32_t>(), copy_params);
+    lensOutQ.FreeTensor(bits_out);
+}
 
 __aicore__ inline void PacEncoder::encode(int layer_id, int channel_start_id) {
     // --------
     // Phase: Copy IN
     // --------
-    LocalTensor<uint8_t> l_syms = symInQ.AllocTensor<uint8_t>();
-    auto sym_offset = n_tokens_per_layer * layer_id + channel_start_id;
-    uint16_t src_stride = N_DBs_PER_BLOCK * ((n_channels / N_C_PER_BLOCK) - 1);
-    DataCopyParams repeatParams = {static_cast<uint16_t>(n_tokens), N_DBs_PER_BLOCK, src_stride, 0};
-    DataCopy(l_syms, g_syms[sym_offset], repeatParams);
+    int32_t n_valid = block_channels(n_channels, channel_start_id);
+    auto meta_info = metaDataInQ.AllocTensor<uint16_t>();
+    if (n_valid < N_C_PER_BLOCK) {
+        fill_tail_meta(meta_info, n_valid);
+    }
+    DataCopy(meta_info, gm_meta_data[(layer_id * n_channels + channel_start_id) * N_B_MAX], n_valid * N_B_MAX);
+    metaDataInQ.EnQue(meta_info);
+    meta_info = metaDataInQ.DeQue<uint16_t>();
 
-    symInQ.EnQue(l_syms);
-    l_syms = symInQ.DeQue<uint8_t>();
+    // Every batch is encoded with the same tables into its own row of the output
+    for (int32_t b_ii = 0; b_ii < n_batches; ++b_ii) {
+        int32_t n_batch_tokens = load_batch(layer_id, b_ii, channel_start_id, true);
+        encode_symbols(layer_id * n_batches + b_ii, channel_start_id, n_batch_tokens, meta_info);
+    }
+    metaDataInQ.FreeTensor(meta_info);
+}
 
+__aicore__ inline void PacEncoder::encode_symbols(int row_id, int channel_start_id, int32_t n_batch_tokens, const LocalTensor<uint16_t>& meta_info) {
     uint32_t calc_buf_offset = 0;
 
     uint32_t cast_input_count = N_T_MAX * N_C_PER_BLOCK;
     uint32_t cast_input_sz = ceil_32(cast_input_count * sizeof(half));
     LocalTensor<half> cast_input = calcBuf.GetWithOffset<half>(cast_input_count, calc_buf_offset);
     calc_buf_offset += cast_input_sz;
-    Cast(cast_input, l_syms, RoundMode::CAST_NONE, n_tokens * N_C_PER_BLOCK);
-    symInQ.FreeTensor(l_syms);
-
-    // Defensive, ensure any dummy tokens are intialized to invalid token values
-    half inval = 999.;
-    Duplicate(cast_input[n_tokens * N_C_PER_BLOCK], inval, (N_T_MAX - n_tokens) * N_C_PER_BLOCK);
 
-    uint32_t swapped_input_count = N_T_MAX * N_C_PER_BLOCK;
-    uint32_t swapped_input_sz = ceil_32(swapped_input_count * sizeof(half));
-    LocalTensor<half> swapped_input = calcBuf.GetWithOffset<half>(swapped_input_count, calc_buf_offset);
+    uint32_t swapped_input_sz = ceil_32(N_T_MAX * N_C_PER_BLOCK * sizeof(half));
     calc_buf_offset += swapped_input_sz;
 
-    for (int32_t c_ii = 0; c_ii < N_C_PER_BLOCK; ++c_ii) {
-        Gather(swapped_input[N_T_MAX * c_ii], cast_input, swap_channel_token_i16_idxs.ReinterpretCast<uint32_t>(), sizeof(half) * c_ii, N_T_MAX);
-    }
-
-    auto meta_info = metaDataInQ.AllocTensor<uint16_t>();
-    DataCopy(meta_info, gm_meta_data[(layer_id * n_channels + channel_start_id) * N_B_MAX], N_C_PER_BLOCK * N_B_MAX);
-    metaDataInQ.EnQue(meta_info);
-    meta_info = metaDataInQ.DeQue<uint16_t>();
-
     uint32_t bins_per_block = N_C_PER_BLOCK * N_B_MAX;
     uint32_t encs_sz = ceil_32(bins_per_block * sizeof(int16_t));
     LocalTensor<int16_t> enc = calcBuf.GetWithOffset<int16_t>(bins_per_block, calc_buf_offset);
@@ -810,8 +1067,6 @@ __aicore__ inline void PacEncoder::encode(int layer_id, int channel_start_id) {
     ShiftLeft(lens.ReinterpretCast<uint16_t>(), meta_info, shift_byte, bins_per_block);
     ShiftRight(lens.ReinterpretCast<uint16_t>(), lens.ReinterpretCast<uint16_t>(), shift_byte, bins_per_block);
 
-    metaDataInQ.FreeTensor(meta_info);
-
     // --------
     // Phase: Prepare various buffers used in the core encoding loop
     // --------
@@ -822,18 +1077,19 @@ __aicore__ inline void PacEncoder::encode(int layer_id, int channel_start_id) {
     LocalTensor<uint16_t> bytestream_out_i16 = byteStreamOutQ.AllocTensor<uint16_t>();
     LocalTensor<uint32_t> lens_out_32 = lensOutQ.AllocTensor<uint32_t>();
     LocalTensor<int16_t> lens_out = lens_out_32.ReinterpretCast<int16_t>();
-    Duplicate(lens_out, static_cast<int16_t>(2), N_C_PER_BLOCK);
 
-    uint32_t current_write_h = 0;
+    // Byte lengths and start offsets of the sub-streams within their channel's stream, [n_sub_streams, N_C_PER_BLOCK]
+    uint32_t sub_lens_sz = ceil_32(N_SUB_STREAMS_MAX * N_C_PER_BLOCK * sizeof(int32_t));
+    LocalTensor<int32_t> sub_lens = calcBuf.GetWithOffset<int32_t>(N_SUB_STREAMS_MAX * N_C_PER_BLOCK, calc_buf_offset);
+    calc_buf_offset += sub_lens_sz;
+    LocalTensor<int32_t> sub_offsets = calcBuf.GetWithOffset<int32_t>(N_SUB_STREAMS_MAX * N_C_PER_BLOCK, calc_buf_offset);
+    calc_buf_offset += sub_lens_sz;
     uint32_t current_T_read_h_sz = ceil_32(2 * N_C_PER_BLOCK * sizeof(uint32_t));
     LocalTensor<int32_t> current_T_read_h = calcBuf.GetWithOffset<int32_t>(2 * N_C_PER_BLOCK, calc_buf_offset);
     calc_buf_offset += current_T_read_h_sz;
     LocalTensor<int32_t> current_T_read_h_tmp = calcBuf.GetWithOffset<int32_t>(2 * N_C_PER_BLOCK, calc_buf_offset);
     calc_buf_offset += current_T_read_h_sz;
 
-    CreateVecIndex(current_T_read_h, 0, N_C_PER_BLOCK);
-    Muls(current_T_read_h, current_T_read_h, static_cast<int32_t>(sizeof(int16_t)), N_C_PER_BLOCK);
-
     uint32_t current_out_slot_sz = ceil_32(N_C_PER_BLOCK * sizeof(uint16_t));
     LocalTensor<int16_t> current_out_slot = calcBuf.GetWithOffset<int16_t>(N_C_PER_BLOCK, calc_buf_offset);
     calc_buf_offset += current_out_slot_sz;
@@ -845,12 +1101,10 @@ __aicore__ inline void PacEncoder::encode(int layer_id, int channel_start_id) {
     uint32_t overflow_Enc_sz = ceil_32(N_C_PER_BLOCK * sizeof(uint16_t));
     LocalTensor<int16_t> overflow_Enc = calcBuf.GetWithOffset<int16_t>(N_C_PER_BLOCK, calc_buf_offset);
     calc_buf_offset += overflow_Enc_sz;
-    Duplicate(overflow_Enc, static_cast<int16_t>(0), N_C_PER_BLOCK);
 
     uint32_t overflow_Len_sz = ceil_32(N_C_PER_BLOCK * sizeof(uint16_t));
     LocalTensor<int16_t> overflow_Len = calcBuf.GetWithOffset<int16_t>(N_C_PER_BLOCK, calc_buf_offset);
     calc_buf_offset += overflow_Len_sz;
-    Duplicate(overflow_Len, static_cast<int16_t>(0), N_C_PER_BLOCK);
 
     uint32_t next_T_sz = ceil_32(N_C_PER_BLOCK * sizeof(uint16_t));
     LocalTensor<int16_t> next_T = calcBuf.GetWithOffset<int16_t>(N_C_PER_BLOCK, calc_buf_offset);
@@ -898,15 +1152,11 @@ __aicore__ inline void PacEncoder::encode(int layer_id, int channel_start_id) {
     calc_buf_offset += full_sz;
     LocalTensor<uint8_t> tmp_conditional = calcBuf.GetWithOffset<uint8_t>(256 / 8, calc_buf_offset);
     calc_buf_offset += full_sz;
-    Duplicate(complete.ReinterpretCast<int16_t>(), static_cast<int16_t>(0), 256 / (8 * sizeof(int16_t)));
 
     // 256B because of use in compare. Assumes 256 / sizeof(int32) > N_C_PER_BLOCK
     uint32_t n_t_bcast_sz = 256;
     LocalTensor<int32_t> n_t_bcast = calcBuf.GetWithOffset<int32_t>(256 / sizeof(int32_t), calc_buf_offset);
     calc_buf_offset += n_t_bcast_sz;
-    CreateVecIndex(n_t_bcast, 0, N_C_PER_BLOCK);
-    Muls(n_t_bcast, n_t_bcast, static_cast<int32_t>(sizeof(int16_t)), N_C_PER_BLOCK);
-    Adds(n_t_bcast, n_t_bcast, N_C_PER_BLOCK * static_cast<int32_t>((n_tokens - 1) * sizeof(int16_t)), N_C_PER_BLOCK);
 
     LocalTensor<int16_t> cast_input_i16 = cast_input.ReinterpretCast<int16_t>();
     Cast(cast_input_i16, cast_input, RoundMode::CAST_RINT, N_T_PER_BATCH);
@@ -914,128 +1164,162 @@ __aicore__ inline void PacEncoder::encode(int layer_id, int channel_start_id) {
     // --------
     // Phase: Combine all the previous work and encode the input symbols per the encode lengths and patterns
     // --------
-    // Outer loop runs until all tokens are encoded
-    Compare(end, n_t_bcast, current_T_read_h, CMPMODE::EQ, 256 / sizeof(int32_t));
-    bool outer_done = false;
-    while (!outer_done) {
-        Duplicate(current_out_slot, static_cast<int16_t>(0), N_C_PER_BLOCK);
-        Duplicate(slot_write_h, static_cast<int16_t>(16), N_C_PER_BLOCK);
-
-        // Handle overflow from previous iteration
-        Or(current_out_slot, current_out_slot, overflow_Enc, N_C_PER_BLOCK);
-        Muls(overflow_Len, overflow_Len, static_cast<int16_t>(-1), N_C_PER_BLOCK);
-        Add(slot_write_h, slot_write_h, overflow_Len, N_C_PER_BLOCK);
+    // Token t goes to sub-stream t % n_sub_streams. Each sub-stream is encoded as a stream of its own into a
+    // N_T_MAX / n_sub_streams byte share of its channel's slots, the same bound N_T_MAX is for a whole stream.
+    int32_t token_stride = n_sub_streams * N_C_PER_BLOCK * static_cast<int32_t>(sizeof(int16_t));
+    for (int32_t s_ii = 0; s_ii < n_sub_streams; ++s_ii) {
+        if (s_ii >= n_batch_tokens) {
+            Duplicate(sub_lens[s_ii * N_C_PER_BLOCK], 0, N_C_PER_BLOCK);
+            continue;
+        }
+        int32_t last_token = s_ii + n_sub_streams * ((n_batch_tokens - 1 - s_ii) / n_sub_streams);
+        uint32_t current_write_h = s_ii * (N_T_MAX / sizeof(uint16_t)) / n_sub_streams;
 
+        Duplicate(lens_out, static_cast<int16_t>(2), N_C_PER_BLOCK);
         Duplicate(overflow_Enc, static_cast<int16_t>(0), N_C_PER_BLOCK);
         Duplicate(overflow_Len, static_cast<int16_t>(0), N_C_PER_BLOCK);
-        Duplicate(full.ReinterpretCast<int16_t>(), static_cast<int16_t>(0), N_C_PER_BLOCK / (8 * sizeof(int16_t)));
-
-        // Inner loop until current buffers are full (or all tokens are encoded)
-        bool inner_done = false;
-        while(!(inner_done)) {
-            Or(complete.ReinterpretCast<int16_t>(), end.ReinterpretCast<int16_t>(), full.ReinterpretCast<int16_t>(), N_C_PER_BLOCK / sizeof(int16_t));
-
-            Gather(next_T, cast_input_i16, current_T_read_h.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK);
-
-            Adds(current_T_read_h_tmp, current_T_read_h, static_cast<int32_t>(sizeof(int16_t)) * N_C_PER_BLOCK, N_C_PER_BLOCK);
-
-            Compare(end, n_t_bcast, current_T_read_h, CMPMODE::EQ, 256 / sizeof(int32_t));
-            Or(tmp_conditional.ReinterpretCast<int16_t>(), end.ReinterpretCast<int16_t>(), complete.ReinterpretCast<int16_t>(), N_C_PER_BLOCK / sizeof(int16_t));
-            Select(current_T_read_h.ReinterpretCast<float>(), tmp_conditional, current_T_read_h.ReinterpretCast<float>(), current_T_read_h_tmp.ReinterpretCast<float>(), SELMODE::VSEL_TENSOR_TENSOR_MODE, N_C_PER_BLOCK);
-
-            // Next_T as byte offset in lens and encs (including channel offsets)
-            Cast(register_bins.ReinterpretCast<half>(), next_T, RoundMode::CAST_NONE, N_C_PER_BLOCK);
-            Cast(next_T_as_byte, register_bins.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
-            Muls(next_T_as_byte, next_T_as_byte, 2, N_C_PER_BLOCK);
-            Add(next_T_as_byte, next_T_as_byte, swap_channel_token_i16_idxs, N_C_PER_BLOCK);
-
-            Gather(next_L, lens, next_T_as_byte.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK);
-            Gather(register_bins.ReinterpretCast<int16_t>(), enc, next_T_as_byte.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK); // [enc c0, enc c1, enc c2]
-            Gather(next_Enc_16, register_bins.ReinterpretCast<int16_t>(), duplicating_gather_i16_idxs.ReinterpretCast<uint32_t>(), 0, 2 * N_C_PER_BLOCK); // [x, enc c0, x, enc c1, ... ]
-            uint64_t mul_mask[1] = {0xAAAAAAAAAAAAAAAA}; // Every other element for 64
-            Muls(next_Enc_16, next_Enc_16, static_cast<int16_t>(0), mul_mask, 1, {1, 1, 8, 8}); // [0, enc c0, 0, enc c1, ... ]
-
-            // Note various endian-ness complexities that come into play with ReinterpretCast. Represented as u32:
-            // Logical order
-            // |               Symbol 0             |               Symbol 1             |
-            // | Byte 0 | Byte 1 | Byte 2 | Bytes 3 | Byte 0 | Byte 1 | Byte 2 | Bytes 3 |
-            // |   0    |   0    |   0    | Enc --- |   0    |   0    |   0    | Enc --- | Right aligned
-            //
-            // - Shift left 8 aligns to i16 boundary
-            // - Shift left another slot_write_h aligns to write h
-            //
-            // The per symbol shift is achieved with a multiplication by 2^n. Gathering those factors needs a
-            // x sizeof(int32) to convert to a byte offset into an int32 tensor
-            Adds(register_bins.ReinterpretCast<int16_t>(), slot_write_h, static_cast<int16_t>(8), N_C_PER_BLOCK);
-            Muls(register_bins.ReinterpretCast<int16_t>(), register_bins.ReinterpretCast<int16_t>(), static_cast<int16_t>(sizeof(int32_t)), N_C_PER_BLOCK);
-            Cast(register_bins.ReinterpretCast<half>(), register_bins.ReinterpretCast<int16_t>(), RoundMode::CAST_NONE, N_C_PER_BLOCK);
-            Cast(register_bins_2, register_bins.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
-            Gather(shift_factor, p2s_32_arr, register_bins_2.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK);
-
-            // next_Enc_32 is int32 (to support muls). What does this mean when shifting a 1 into the m.s.b?
-            // Rather than rely on undocumented overflow behaviour this shifts by (n - 1) and unconditionally
-            // shifts left 1
-            Mul(next_Enc_32, next_Enc_32, shift_factor, N_C_PER_BLOCK);
-            ShiftLeft(next_Enc_32, next_Enc_32, 1, N_C_PER_BLOCK);
-
-            Gather(next_write_16, next_Enc_16, reducing_gather_i16_idxs.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK);
-            Or(current_out_slot, current_out_slot, next_write_16, N_C_PER_BLOCK);
-
-            // slot_write_h = slot_write_h - len // +ve => all written, 0 or -ve => full and maybe spill
-            Muls(register_bins.ReinterpretCast<int16_t>(), next_L, static_cast<int16_t>(-1), N_C_PER_BLOCK);
-            Add(slot_write_h, slot_write_h, register_bins.ReinterpretCast<int16_t>(), N_C_PER_BLOCK);
-
-            // Overflow len = Max(-slot_write_h, 0);
-            Muls(register_bins.ReinterpretCast<int16_t>(), slot_write_h, static_cast<int16_t>(-1), N_C_PER_BLOCK);
-            Maxs(pending_len_16, register_bins.ReinterpretCast<int16_t>(), static_cast<int16_t>(0), N_C_PER_BLOCK);
-
-            // Correct write_h to boundary
-            Maxs(slot_write_h, slot_write_h, static_cast<int16_t>(0), N_C_PER_BLOCK);
-            Cast(register_bins.ReinterpretCast<half>(), slot_write_h, RoundMode::CAST_NONE, N_C_PER_BLOCK);
-            Cast(register_bins_2, register_bins.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
-            CompareScalar(full, register_bins_2, 0, CMPMODE::EQ, 2 * N_C_PER_BLOCK);
-
-            ShiftLeft(next_Enc_32, next_Enc_32, 16, N_C_PER_BLOCK);
-            Gather(pending_enc_16, next_Enc_16, reducing_gather_i16_idxs.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK);
-
-            // Select with full & !complete - stay the same or change first time full
-            Not(tmp_conditional.ReinterpretCast<int16_t>(), complete.ReinterpretCast<int16_t>(), N_C_PER_BLOCK / sizeof(int16_t));
-            And(tmp_conditional.ReinterpretCast<int16_t>(), tmp_conditional.ReinterpretCast<int16_t>(), full.ReinterpretCast<int16_t>(), N_C_PER_BLOCK / sizeof(int16_t));
-            Select(overflow_Enc.ReinterpretCast<half>(), tmp_conditional, pending_enc_16.ReinterpretCast<half>(), overflow_Enc.ReinterpretCast<half>(), SELMODE::VSEL_TENSOR_TENSOR_MODE, N_C_PER_BLOCK);
-            Select(overflow_Len.ReinterpretCast<half>(),  tmp_conditional, pending_len_16.ReinterpretCast<half>(), overflow_Len.ReinterpretCast<half>(), SELMODE::VSEL_TENSOR_TENSOR_MODE, N_C_PER_BLOCK);
-
-            Or(tmp_conditional.ReinterpretCast<int16_t>(), full.ReinterpretCast<int16_t>(), complete.ReinterpretCast<int16_t>(), N_C_PER_BLOCK / sizeof(int16_t));
-
-            inner_done = tmp_conditional.ReinterpretCast<int32_t>()(0) == 0xffffffff;
+        Duplicate(complete.ReinterpretCast<int16_t>(), static_cast<int16_t>(0), 256 / (8 * sizeof(int16_t)));
+
+        CreateVecIndex(current_T_read_h, 0, N_C_PER_BLOCK);
+        Muls(current_T_read_h, current_T_read_h, static_cast<int32_t>(sizeof(int16_t)), N_C_PER_BLOCK);
+        Adds(current_T_read_h, current_T_read_h, N_C_PER_BLOCK * static_cast<int32_t>(s_ii * sizeof(int16_t)), N_C_PER_BLOCK);
+
+        CreateVecIndex(n_t_bcast, 0, N_C_PER_BLOCK);
+        Muls(n_t_bcast, n_t_bcast, static_cast<int32_t>(sizeof(int16_t)), N_C_PER_BLOCK);
+        Adds(n_t_bcast, n_t_bcast, N_C_PER_BLOCK * static_cast<int32_t>(last_token * sizeof(int16_t)), N_C_PER_BLOCK);
+
+        // Outer loop runs until all tokens are encoded
+        Compare(end, n_t_bcast, current_T_read_h, CMPMODE::EQ, 256 / sizeof(int32_t));
+        bool outer_done = false;
+        while (!outer_done) {
+            Duplicate(current_out_slot, static_cast<int16_t>(0), N_C_PER_BLOCK);
+            Duplicate(slot_write_h, static_cast<int16_t>(16), N_C_PER_BLOCK);
+
+            // Handle overflow from previous iteration
+            Or(current_out_slot, current_out_slot, overflow_Enc, N_C_PER_BLOCK);
+            Muls(overflow_Len, overflow_Len, static_cast<int16_t>(-1), N_C_PER_BLOCK);
+            Add(slot_write_h, slot_write_h, overflow_Len, N_C_PER_BLOCK);
+
+            Duplicate(overflow_Enc, static_cast<int16_t>(0), N_C_PER_BLOCK);
+            Duplicate(overflow_Len, static_cast<int16_t>(0), N_C_PER_BLOCK);
+            Duplicate(full.ReinterpretCast<int16_t>(), static_cast<int16_t>(0), N_C_PER_BLOCK / (8 * sizeof(int16_t)));
+
+            // Inner loop until current buffers are full (or all tokens are encoded)
+            bool inner_done = false;
+            while(!(inner_done)) {
+                Or(complete.ReinterpretCast<int16_t>(), end.ReinterpretCast<int16_t>(), full.ReinterpretCast<int16_t>(), N_C_PER_BLOCK / sizeof(int16_t));
+
+                Gather(next_T, cast_input_i16, current_T_read_h.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK);
+
+                Adds(current_T_read_h_tmp, current_T_read_h, token_stride, N_C_PER_BLOCK);
+
+                Compare(end, n_t_bcast, current_T_read_h, CMPMODE::EQ, 256 / sizeof(int32_t));
+                Or(tmp_conditional.ReinterpretCast<int16_t>(), end.ReinterpretCast<int16_t>(), complete.ReinterpretCast<int16_t>(), N_C_PER_BLOCK / sizeof(int16_t));
+                Select(current_T_read_h.ReinterpretCast<float>(), tmp_conditional, current_T_read_h.ReinterpretCast<float>(), current_T_read_h_tmp.ReinterpretCast<float>(), SELMODE::VSEL_TENSOR_TENSOR_MODE, N_C_PER_BLOCK);
+
+                // Next_T as byte offset in lens and encs (including channel offsets)
+                Cast(register_bins.ReinterpretCast<half>(), next_T, RoundMode::CAST_NONE, N_C_PER_BLOCK);
+                Cast(next_T_as_byte, register_bins.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
+                Muls(next_T_as_byte, next_T_as_byte, 2, N_C_PER_BLOCK);
+                Add(next_T_as_byte, next_T_as_byte, swap_channel_token_i16_idxs, N_C_PER_BLOCK);
+
+                Gather(next_L, lens, next_T_as_byte.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK);
+                Gather(register_bins.ReinterpretCast<int16_t>(), enc, next_T_as_byte.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK); // [enc c0, enc c1, enc c2]
+                Gather(next_Enc_16, register_bins.ReinterpretCast<int16_t>(), duplicating_gather_i16_idxs.ReinterpretCast<uint32_t>(), 0, 2 * N_C_PER_BLOCK); // [x, enc c0, x, enc c1, ... ]
+                uint64_t mul_mask[1] = {0xAAAAAAAAAAAAAAAA}; // Every other element for 64
+                Muls(next_Enc_16, next_Enc_16, static_cast<int16_t>(0), mul_mask, 1, {1, 1, 8, 8}); // [0, enc c0, 0, enc c1, ... ]
+
+                // Note various endian-ness complexities that come into play with ReinterpretCast. Represented as u32:
+                // Logical order
+                // |               Symbol 0             |               Symbol 1             |
+                // | Byte 0 | Byte 1 | Byte 2 | Bytes 3 | Byte 0 | Byte 1 | Byte 2 | Bytes 3 |
+                // |   0    |   0    |   0    | Enc --- |   0    |   0    |   0    | Enc --- | Right aligned
+                //
+                // - Shift left 8 aligns to i16 boundary
+                // - Shift left another slot_write_h aligns to write h
+                //
+                // The per symbol shift is achieved with a multiplication by 2^n. Gathering those factors needs a
+                // x sizeof(int32) to convert to a byte offset into an int32 tensor
+                Adds(register_bins.ReinterpretCast<int16_t>(), slot_write_h, static_cast<int16_t>(8), N_C_PER_BLOCK);
+                Muls(register_bins.ReinterpretCast<int16_t>(), register_bins.ReinterpretCast<int16_t>(), static_cast<int16_t>(sizeof(int32_t)), N_C_PER_BLOCK);
+                Cast(register_bins.ReinterpretCast<half>(), register_bins.ReinterpretCast<int16_t>(), RoundMode::CAST_NONE, N_C_PER_BLOCK);
+                Cast(register_bins_2, register_bins.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
+                Gather(shift_factor, p2s_32_arr, register_bins_2.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK);
+
+                // next_Enc_32 is int32 (to support muls). What does this mean when shifting a 1 into the m.s.b?
+                // Rather than rely on undocumented overflow behaviour this shifts by (n - 1) and unconditionally
+                // shifts left 1
+                Mul(next_Enc_32, next_Enc_32, shift_factor, N_C_PER_BLOCK);
+                ShiftLeft(next_Enc_32, next_Enc_32, 1, N_C_PER_BLOCK);
+
+                Gather(next_write_16, next_Enc_16, reducing_gather_i16_idxs.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK);
+                Or(current_out_slot, current_out_slot, next_write_16, N_C_PER_BLOCK);
+
+                // slot_write_h = slot_write_h - len // +ve => all written, 0 or -ve => full and maybe spill
+                Muls(register_bins.ReinterpretCast<int16_t>(), next_L, static_cast<int16_t>(-1), N_C_PER_BLOCK);
+                Add(slot_write_h, slot_write_h, register_bins.ReinterpretCast<int16_t>(), N_C_PER_BLOCK);
+
+                // Overflow len = Max(-slot_write_h, 0);
+                Muls(register_bins.ReinterpretCast<int16_t>(), slot_write_h, static_cast<int16_t>(-1), N_C_PER_BLOCK);
+                Maxs(pending_len_16, register_bins.ReinterpretCast<int16_t>(), static_cast<int16_t>(0), N_C_PER_BLOCK);
+
+                // Correct write_h to boundary
+                Maxs(slot_write_h, slot_write_h, static_cast<int16_t>(0), N_C_PER_BLOCK);
+                Cast(register_bins.ReinterpretCast<half>(), slot_write_h, RoundMode::CAST_NONE, N_C_PER_BLOCK);
+                Cast(register_bins_2, register_bins.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
+                CompareScalar(full, register_bins_2, 0, CMPMODE::EQ, 2 * N_C_PER_BLOCK);
+
+                ShiftLeft(next_Enc_32, next_Enc_32, 16, N_C_PER_BLOCK);
+                Gather(pending_enc_16, next_Enc_16, reducing_gather_i16_idxs.ReinterpretCast<uint32_t>(), 0, N_C_PER_BLOCK);
+
+                // Select with full & !complete - stay the same or change first time full
+                Not(tmp_conditional.ReinterpretCast<int16_t>(), complete.ReinterpretCast<int16_t>(), N_C_PER_BLOCK / sizeof(int16_t));
+                And(tmp_conditional.ReinterpretCast<int16_t>(), tmp_conditional.ReinterpretCast<int16_t>(), full.ReinterpretCast<int16_t>(), N_C_PER_BLOCK / sizeof(int16_t));
+                Select(overflow_Enc.ReinterpretCast<half>(), tmp_conditional, pending_enc_16.ReinterpretCast<half>(), overflow_Enc.ReinterpretCast<half>(), SELMODE::VSEL_TENSOR_TENSOR_MODE, N_C_PER_BLOCK);
+                Select(overflow_Len.ReinterpretCast<half>(),  tmp_conditional, pending_len_16.ReinterpretCast<half>(), overflow_Len.ReinterpretCast<half>(), SELMODE::VSEL_TENSOR_TENSOR_MODE, N_C_PER_BLOCK);
+
+                Or(tmp_conditional.ReinterpretCast<int16_t>(), full.ReinterpretCast<int16_t>(), complete.ReinterpretCast<int16_t>(), N_C_PER_BLOCK / sizeof(int16_t));
+
+                inner_done = tmp_conditional.ReinterpretCast<int32_t>()(0) == 0xffffffff;
+            }
+
+            Copy(tmp_out[current_write_h * N_C_PER_BLOCK], current_out_slot.ReinterpretCast<uint16_t>(), 32, 1, {1, 1, 8, 8});
+            ++current_write_h;
+
+            // note, init out len to 2
+            Adds(register_bins.ReinterpretCast<int16_t>(), lens_out, static_cast<int16_t>(2), N_C_PER_BLOCK);
+            Select(lens_out.ReinterpretCast<half>(),  end, lens_out.ReinterpretCast<half>(), register_bins.ReinterpretCast<half>(), SELMODE::VSEL_TENSOR_TENSOR_MODE, N_C_PER_BLOCK);
+            uint32_t full_i = full.ReinterpretCast<uint32_t>()(0);
+            uint32_t end_i = end.ReinterpretCast<uint32_t>()(0);
+            outer_done = (end_i & ~full_i) == 0xffffffff;
         }
 
+        // Handle final overflow
+        Duplicate(current_out_slot, static_cast<int16_t>(0), N_C_PER_BLOCK);
+        Or(current_out_slot, current_out_slot, overflow_Enc, N_C_PER_BLOCK);
         Copy(tmp_out[current_write_h * N_C_PER_BLOCK], current_out_slot.ReinterpretCast<uint16_t>(), 32, 1, {1, 1, 8, 8});
-        ++current_write_h;
+        Cast(overflow_Len.ReinterpretCast<half>(), overflow_Len, RoundMode::CAST_NONE, N_C_PER_BLOCK);
+        half zero = 0.;
+        CompareScalar(tmp_conditional, overflow_Len.ReinterpretCast<half>(), zero , CMPMODE::EQ,  N_C_PER_BLOCK);
+        Not(tmp_conditional.ReinterpretCast<int16_t>(), tmp_conditional.ReinterpretCast<int16_t>(), N_C_PER_BLOCK / sizeof(int16_t));
 
-        // note, init out len to 2
         Adds(register_bins.ReinterpretCast<int16_t>(), lens_out, static_cast<int16_t>(2), N_C_PER_BLOCK);
-        Select(lens_out.ReinterpretCast<half>(),  end, lens_out.ReinterpretCast<half>(), register_bins.ReinterpretCast<half>(), SELMODE::VSEL_TENSOR_TENSOR_MODE, N_C_PER_BLOCK);
-        uint32_t full_i = full.ReinterpretCast<uint32_t>()(0);
-        uint32_t end_i = end.ReinterpretCast<uint32_t>()(0);
-        outer_done = (end_i & ~full_i) == 0xffffffff;
+        Select(lens_out.ReinterpretCast<half>(),  tmp_conditional, lens_out.ReinterpretCast<half>(), register_bins.ReinterpretCast<half>(), SELMODE::VSEL_TENSOR_TENSOR_MODE, N_C_PER_BLOCK);
+        Cast(register_bins.ReinterpretCast<half>(), lens_out, RoundMode::CAST_NONE, N_C_PER_BLOCK);
+        Cast(sub_lens[s_ii * N_C_PER_BLOCK], register_bins.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
     }
 
-    // Handle final overflow
-    Duplicate(current_out_slot, static_cast<int16_t>(0), N_C_PER_BLOCK);
-    Or(current_out_slot, current_out_slot, overflow_Enc, N_C_PER_BLOCK);
-    Copy(tmp_out[current_write_h * N_C_PER_BLOCK], current_out_slot.ReinterpretCast<uint16_t>(), 32, 1, {1, 1, 8, 8});
-    Cast(overflow_Len.ReinterpretCast<half>(), overflow_Len, RoundMode::CAST_NONE, N_C_PER_BLOCK);
-    half zero = 0.;
-    CompareScalar(tmp_conditional, overflow_Len.ReinterpretCast<half>(), zero , CMPMODE::EQ,  N_C_PER_BLOCK);
-    Not(tmp_conditional.ReinterpretCast<int16_t>(), tmp_conditional.ReinterpretCast<int16_t>(), N_C_PER_BLOCK / sizeof(int16_t));
-
-    Adds(register_bins.ReinterpretCast<int16_t>(), lens_out, static_cast<int16_t>(2), N_C_PER_BLOCK);
-    Select(lens_out.ReinterpretCast<half>(),  tmp_conditional, lens_out.ReinterpretCast<half>(), register_bins.ReinterpretCast<half>(), SELMODE::VSEL_TENSOR_TENSOR_MODE, N_C_PER_BLOCK);
+    // Sub-streams are packed back to back, the channel length is their sum
+    Duplicate(sub_offsets, 0, N_C_PER_BLOCK);
+    for (int32_t s_ii = 1; s_ii < n_sub_streams; ++s_ii) {
+        Add(sub_offsets[s_ii * N_C_PER_BLOCK], sub_offsets[(s_ii - 1) * N_C_PER_BLOCK], sub_lens[(s_ii - 1) * N_C_PER_BLOCK], N_C_PER_BLOCK);
+    }
+    Add(lens_out_32.ReinterpretCast<int32_t>(), sub_offsets[(n_sub_streams - 1) * N_C_PER_BLOCK], sub_lens[(n_sub_streams - 1) * N_C_PER_BLOCK], N_C_PER_BLOCK);
 
     // Gather together the encode bytes for each channel
-    auto offset_to_layer = layer_id * n_channels * N_T_MAX;
-    auto offset_into_layer = channel_start_id * N_T_MAX;
-    auto base_offset = offset_to_layer + offset_into_layer;
+    auto offset_to_row = static_cast<uint64_t>(row_id) * n_channels * N_T_MAX;
+    auto offset_into_row = channel_start_id * N_T_MAX;
+    auto base_offset = offset_to_row + offset_into_row;
     auto encode_cum_len = 0;
     for (int32_t c_ii = 0; c_ii < N_C_PER_BLOCK; ++c_ii) {
         Gather(bytestream_out_i16[(N_T_MAX / 2) * c_ii], tmp_out, swap_channel_token_i16_idxs.ReinterpretCast<uint32_t>(), sizeof(half) * c_ii, N_T_MAX/2);
@@ -1049,30 +1333,59 @@ __aicore__ inline void PacEncoder::encode(int layer_id, int channel_start_id) {
     // --------
     // Phase: Copy out packing the byte streams together
     // --------
-    Cast(register_bins.ReinterpretCast<half>(), lens_out, RoundMode::CAST_NONE, N_C_PER_BLOCK);
-    Cast(lens_out_32.ReinterpretCast<int32_t>(), register_bins.ReinterpretCast<half>(), RoundMode::CAST_RINT, N_C_PER_BLOCK);
-
     PipeBarrier<PIPE_ALL>();
     DataSyncBarrier<MemDsbT::ALL>();
-    for (int32_t c_ii = 0; c_ii < N_C_PER_BLOCK; ++c_ii) {
-        DataCopy(g_out_bytes[base_offset + encode_cum_len], bytestream_out_i16.ReinterpretCast<uint8_t>()[N_T_MAX * c_ii], ceil_32(lens_out_32.GetValue(c_ii)));
-        encode_cum_len += lens_out_32.GetValue(c_ii);
-        PipeBarrier<PIPE_ALL>();
-        DataSyncBarrier<MemDsbT::ALL>();
+    uint32_t sub_stream_bytes = N_T_MAX / n_sub_streams;
+    int32_t n_valid = block_channels(n_channels, channel_start_id);
+    for (int32_t c_ii = 0; c_ii < n_valid; ++c_ii) {
+        for (int32_t s_ii = 0; s_ii < n_sub_streams; ++s_ii) {
+            uint32_t sub_len = sub_lens.GetValue(s_ii * N_C_PER_BLOCK + c_ii);
+            if (sub_len == 0) {
+                continue;
+            }
+            DataCopy(g_out_bytes[base_offset + encode_cum_len], bytestream_out_i16.ReinterpretCast<uint8_t>()[N_T_MAX * c_ii + sub_stream_bytes * s_ii], ceil_32(sub_len));
+            encode_cum_len += sub_len;
+            PipeBarrier<PIPE_ALL>();
+            DataSyncBarrier<MemDsbT::ALL>();
+        }
     }
     byteStreamOutQ.FreeTensor(bytestream_out_i16);
 
+    uint32_t valid_bytes = n_valid * sizeof(uint32_t);
+    if (n_sub_streams > 1) {
+        uint32_t src_stride = (N_C_PER_BLOCK * sizeof(uint32_t) - ceil_32(valid_bytes)) / DATABLOCK_BYTES;
+        uint32_t dst_stride = (n_channels - n_valid) * sizeof(uint32_t);
+        DataCopyExtParams sub_offsets_params = {static_cast<uint16_t>(n_sub_streams), valid_bytes, src_stride, dst_stride, 0};
+        DataCopyPad(g_sub_offsets[row_id * n_sub_streams * n_channels + channel_start_id], sub_offsets.ReinterpretCast<uint32_t>(), sub_offsets_params);
+    }
+
+    // Lengths go out as uint64, the rectifier turns them into 64 bit offsets in place. Every length as both
+    // words, the high ones cleared
+    auto lens_out_64 = lens_out_32[N_C_PER_BLOCK].ReinterpretCast<int32_t>();
+    uint64_t high_words_mask[1] = {0xAAAAAAAAAAAAAAAA};
+    Gather(lens_out_64, lens_out_32.ReinterpretCast<int32_t>(), widen_u32_idxs.ReinterpretCast<uint32_t>(), 0, 2 * N_C_PER_BLOCK);
+    Muls(lens_out_64, lens_out_64, 0, high_words_mask, 1, {1, 1, 8, 8});
+
     lensOutQ.EnQue(lens_out_32);
     lens_out_32 = lensOutQ.DeQue<uint32_t>();
-    DataCopy(g_out_lens[layer_id * n_channels + channel_start_id], lens_out_32, N_C_PER_BLOCK);
+    DataCopyExtParams lens_params = {1, static_cast<uint32_t>(n_valid * sizeof(uint64_t)), 0, 0, 0};
+    DataCopyPad(g_out_lens[2 * (row_id * n_channels + channel_start_id)], lens_out_32[N_C_PER_BLOCK], lens_params);
     lensOutQ.FreeTensor(lens_out_32);
 }
 
+// Lengths are widened to 64 bit offsets N_WIDEN_SPAN channels at a time
+constexpr int32_t N_WIDEN_SPAN = N_C_MAX / 2;
+
+// Channel blocks compact() stages per core between two syncs, they fit calcBuf after the bounds of a block
+constexpr int32_t N_COMPACT_BLOCKS = 7;
+static_assert(2 * (N_C_PER_BLOCK + 1) * sizeof(uint32_t) + DATABLOCK_BYTES + N_COMPACT_BLOCKS * N_T_PER_BATCH <= 0x10000);
+
 class PacEncoderRectifier {
 public:
     __aicore__ inline PacEncoderRectifier(
         GM_ADDR out_bytes, // Out bytes [n_layers, n_channels, batch_size], uint8
-        GM_ADDR out_lens, // Out lengths [n_layers, n_channels], uint32
+        GM_ADDR out_lens, // Out lengths [n_layers, n_channels], uint64
+        GM_ADDR workspace, // SyncAll area [N_AIV_MAX, 8] followed by layer totals [n_layers, 8], int32
 
         TPipe& pipe,
 
@@ -1080,19 +1393,33 @@ public:
         int32_t n_layers,
         int32_t n_channels,
         uint32_t n_bins,
-        int32_t chunk_size);
+        int32_t chunk_size,
+        int32_t core_idx,
+        int32_t n_cores);
 
+    // Collective, every launched core has to call it
     __aicore__ inline void rectify();
 
 private:
+    __aicore__ inline void sync();
+    __aicore__ inline void layer_prefix_sum(int32_t layer_id);
+    __aicore__ inline void offset_layers();
+    __aicore__ inline void compact();
+    // Reads the low words of a layer's uint64 lengths into scan
+    __aicore__ inline void load_layer(int32_t layer_id);
+    // Writes the cumulative lengths in scan as uint64 offsets past base into the layer's lengths. total is the
+    // largest of them, their low words carry into the high ones at most once
+    __aicore__ inline void store_layer(int32_t layer_id, uint64_t base, uint32_t total);
 
-    // Output Queues
-    TQueBind<TPosition::VECIN, TPosition::VECOUT, 2> byteStreamBoundQ;
     GlobalTensor<uint8_t> g_in_out_bytes;
 
-    TQue<TPosition::VECIN, 2> lensInQ;
-    TQue<TPosition::VECOUT, 2> lensOutQ;
-    GlobalTensor<uint32_t> g_in_out_lens;
+    TQue<TPosition::VECIN, 1> lensInQ;
+    TQue<TPosition::VECOUT, 1> lensOutQ;
+    GlobalTensor<uint32_t> g_in_out_lens; // Low and high word of every length
+
+    // Cross core state
+    GlobalTensor<int32_t> g_sync;
+    GlobalTensor<uint32_t> g_layer_totals; // Last 8 in-layer cumulative lengths of each layer, total is the 8th
 
     TPipe& pipe;
 
@@ -1103,8 +1430,18 @@ private:
     uint32_t n_bins;
     int32_t chunk_size;
 
+    int32_t n_c_blocks;
+
+    int32_t core_idx;
+    int32_t n_cores;
+
     // Intermediate buffers
     TBuf<TPosition::VECCALC> calcBuf; // For transient (per rectify) intermediates
+    TBuf<TPosition::VECCALC> scanBuf; // Lengths of a layer as int32 and the tables to widen them
+    TBuf<TPosition::VECCALC> syncBuf; // SyncAll UB workspace
+
+    LocalTensor<int32_t> scan; // DB_ELEMS + N_C_MAX [0, ... 0 | lengths of a layer ]
+    LocalTensor<int32_t> widen_u32_idxs; // 2 * N_WIDEN_SPAN [0, 0, 4, 4, 8, 8, ... ] - every u32 as both words of a u64
 
     // Class has no known need to support move or copy operations
     PacEncoderRectifier(const PacEncoderRectifier&) = delete;
@@ -1115,129 +1452,284 @@ private:
 __aicore__ inline PacEncoderRectifier::PacEncoderRectifier(
     GM_ADDR out_bytes,
     GM_ADDR out_lens,
+    GM_ADDR workspace,
     TPipe& _pipe,
     int32_t n_tokens,
     int32_t n_layers,
     int32_t n_channels,
     uint32_t n_bins,
-    int32_t chunk_size):
+    int32_t chunk_size,
+    int32_t core_idx,
+    int32_t n_cores):
         pipe(_pipe),
         n_tokens(n_tokens),
         n_layers(n_layers),
         n_channels(n_channels),
         n_bins(n_bins),
-        chunk_size(chunk_size) {
-    g_in_out_bytes.SetGlobalBuffer(reinterpret_cast<__gm__ uint8_t*>(out_bytes), n_layers * n_channels * chunk_size);
-    g_in_out_lens.SetGlobalBuffer(reinterpret_cast<__gm__ uint32_t*>(out_lens), n_layers * n_channels);
+        chunk_size(chunk_size),
+        n_c_blocks((n_channels + N_C_PER_BLOCK - 1) / N_C_PER_BLOCK),
+        core_idx(core_idx),
+        n_cores(n_cores) {
+    g_in_out_bytes.SetGlobalBuffer(reinterpret_cast<__gm__ uint8_t*>(out_bytes), static_cast<uint64_t>(n_layers) * n_channels * chunk_size);
+    g_in_out_lens.SetGlobalBuffer(reinterpret_cast<__gm__ uint32_t*>(out_lens), 2 * n_layers * n_channels);
+
+    constexpr int32_t SYNC_ALL_COUNT = N_AIV_MAX * DATABLOCK_BYTES / sizeof(int32_t);
+    g_sync.SetGlobalBuffer(reinterpret_cast<__gm__ int32_t*>(workspace), SYNC_ALL_COUNT);
+    g_layer_totals.SetGlobalBuffer(reinterpret_cast<__gm__ uint32_t*>(workspace) + SYNC_ALL_COUNT,
+        n_layers * DATABLOCK_BYTES / sizeof(uint32_t));
 
-    pipe.InitBuffer(byteStreamBoundQ, 2, N_T_PER_BATCH);
-    pipe.InitBuffer(lensInQ, 2, N_C_MAX * sizeof(int32_t));
-    pipe.InitBuffer(lensOutQ, 2, N_C_MAX * sizeof(int32_t));
+    pipe.InitBuffer(lensInQ, 1, N_C_MAX * sizeof(uint64_t));
+    pipe.InitBuffer(lensOutQ, 1, N_C_MAX * sizeof(uint64_t));
 
     uint32_t calc_buf_sz_aligned = 0x10000;
     pipe.InitBuffer(calcBuf, calc_buf_sz_aligned);
-}
-
-__aicore__ inline void PacEncoderRectifier::rectify() {
-    uint32_t calc_buf_offset = 0;
-    uint32_t boundaries_per_layer = n_channels / N_C_PER_BLOCK;
-    uint32_t boundaries_per_layer_aligned = ceil_32(n_channels / N_C_PER_BLOCK);
-    uint32_t boundaries_count = boundaries_per_layer_aligned * n_layers;
-    uint32_t boundaries_sz = ceil_32(boundaries_count * sizeof(int32_t));
-    LocalTensor<uint32_t> boundaries = calcBuf.GetWithOffset<uint32_t>(boundaries_count, calc_buf_offset);
-    calc_buf_offset += boundaries_sz;
-
-    uint32_t boundaries_gather_idxs_count = n_channels / N_C_PER_BLOCK;
-    uint32_t boundaries_gather_idxs_count_aligned = ceil_32(n_channels / N_C_PER_BLOCK);
-    uint32_t boundaries_gather_idxs_sz = ceil_32(boundaries_gather_idxs_count_aligned * sizeof(int32_t));
-    LocalTensor<int32_t> boundaries_gather_idxs = calcBuf.GetWithOffset<int32_t>(boundaries_gather_idxs_count_aligned, calc_buf_offset);
-    calc_buf_offset += boundaries_gather_idxs_sz;
-    CreateVecIndex(boundaries_gather_idxs, 0, boundaries_gather_idxs_count_aligned);
-    Muls(boundaries_gather_idxs, boundaries_gather_idxs, 4 * N_C_PER_BLOCK, boundaries_gather_idxs_count_aligned);
-
-    uint32_t last = 0; // Correction between layers
-    for (auto l_ii = 0; l_ii < n_layers; ++l_ii) {
-        LocalTensor<int32_t> lens_in = lensInQ.AllocTensor<int32_t>();
+    pipe.InitBuffer(syncBuf, N_AIV_MAX * DATABLOCK_BYTES);
 
-        DataCopy(lens_in.ReinterpretCast<uint32_t>(), g_in_out_lens[l_ii * n_channels], n_channels);
+    constexpr int32_t DB_ELEMS = DATABLOCK_BYTES / sizeof(int32_t);
+    uint32_t scan_sz = ceil_32((DB_ELEMS + N_C_MAX) * sizeof(int32_t));
+    uint32_t widen_u32_idxs_sz = ceil_32(2 * N_WIDEN_SPAN * sizeof(int32_t));
+    pipe.InitBuffer(scanBuf, scan_sz + widen_u32_idxs_sz);
+    scan = scanBuf.GetWithOffset<int32_t>(DB_ELEMS + N_C_MAX, 0);
+    widen_u32_idxs = scanBuf.GetWithOffset<int32_t>(2 * N_WIDEN_SPAN, scan_sz);
 
-        lensInQ.EnQue(lens_in);
-        lens_in = lensInQ.DeQue<int32_t>();
+    Duplicate(scan, 0, DB_ELEMS);
+    CreateVecIndex(widen_u32_idxs, -1, 2 * N_WIDEN_SPAN); // -1, 0, 1, 2, ...
+    uint64_t everyother_mask[1] = {0x5555555555555555}; // Every other element for 64
+    Adds(widen_u32_idxs, widen_u32_idxs, 1, everyother_mask, 2 * N_WIDEN_SPAN / 64, {1, 1, 8, 8}); // 0, 0, 2, 2, 4, 4
+    Muls(widen_u32_idxs, widen_u32_idxs, static_cast<int32_t>(sizeof(uint32_t) / sizeof(uint16_t)), 2 * N_WIDEN_SPAN);
+}
 
-        LocalTensor<int32_t> lens_out = lensOutQ.AllocTensor<int32_t>();
-        Cast(lens_out.ReinterpretCast<float>(), lens_in, RoundMode::CAST_NONE, n_channels);
-        auto lens_out_f = lens_out.ReinterpretCast<float>();
-        lensInQ.FreeTensor(lens_in);
+__aicore__ inline void PacEncoderRectifier::sync() {
+    LocalTensor<int32_t> sync_local = syncBuf.Get<int32_t>();
+    PipeBarrier<PIPE_ALL>();
+    SyncAll(g_sync, sync_local, n_cores);
+}
 
-        // CumSum internally applies for memory, for stability invoke it with a fixed size avoiding complexity
-        // with variable n_channels requiring different footprints
-        auto elem_idx = 0;
-        uint32_t sum_span = 128;
-        float prev_last_f = 0.; // Corrections within a layer
-        for (; (elem_idx + sum_span) <= n_channels; elem_idx += sum_span) {
-            auto lens_out_f_span = lens_out_f[elem_idx];
-            float first = lens_out_f_span.GetValue(0);
-            lens_out_f_span.SetValue(0, prev_last_f + first);
+__aicore__ inline void PacEncoderRectifier::load_layer(int32_t layer_id) {
+    constexpr int32_t DB_ELEMS = DATABLOCK_BYTES / sizeof(int32_t);
+    LocalTensor<int32_t> lens_in = lensInQ.AllocTensor<int32_t>();
 
-            static constexpr CumSumConfig cum_sum_cfg = {true, true, false};
-            CumSumInfo cum_sum_info = {1, sum_span};
-            CumSum<float, cum_sum_cfg>(lens_out_f_span, lens_out_f_span, lens_out_f_span, cum_sum_info);
+    DataCopyExtParams lens_params = {1, static_cast<uint32_t>(n_channels * sizeof(uint64_t)), 0, 0, 0};
+    DataCopyPadExtParams<uint32_t> pad_params = {false, 0, 0, 0};
+    DataCopyPad(lens_in.ReinterpretCast<uint32_t>(), g_in_out_lens[2 * layer_id * n_channels], lens_params, pad_params);
 
-            prev_last_f = lens_out_f_span.GetValue(sum_span - 1);
-        }
+    lensInQ.EnQue(lens_in);
+    lens_in = lensInQ.DeQue<int32_t>();
 
-        // Handle tail for when n_channels % sum_span != 0
-        if (elem_idx < n_channels) {
-            auto lens_out_f_span = lens_out_f[elem_idx];
-            float first = lens_out_f_span.GetValue(0);
-            lens_out_f_span.SetValue(0, prev_last_f + first);
-            uint32_t cum_sum_tail = n_channels - elem_idx;
+    // A layer sums to at most N_C_MAX * N_T_MAX, the low words alone are exact in int32
+    uint64_t _rsvd = 0;
+    GatherMaskParams gmp = {
+        1, // src0BlockStride. 1 - Continuous data
+        static_cast<uint8_t>((2 * n_channels + 63) / 64),
+        8, // src0RepeatStride - Continuous Data
+        0 // src1RepeatStride - not used
+    };
+    GatherMask(scan[DB_ELEMS], lens_in, 1, false, 0, gmp, _rsvd);
+    lensInQ.FreeTensor(lens_in);
+}
 
-            static constexpr CumSumConfig cum_sum_cfg = {true, true, false};
-            CumSumInfo cum_sum_info = {1, cum_sum_tail};
-            CumSum<float, cum_sum_cfg>(lens_out_f_span, lens_out_f_span, lens_out_f_span, cum_sum_info);
+__aicore__ inline void PacEncoderRectifier::store_layer(int32_t layer_id, uint64_t base, uint32_t total) {
+    constexpr int32_t DB_ELEMS = DATABLOCK_BYTES / sizeof(int32_t);
+    LocalTensor<int32_t> lens_out = lensOutQ.AllocTensor<int32_t>();
+
+    // Every length as both words of a uint64. The low words wrap past base's, the high ones are base's plus one
+    // from the first length that wraps: cum >= 2^32 - low word of base, a 0 / 1 step as clamp(cum - that + 1)
+    uint32_t base_low = static_cast<uint32_t>(base);
+    int32_t base_high = static_cast<int32_t>(base >> 32);
+    bool carries = static_cast<uint64_t>(base_low) + total > 0xFFFFFFFFULL;
+    int32_t carry_step = carries ? static_cast<int32_t>(1 - static_cast<int64_t>(0x100000000LL - base_low)) : 0;
+    uint64_t low_words_mask[1] = {0x5555555555555555};
+    uint64_t high_words_mask[1] = {0xAAAAAAAAAAAAAAAA};
+    UnaryRepeatParams pair_params = {1, 1, 8, 8};
+    for (int32_t span_start = 0; span_start < n_channels; span_start += N_WIDEN_SPAN) {
+        int32_t n_span = n_channels - span_start < N_WIDEN_SPAN ? n_channels - span_start : N_WIDEN_SPAN;
+        auto pairs = lens_out[2 * span_start];
+        uint8_t pair_repeats = static_cast<uint8_t>((2 * n_span + 63) / 64);
+        uint32_t span_offset = (DB_ELEMS + span_start) * sizeof(int32_t);
+        Gather(pairs, scan, widen_u32_idxs.ReinterpretCast<uint32_t>(), span_offset, 2 * n_span);
+        Adds(pairs, pairs, static_cast<int32_t>(base_low), low_words_mask, pair_repeats, pair_params);
+        if (carries) {
+            Adds(pairs, pairs, carry_step, high_words_mask, pair_repeats, pair_params);
+            Maxs(pairs, pairs, 0, high_words_mask, pair_repeats, pair_params);
+            Mins(pairs, pairs, 1, high_words_mask, pair_repeats, pair_params);
+        } else {
+            Muls(pairs, pairs, 0, high_words_mask, pair_repeats, pair_params);
         }
+        Adds(pairs, pairs, base_high, high_words_mask, pair_repeats, pair_params);
+    }
 
+    lensOutQ.EnQue(lens_out);
+    lens_out = lensOutQ.DeQue<int32_t>();
+    DataCopyExtParams lens_params = {1, static_cast<uint32_t>(n_channels * sizeof(uint64_t)), 0, 0, 0};
+    DataCopyPad(g_in_out_lens[2 * layer_id * n_channels], lens_out.ReinterpretCast<uint32_t>(), lens_params);
+    lensOutQ.FreeTensor(lens_out);
+}
 
-        Cast(lens_out, lens_out.ReinterpretCast<float>(), RoundMode::CAST_RINT, n_channels);
-
-        Adds(lens_out, lens_out, static_cast<int32_t>(last), n_channels);
-        last = lens_out.GetValue(n_channels - 1);
-
-        Gather(boundaries[l_ii * boundaries_per_layer_aligned], lens_out.ReinterpretCast<uint32_t>(), boundaries_gather_idxs.ReinterpretCast<uint32_t>(), 4 * (N_C_PER_BLOCK - 1), boundaries_per_layer);
+// Per layer cumulative lengths, written back in place. The layer total is published for the other cores.
+// Integer throughout, a Hillis-Steele scan: each step adds the sum ending shift channels before, gathered with
+// channels before the first reading the zeros in front of the lengths
+__aicore__ inline void PacEncoderRectifier::layer_prefix_sum(int32_t layer_id) {
+    constexpr int32_t DB_ELEMS = DATABLOCK_BYTES / sizeof(int32_t);
+    load_layer(layer_id);
 
-        lensOutQ.EnQue(lens_out);
-        lens_out = lensOutQ.DeQue<int32_t>();
-        DataCopy(g_in_out_lens[l_ii * n_channels], lens_out.ReinterpretCast<uint32_t>(), n_channels);
-        lensOutQ.FreeTensor(lens_out);
+    uint32_t calc_buf_offset = 0;
+    uint32_t lens_sz = ceil_32(N_C_MAX * sizeof(int32_t));
+    LocalTensor<int32_t> shifted = calcBuf.GetWithOffset<int32_t>(N_C_MAX, calc_buf_offset);
+    calc_buf_offset += lens_sz;
+    LocalTensor<int32_t> shift_idxs = calcBuf.GetWithOffset<int32_t>(N_C_MAX, calc_buf_offset);
+
+    auto lens = scan[DB_ELEMS];
+    for (int32_t shift = 1; shift < n_channels; shift *= 2) {
+        CreateVecIndex(shift_idxs, DB_ELEMS - shift, n_channels);
+        Maxs(shift_idxs, shift_idxs, DB_ELEMS - 1, n_channels);
+        Muls(shift_idxs, shift_idxs, static_cast<int32_t>(sizeof(int32_t)), n_channels);
+        Gather(shifted, scan, shift_idxs.ReinterpretCast<uint32_t>(), 0, n_channels);
+        Add(lens, lens, shifted, n_channels);
     }
 
-    for (auto l_ii = 0; l_ii < n_layers; ++l_ii) {
-        for ( auto c_ii = 0; c_ii < n_channels; c_ii += N_C_PER_BLOCK) {
-            auto c_batch_ii = c_ii / N_C_PER_BLOCK;
-
-            LocalTensor<uint8_t> enc_bytes = byteStreamBoundQ.AllocTensor<uint8_t>();
-            DataCopy(enc_bytes, g_in_out_bytes[l_ii * n_channels * N_T_MAX + c_ii * N_T_MAX], N_T_PER_BATCH);
-            byteStreamBoundQ.EnQue(enc_bytes);
-            enc_bytes = byteStreamBoundQ.DeQue<uint8_t>();
+    PipeBarrier<PIPE_ALL>();
+    uint32_t total = lens.GetValue(n_channels - 1);
+    store_layer(layer_id, 0, total);
 
-            auto offset = 0;
-            if (c_batch_ii != 0) {
-                offset = boundaries(l_ii * boundaries_per_layer_aligned + c_batch_ii - 1);
-            } else if (l_ii != 0) {
-                offset = boundaries((l_ii - 1) * boundaries_per_layer_aligned + boundaries_per_layer - 1);
-            } // else c_batch == 0 and l_ii == 0 => leave offset as 0
+    // n_channels need not be a multiple of a data block, publish the total from a data block of its own
+    LocalTensor<int32_t> layer_total = calcBuf.GetWithOffset<int32_t>(DB_ELEMS, 0);
+    Duplicate(layer_total, static_cast<int32_t>(total), DB_ELEMS);
+    PipeBarrier<PIPE_ALL>();
+    DataCopy(g_layer_totals[layer_id * DB_ELEMS], layer_total.ReinterpretCast<uint32_t>(), DB_ELEMS);
+}
 
-            PipeBarrier<PIPE_ALL>();
-            DataSyncBarrier<MemDsbT::ALL>();
-            DataCopy(g_in_out_bytes[offset], enc_bytes, N_T_PER_BATCH);
+// Shift this core's layers by the total length of all the layers before them, in 64 bit
+__aicore__ inline void PacEncoderRectifier::offset_layers() {
+    constexpr int32_t DB_ELEMS = DATABLOCK_BYTES / sizeof(uint32_t);
+    LocalTensor<uint32_t> layer_totals = calcBuf.GetWithOffset<uint32_t>(n_layers * DB_ELEMS, 0);
+    DataCopy(layer_totals, g_layer_totals, n_layers * DB_ELEMS);
+    PipeBarrier<PIPE_ALL>();
 
-            byteStreamBoundQ.FreeTensor(enc_bytes);
+    uint64_t base = 0;
+    for (auto l_ii = 0; l_ii < n_layers; ++l_ii) {
+        uint32_t total = layer_totals.GetValue(l_ii * DB_ELEMS + DB_ELEMS - 1);
+        if (l_ii % n_cores == core_idx && base != 0) {
+            load_layer(l_ii);
+            store_layer(l_ii, base, total);
         }
+        base += total;
     }
 }
 
-} // namespace impl
+// Channel blocks are moved in place, in rounds of N_COMPACT_BLOCKS blocks per core. A block only ever moves
+// towards the start and ends before its own source slot does, so it can overwrite the sources of blocks before it
+// on any core. Sources are only safe to overwrite once their core holds them in UB, which the sync after the loads
+// of a round guarantees: a round can only overwrite sources of its own round or of earlier, already moved ones.
+// Every round stages its blocks in calcBuf, so there is one sync per N_COMPACT_BLOCKS * n_cores blocks.
+__aicore__ inline void PacEncoderRectifier::compact() {
+    // [end of the channel before the block | ends of the channels of this block], low and high words
+    uint32_t bounds_sz = ceil_32(2 * (N_C_PER_BLOCK + 1) * sizeof(uint32_t));
+    LocalTensor<uint32_t> bounds = calcBuf.GetWithOffset<uint32_t>(2 * (N_C_PER_BLOCK + 1), 0);
+    DataCopyPadExtParams<uint32_t> pad_params = {false, 0, 0, 0};
+
+    int32_t n_blocks = n_layers * n_c_blocks;
+    int32_t round_blocks = N_COMPACT_BLOCKS * n_cores;
+    int32_t n_rounds = (n_blocks + round_blocks - 1) / round_blocks;
+    for (auto r_ii = 0; r_ii < n_rounds; ++r_ii) {
+        uint64_t starts[N_COMPACT_BLOCKS];
+        uint64_t ends[N_COMPACT_BLOCKS];
+        for (auto k_ii = 0; k_ii < N_COMPACT_BLOCKS; ++k_ii) {
+            starts[k_ii] = 0;
+            ends[k_ii] = 0;
+            int32_t block_id = r_ii * round_blocks + k_ii * n_cores + core_idx;
+            if (block_id >= n_blocks) {
+                continue;
+            }
+            int32_t channel_start_id = (block_id % n_c_blocks) * N_C_PER_BLOCK;
+            int32_t first_idx = (block_id / n_c_blocks) * n_channels + channel_start_id;
+            int32_t n_valid = block_channels(n_channels, channel_start_id);
+            int32_t n_bounds = first_idx == 0 ? n_valid : n_valid + 1;
+            DataCopyExtParams bounds_params = {1, static_cast<uint32_t>(n_bounds * sizeof(uint64_t)), 0, 0, 0};
+            DataCopyPad(bounds, g_in_out_lens[2 * (first_idx + n_valid - n_bounds)], bounds_params, pad_params);
+
+            LocalTensor<uint8_t> enc_bytes = calcBuf.GetWithOffset<uint8_t>(N_T_PER_BATCH, bounds_sz + k_ii * N_T_PER_BATCH);
+            DataCopy(enc_bytes, g_in_out_bytes[static_cast<uint64_t>(first_idx) * N_T_MAX], n_valid * N_T_MAX);
+
+            PipeBarrier<PIPE_ALL>();
+            if (first_idx != 0) {
+                starts[k_ii] = (static_cast<uint64_t>(bounds.GetValue(1)) << 32) | bounds.GetValue(0);
+            }
+            ends[k_ii] = (static_cast<uint64_t>(bounds.GetValue(2 * n_bounds - 1)) << 32) | bounds.GetValue(2 * n_bounds - 2);
+        }
+
+        sync();
+
+        for (auto k_ii = 0; k_ii < N_COMPACT_BLOCKS; ++k_ii) {
+            if (ends[k_ii] > starts[k_ii]) {
+                LocalTensor<uint8_t> enc_bytes = calcBuf.GetWithOffset<uint8_t>(N_T_PER_BATCH, bounds_sz + k_ii * N_T_PER_BATCH);
+                DataCopyExtParams copy_params = {1, static_cast<uint32_t>(ends[k_ii] - starts[k_ii]), 0, 0, 0};
+                DataCopyPad(g_in_out_bytes[starts[k_ii]], enc_bytes, copy_params);
+            }
+        }
+        // The next round's loads reuse the staging slots
+        PipeBarrier<PIPE_ALL>();
+    }
+}
+
+__aicore__ inline void PacEncoderRectifier::rectify() {
+    for (auto l_ii = core_idx; l_ii < n_layers; l_ii += n_cores) {
+        layer_prefix_sum(l_ii);
+    }
+    sync();
+
+    offset_layers();
+    sync();
+
+    compact();
+}
+
+// Tail of every encode kernel: waits for all cores' encodes, then rectifies the encoded rows. Collective, every
+// launched core has to call it
+__aicore__ inline void sync_and_rectify(
+    TPipe& pipe,
+    GM_ADDR out_bytes,
+    GM_ADDR out_lens,
+    GM_ADDR workspace,
+    int32_t n_tokens,
+    int32_t n_layers,
+    int32_t n_channels,
+    uint32_t n_bins,
+    int32_t chunk_size,
+    int32_t core_idx,
+    int32_t n_cores) {
+    pipe.Reset();
+
+    GlobalTensor<int32_t> syncAllGM;
+    auto DEFAULT_SYNCALL_NEED_SIZE = 32 / sizeof(int32_t);
+    syncAllGM.SetGlobalBuffer(reinterpret_cast<__gm__ int32_t*>(workspace), N_AIV_MAX * DEFAULT_SYNCALL_NEED_SIZE);
+
+    TQue<AscendC::TPosition::VECIN, 1> workQueue;
+    pipe.InitBuffer(workQueue, 1, N_AIV_MAX * 32);
+    LocalTensor<int32_t> workLocal = workQueue.AllocTensor<int32_t>();
+
+    SyncAll(syncAllGM, workLocal, n_cores);
+    workQueue.FreeTensor(workLocal);
+
+    pipe.Reset();
+
+    // Every batch of a layer is a row of its own to the rectifier
+    int32_t n_rows = n_layers * ((n_tokens + N_T_MAX - 1) / N_T_MAX);
+    PacEncoderRectifier rectifier {out_bytes,
+        out_lens,
+        workspace,
+        pipe,
+        n_tokens,
+        n_rows,
+        n_channels,
+        n_bins,
+        chunk_size,
+        core_idx,
+        n_cores};
+
+    rectifier.rectify();
+}
+
+} // namespace impl
 } // namespace pac_coder
 } // namespace kvcache_ops
 
@@ -1246,11 +1738,15 @@ extern "C" __global__ __aicore__ void pac_encode_kernel (
     GM_ADDR meta_data_ptr,
     GM_ADDR output_data_ptr,
     GM_ADDR output_lengths_data_ptr,
+    GM_ADDR sub_offsets_ptr,
+    GM_ADDR raw_bits_ptr,
     const uint32_t n_bins,
     const int n_tokens,
     const int n_layers,
     const int n_channels,
     const int chunk_size,
+    const int n_sub_streams,
+    const int pred_group,
     const float scale_factor,
     GM_ADDR workGM_ptr
 ) {
@@ -1266,15 +1762,20 @@ extern "C" __global__ __aicore__ void pac_encode_kernel (
             meta_data_ptr,
             output_data_ptr,
             output_lengths_data_ptr,
+            sub_offsets_ptr,
+            raw_bits_ptr,
             pipe,
             n_tokens,
             n_layers,
             n_channels,
             n_bins,
             chunk_size,
+            n_sub_streams,
+            pred_group,
             static_cast<half>(scale_factor)};
 
-        int max_work_idx = n_layers * n_channels / kvcache_ops::pac_coder::N_C_PER_BLOCK;
+        int n_c_blocks = (n_channels + kvcache_ops::pac_coder::N_C_PER_BLOCK - 1) / kvcache_ops::pac_coder::N_C_PER_BLOCK;
+        int max_work_idx = n_layers * n_c_blocks;
         for (int work_idx = coreIdx; work_idx < max_work_idx; work_idx += launchedCores) {
             int layer_id = work_idx % n_layers;
             int channel_id = kvcache_ops::pac_coder::N_C_PER_BLOCK * (work_idx / n_layers);
@@ -1282,33 +1783,244 @@ extern "C" __global__ __aicore__ void pac_encode_kernel (
         }
     }
 
-    pipe.Reset();
+    kvcache_ops::pac_coder::impl::sync_and_rectify(pipe,
+        output_data_ptr,
+        output_lengths_data_ptr,
+        workGM_ptr,
+        n_tokens,
+        n_layers,
+        n_channels,
+        n_bins,
+        chunk_size,
+        coreIdx,
+        launchedCores);
+}
 
-    GlobalTensor<int32_t> syncAllGM;
-    auto DEFAULT_SYNCALL_NEED_SIZE = 32 / sizeof(int32_t);
-    syncAllGM.SetGlobalBuffer(reinterpret_cast<__gm__ int32_t*>(workGM_ptr), 40 * DEFAULT_SYNCALL_NEED_SIZE);
+// pac_prep_enc_metadata_kernel and pac_encode_kernel in one launch, see PacEncoder::encode_with_meta
+extern "C" __global__ __aicore__ void pac_encode_with_meta_kernel (
+    GM_ADDR input_data_ptr,
+    GM_ADDR meta_data_ptr,
+    GM_ADDR output_data_ptr,
+    GM_ADDR output_lengths_data_ptr,
+    GM_ADDR sub_offsets_ptr,
+    GM_ADDR raw_bits_ptr,
+    const uint32_t n_bins,
+    const int n_tokens,
+    const int n_layers,
+    const int n_channels,
+    const int chunk_size,
+    const int n_sub_streams,
+    const int pred_group,
+    const float scale_factor,
+    GM_ADDR workGM_ptr
+) {
+    TPipe pipe{};
+    int32_t coreIdx = GetBlockIdx();
+    int32_t launchedCores = GetBlockNum();
 
-    TQue<AscendC::TPosition::VECIN, 1> workQueue;
-    pipe.InitBuffer(workQueue, 1, 40 * 32);
-    LocalTensor<int32_t> workLocal = workQueue.AllocTensor<int32_t>();
+    KERNEL_TASK_TYPE_DEFAULT(KERNEL_TYPE_AIV_ONLY);
 
-    SyncAll(syncAllGM, workLocal, launchedCores);
-    workQueue.FreeTensor(workLocal);
+    {
+        kvcache_ops::pac_coder::impl::PacEncoder encoder {
+            input_data_ptr,
+            meta_data_ptr,
+            output_data_ptr,
+            output_lengths_data_ptr,
+            sub_offsets_ptr,
+            raw_bits_ptr,
+            pipe,
+            n_tokens,
+            n_layers,
+            n_channels,
+            n_bins,
+            chunk_size,
+            n_sub_streams,
+            pred_group,
+            static_cast<half>(scale_factor)};
 
-    pipe.Reset();
+        int n_c_blocks = (n_channels + kvcache_ops::pac_coder::N_C_PER_BLOCK - 1) / kvcache_ops::pac_coder::N_C_PER_BLOCK;
+        int max_work_idx = n_layers * n_c_blocks;
+        for (int work_idx = coreIdx; work_idx < max_work_idx; work_idx += launchedCores) {
+            int layer_id = work_idx % n_layers;
+            int channel_id = kvcache_ops::pac_coder::N_C_PER_BLOCK * (work_idx / n_layers);
+            encoder.encode_with_meta(layer_id, channel_id);
+        }
+    }
 
-    if (coreIdx == 0) {
-        kvcache_ops::pac_coder::impl::PacEncoderRectifier rectifier {output_data_ptr,
+    kvcache_ops::pac_coder::impl::sync_and_rectify(pipe,
+        output_data_ptr,
+        output_lengths_data_ptr,
+        workGM_ptr,
+        n_tokens,
+        n_layers,
+        n_channels,
+        n_bins,
+        chunk_size,
+        coreIdx,
+        launchedCores);
+}
+
+// pac_encode_with_meta_kernel over n_chunks chunks of the same n_layers and n_channels in one launch. The
+// (chunk, layer, block) work items of all chunks are spread over the cores, the chunks are rectified one after another
+extern "C" __global__ __aicore__ void pac_encode_batched_kernel (
+    GM_ADDR desc_ptr,
+    GM_ADDR chunk_tokens_ptr,
+    const uint32_t n_bins,
+    const int n_tokens_max,
+    const int n_chunks,
+    const int n_layers,
+    const int n_channels,
+    const int chunk_size,
+    const int n_sub_streams,
+    const int pred_group,
+    GM_ADDR workGM_ptr
+) {
+    TPipe pipe{};
+    int32_t coreIdx = GetBlockIdx();
+    int32_t launchedCores = GetBlockNum();
+
+    KERNEL_TASK_TYPE_DEFAULT(KERNEL_TYPE_AIV_ONLY);
+
+    constexpr int32_t desc_words = kvcache_ops::pac_coder::PAC_ENC_DESC_WORDS;
+    GlobalTensor<uint64_t> gm_desc;
+    gm_desc.SetGlobalBuffer(reinterpret_cast<__gm__ uint64_t*>(desc_ptr), n_chunks * desc_words);
+    GlobalTensor<int32_t> gm_chunk_tokens;
+    gm_chunk_tokens.SetGlobalBuffer(reinterpret_cast<__gm__ int32_t*>(chunk_tokens_ptr), n_chunks);
+
+    int n_c_blocks = (n_channels + kvcache_ops::pac_coder::N_C_PER_BLOCK - 1) / kvcache_ops::pac_coder::N_C_PER_BLOCK;
+    int chunk_work_items = n_layers * n_c_blocks;
+    int max_work_idx = n_chunks * chunk_work_items;
+
+    int work_idx = kvcache_ops::pac_coder::impl::next_chunk_work(
+        gm_chunk_tokens, coreIdx, max_work_idx, chunk_work_items, launchedCores, n_tokens_max);
+    if (work_idx < max_work_idx) {
+        // The encoder is only re-pointed when a core crosses into the next chunk
+        int loaded_chunk = work_idx / chunk_work_items;
+        int n_tokens = gm_chunk_tokens.GetValue(loaded_chunk);
+        kvcache_ops::pac_coder::impl::PacEncoder encoder {
+            kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, loaded_chunk, 0),
+            kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, loaded_chunk, 1),
+            kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, loaded_chunk, 2),
+            kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, loaded_chunk, 3),
+            kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, loaded_chunk, 4),
+            kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, loaded_chunk, 5),
+            pipe,
+            n_tokens,
+            n_layers,
+            n_channels,
+            n_bins,
+            chunk_size,
+            n_sub_streams,
+            pred_group,
+            static_cast<half>(static_cast<float>(kvcache_ops::pac_coder::N_T_MAX - kvcache_ops::pac_coder::N_B_MAX) / n_tokens)};
+
+        for (; work_idx < max_work_idx; work_idx = kvcache_ops::pac_coder::impl::next_chunk_work(
+                gm_chunk_tokens, work_idx + launchedCores, max_work_idx, chunk_work_items, launchedCores, n_tokens_max)) {
+            int chunk_id = work_idx / chunk_work_items;
+            if (chunk_id != loaded_chunk) {
+                n_tokens = gm_chunk_tokens.GetValue(chunk_id);
+                encoder.set_chunk(
+                    kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, chunk_id, 0),
+                    kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, chunk_id, 1),
+                    kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, chunk_id, 2),
+                    kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, chunk_id, 3),
+                    kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, chunk_id, 4),
+                    kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, chunk_id, 5),
+                    n_tokens,
+                    static_cast<half>(static_cast<float>(kvcache_ops::pac_coder::N_T_MAX - kvcache_ops::pac_coder::N_B_MAX) / n_tokens));
+                loaded_chunk = chunk_id;
+            }
+            int chunk_work_idx = work_idx % chunk_work_items;
+            int layer_id = chunk_work_idx % n_layers;
+            int channel_id = kvcache_ops::pac_coder::N_C_PER_BLOCK * (chunk_work_idx / n_layers);
+            encoder.encode_with_meta(layer_id, channel_id);
+        }
+    }
+
+    // The chunks share the workspace and are rectified one after another. Every core reads the same n_tokens, so
+    // all of them skip the same chunks of the collective
+    for (int chunk_id = 0; chunk_id < n_chunks; chunk_id++) {
+        int n_tokens = gm_chunk_tokens.GetValue(chunk_id);
+        if (!kvcache_ops::pac_coder::impl::chunk_tokens_valid(n_tokens, n_tokens_max)) {
+            continue;
+        }
+        kvcache_ops::pac_coder::impl::sync_and_rectify(pipe,
+            kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, chunk_id, 2),
+            kvcache_ops::pac_coder::impl::chunk_desc_addr(gm_desc, desc_words, chunk_id, 3),
+            workGM_ptr,
+            n_tokens,
+            n_layers,
+            n_channels,
+            n_bins,
+            chunk_size,
+            coreIdx,
+            launchedCores);
+    }
+}
+
+// pac_encode_kernel from cached tables, re-derived per block as needed, see PacEncoder::encode_adaptive
+extern "C" __global__ __aicore__ void pac_encode_adaptive_kernel (
+    GM_ADDR input_data_ptr,
+    GM_ADDR meta_data_ptr,
+    GM_ADDR output_data_ptr,
+    GM_ADDR output_lengths_data_ptr,
+    GM_ADDR sub_offsets_ptr,
+    GM_ADDR raw_bits_ptr,
+    const uint32_t n_bins,
+    const int n_tokens,
+    const int n_layers,
+    const int n_channels,
+    const int chunk_size,
+    const int n_sub_streams,
+    const int pred_group,
+    const float scale_factor,
+    const int cost_limit,
+    GM_ADDR workGM_ptr
+) {
+    TPipe pipe{};
+    int32_t coreIdx = GetBlockIdx();
+    int32_t launchedCores = GetBlockNum();
+
+    KERNEL_TASK_TYPE_DEFAULT(KERNEL_TYPE_AIV_ONLY);
+
+    {
+        kvcache_ops::pac_coder::impl::PacEncoder encoder {
+            input_data_ptr,
+            meta_data_ptr,
+            output_data_ptr,
             output_lengths_data_ptr,
+            sub_offsets_ptr,
+            raw_bits_ptr,
             pipe,
             n_tokens,
             n_layers,
             n_channels,
             n_bins,
-            chunk_size};
+            chunk_size,
+            n_sub_streams,
+            pred_group,
+            static_cast<half>(scale_factor)};
 
-        rectifier.rectify();
+        int n_c_blocks = (n_channels + kvcache_ops::pac_coder::N_C_PER_BLOCK - 1) / kvcache_ops::pac_coder::N_C_PER_BLOCK;
+        int max_work_idx = n_layers * n_c_blocks;
+        for (int work_idx = coreIdx; work_idx < max_work_idx; work_idx += launchedCores) {
+            int layer_id = work_idx % n_layers;
+            int channel_id = kvcache_ops::pac_coder::N_C_PER_BLOCK * (work_idx / n_layers);
+            encoder.encode_adaptive(layer_id, channel_id, cost_limit);
+        }
     }
+
+    kvcache_ops::pac_coder::impl::sync_and_rectify(pipe,
+        output_data_ptr,
+        output_lengths_data_ptr,
+        workGM_ptr,
+        n_tokens,
+        n_layers,
+        n_channels,
+        n_bins,
+        chunk_size,
+        coreIdx,
+        launchedCores);
 }
 
 extern "C" __global__ __aicore__ void pac_prep_enc_metadata_kernel (
@@ -1318,6 +2030,7 @@ extern "C" __global__ __aicore__ void pac_prep_enc_metadata_kernel (
     const int n_tokens,
     const int n_layers,
     const int n_channels,
+    const int pred_group,
     const float scale_factor
 ) {
     TPipe pipe{};
@@ -1332,15 +2045,20 @@ extern "C" __global__ __aicore__ void pac_prep_enc_metadata_kernel (
             meta_data_ptr,
             NULL,
             NULL,
+            NULL,
+            NULL,
             pipe,
             n_tokens,
             n_layers,
             n_channels,
             n_bins,
             -1,
+            1,
+            pred_group,
             static_cast<half>(scale_factor)};
 
-        int max_work_idx = n_layers * n_channels / kvcache_ops::pac_coder::N_C_PER_BLOCK;
+        int n_c_blocks = (n_channels + kvcache_ops::pac_coder::N_C_PER_BLOCK - 1) / kvcache_ops::pac_coder::N_C_PER_BLOCK;
+        int max_work_idx = n_layers * n_c_blocks;
         for (int work_idx = coreIdx; work_idx < max_work_idx; work_idx += launchedCores) {
             int layer_id = work_idx % n_layers;
             int channel_id = kvcache_ops::pac_coder::N_C_PER_BLOCK * (work_idx / n_layers);
@@ -1349,14 +2067,75 @@ extern "C" __global__ __aicore__ void pac_prep_enc_metadata_kernel (
     }
 }
 
+extern "C" __global__ __aicore__ void pac_estimate_kernel (
+    GM_ADDR input_data_ptr,
+    GM_ADDR output_bits_ptr,
+    const uint32_t n_bins,
+    const int n_tokens,
+    const int n_layers,
+    const int n_channels,
+    const int n_sub_streams,
+    const int pred_group,
+    const float scale_factor
+) {
+    TPipe pipe{};
+    int32_t coreIdx = GetBlockIdx();
+    int32_t launchedCores = GetBlockNum();
+
+    KERNEL_TASK_TYPE_DEFAULT(KERNEL_TYPE_AIV_ONLY);
+
+    {
+        kvcache_ops::pac_coder::impl::PacEncoder encoder {
+            input_data_ptr,
+            NULL,
+            NULL,
+            output_bits_ptr,
+            NULL,
+            NULL,
+            pipe,
+            n_tokens,
+            n_layers,
+            n_channels,
+            n_bins,
+            -1,
+            n_sub_streams,
+            pred_group,
+            static_cast<half>(scale_factor)};
+
+        int n_c_blocks = (n_channels + kvcache_ops::pac_coder::N_C_PER_BLOCK - 1) / kvcache_ops::pac_coder::N_C_PER_BLOCK;
+        int max_work_idx = n_layers * n_c_blocks;
+        for (int work_idx = coreIdx; work_idx < max_work_idx; work_idx += launchedCores) {
+            int layer_id = work_idx % n_layers;
+            int channel_id = kvcache_ops::pac_coder::N_C_PER_BLOCK * (work_idx / n_layers);
+            encoder.estimate(layer_id, channel_id);
+        }
+    }
+}
+
 namespace kvcache_ops {
 namespace pac_coder {
 
+// Chunks of up to N_T_CHUNK_MAX tokens are encoded in n_batches = ceil(n_tokens / N_T_MAX) batches that share
+// the layer's tables. Each batch is a row of its own: output_lengths_data_ptr holds [n_layers, n_batches,
+// n_channels] cumulative lengths, uint64, so the end of the previous entry is where a batch's channel stream starts.
+// The offsets are summed in integers and are exact past 4 GB of output. output_data_ptr needs room for n_layers * n_batches * n_channels * N_T_MAX bytes before compaction.
+// workGM_ptr must be zero initialised and hold (N_AIV_MAX + n_layers * n_batches) * 32 bytes: the SyncAll area
+// followed by the per row totals exchanged by the rectifier cores.
+// n_sub_streams of 1, 2 or 4 splits the tokens of every channel round robin into independently decodable
+// sub-streams, their start offsets within the channel's stream go to sub_offsets_ptr [n_layers, n_batches,
+// n_sub_streams, n_channels], uint32. A single stream writes no offsets and is the plain format.
+// n_bins of 64, 128 or 256 codes the top 5 bits of every symbol and writes the low bits to raw_bits_ptr as bit
+// planes [n_layers, n_batches, ceil(n_channels / 32), n_raw_bits, N_RAW_PLANE_BYTES], uint8, see split_raw_bits().
+// pred_group other than PRED_NONE codes every symbol as its residual modulo n_bins against the previous token of its
+// channel (PRED_PREV) or against the first token of its group of pred_group tokens (a power of 2 from
+// PRED_GROUP_MIN to N_T_MAX), see predict_batch(). Batches stay independently decodable.
 void pac_encode(
     uint8_t* input_data_ptr,
     uint8_t* meta_data_ptr,
     uint8_t* output_data_ptr,
     uint8_t* output_lengths_data_ptr,
+    uint8_t* sub_offsets_ptr,
+    uint8_t* raw_bits_ptr,
     void* stream,
     const int n_aiv,
     const int n_bins,
@@ -1364,9 +2143,19 @@ void pac_encode(
     const int n_layers,
     const int n_channels,
     const int chunk_size,
+    const int n_sub_streams,
+    const int pred_group,
     uint8_t* workGM_ptr) {
 
-    int blockDim = n_layers * (n_channels / N_C_PER_BLOCK) < n_aiv ? n_layers * (n_channels / N_C_PER_BLOCK) : n_aiv;
+    check_pac_params(n_bins, n_sub_streams, pred_group, raw_bits_ptr != nullptr);
+
+    if (n_tokens < 1 || n_tokens > N_T_CHUNK_MAX) {
+        ASCENDC_REPORT_NOT_SUPPORT(false, "Unsupported number of PAC tokens.");
+        throw std::runtime_error("n_tokens: " + std::to_string(n_tokens) + " not supported.");
+    }
+
+    int n_c_blocks = (n_channels + N_C_PER_BLOCK - 1) / N_C_PER_BLOCK;
+    int blockDim = n_layers * n_c_blocks < n_aiv ? n_layers * n_c_blocks : n_aiv;
 
     float scale_factor = static_cast<half>(kvcache_ops::pac_coder::N_T_MAX) / static_cast<half>(n_tokens);
     pac_encode_kernel<<<blockDim, nullptr, stream>>>(
@@ -1374,15 +2163,252 @@ void pac_encode(
         meta_data_ptr,
         output_data_ptr,
         output_lengths_data_ptr,
+        sub_offsets_ptr,
+        raw_bits_ptr,
+        n_bins,
+        n_tokens,
+        n_layers,
+        n_channels,
+        chunk_size,
+        n_sub_streams,
+        pred_group,
+        scale_factor,
+        workGM_ptr);
+}
+
+void pac_encode(
+    uint8_t* input_data_ptr,
+    uint8_t* meta_data_ptr,
+    uint8_t* output_data_ptr,
+    uint8_t* output_lengths_data_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bins,
+    const int n_tokens,
+    const int n_layers,
+    const int n_channels,
+    const int chunk_size,
+    uint8_t* workGM_ptr) {
+    pac_encode(input_data_ptr, meta_data_ptr, output_data_ptr, output_lengths_data_ptr, nullptr, nullptr, stream,
+        n_aiv, n_bins, n_tokens, n_layers, n_channels, chunk_size, 1, PRED_NONE, workGM_ptr);
+}
+
+// pac_prep_enc_metadata() followed by pac_encode() as a single launch. meta_data_ptr is written, not read.
+// Same batching, workspace and sub-stream requirements as pac_encode().
+void pac_encode_with_meta(
+    uint8_t* input_data_ptr,
+    uint8_t* meta_data_ptr,
+    uint8_t* output_data_ptr,
+    uint8_t* output_lengths_data_ptr,
+    uint8_t* sub_offsets_ptr,
+    uint8_t* raw_bits_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bins,
+    const int n_tokens,
+    const int n_layers,
+    const int n_channels,
+    const int chunk_size,
+    const int n_sub_streams,
+    const int pred_group,
+    uint8_t* workGM_ptr) {
+
+    check_pac_params(n_bins, n_sub_streams, pred_group, raw_bits_ptr != nullptr);
+
+    if (n_tokens < 1 || n_tokens > N_T_CHUNK_MAX) {
+        ASCENDC_REPORT_NOT_SUPPORT(false, "Unsupported number of PAC tokens.");
+        throw std::runtime_error("n_tokens: " + std::to_string(n_tokens) + " not supported.");
+    }
+
+    int n_c_blocks = (n_channels + N_C_PER_BLOCK - 1) / N_C_PER_BLOCK;
+    int blockDim = n_layers * n_c_blocks < n_aiv ? n_layers * n_c_blocks : n_aiv;
+
+    float scale_factor = static_cast<half>(kvcache_ops::pac_coder::N_T_MAX - kvcache_ops::pac_coder::N_B_MAX) / static_cast<half>(n_tokens);
+    pac_encode_with_meta_kernel<<<blockDim, nullptr, stream>>>(
+        input_data_ptr,
+        meta_data_ptr,
+        output_data_ptr,
+        output_lengths_data_ptr,
+        sub_offsets_ptr,
+        raw_bits_ptr,
+        n_bins,
+        n_tokens,
+        n_layers,
+        n_channels,
+        chunk_size,
+        n_sub_streams,
+        pred_group,
+        scale_factor,
+        workGM_ptr);
+}
+
+void pac_encode_with_meta(
+    uint8_t* input_data_ptr,
+    uint8_t* meta_data_ptr,
+    uint8_t* output_data_ptr,
+    uint8_t* output_lengths_data_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bins,
+    const int n_tokens,
+    const int n_layers,
+    const int n_channels,
+    const int chunk_size,
+    uint8_t* workGM_ptr) {
+    pac_encode_with_meta(input_data_ptr, meta_data_ptr, output_data_ptr, output_lengths_data_ptr, nullptr, nullptr, stream,
+        n_aiv, n_bins, n_tokens, n_layers, n_channels, chunk_size, 1, PRED_NONE, workGM_ptr);
+}
+
+// pac_encode_with_meta() of n_chunks chunks in a single launch, for many short chunks that each fill only a few
+// cores. desc_ptr is a device array [n_chunks, PAC_ENC_DESC_WORDS] of uint64 device addresses, per chunk the
+// input_data_ptr, meta_data_ptr, output_data_ptr, output_lengths_data_ptr, sub_offsets_ptr and raw_bits_ptr of its
+// own pac_encode_with_meta() (unused ones may be 0). chunk_tokens_ptr is a device array [n_chunks] of int32, every
+// chunk's n_tokens, none past n_tokens_max. The chunks share n_layers, n_channels, n_bins, chunk_size, sub-streams
+// and prediction, each chunk's buffers and results are exactly those of its own pac_encode_with_meta(). workGM_ptr
+// is one workspace sized as pac_encode() for n_tokens_max. Chunks of n_tokens outside [1, n_tokens_max] are
+// skipped, their outputs are left untouched.
+void pac_encode_batched(
+    uint8_t* desc_ptr,
+    uint8_t* chunk_tokens_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bins,
+    const int n_tokens_max,
+    const int n_chunks,
+    const int n_layers,
+    const int n_channels,
+    const int chunk_size,
+    const int n_sub_streams,
+    const int pred_group,
+    uint8_t* workGM_ptr) {
+
+    check_pac_params(n_bins, n_sub_streams, pred_group);
+
+    if (n_tokens_max < 1 || n_tokens_max > N_T_CHUNK_MAX) {
+        ASCENDC_REPORT_NOT_SUPPORT(false, "Unsupported number of PAC tokens.");
+        throw std::runtime_error("n_tokens_max: " + std::to_string(n_tokens_max) + " not supported.");
+    }
+
+    if (n_chunks < 1) {
+        ASCENDC_REPORT_NOT_SUPPORT(false, "Unsupported number of PAC chunks.");
+        throw std::runtime_error("n_chunks: " + std::to_string(n_chunks) + " not supported.");
+    }
+
+    int n_c_blocks = (n_channels + N_C_PER_BLOCK - 1) / N_C_PER_BLOCK;
+    int64_t n_work_items = static_cast<int64_t>(n_chunks) * n_layers * n_c_blocks;
+    int blockDim = n_work_items < n_aiv ? static_cast<int>(n_work_items) : n_aiv;
+
+    pac_encode_batched_kernel<<<blockDim, nullptr, stream>>>(
+        desc_ptr,
+        chunk_tokens_ptr,
+        n_bins,
+        n_tokens_max,
+        n_chunks,
+        n_layers,
+        n_channels,
+        chunk_size,
+        n_sub_streams,
+        pred_group,
+        workGM_ptr);
+}
+
+void pac_encode_batched(
+    uint8_t* desc_ptr,
+    uint8_t* chunk_tokens_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bins,
+    const int n_tokens_max,
+    const int n_chunks,
+    const int n_layers,
+    const int n_channels,
+    const int chunk_size,
+    uint8_t* workGM_ptr) {
+    pac_encode_batched(desc_ptr, chunk_tokens_ptr, stream, n_aiv, n_bins, n_tokens_max, n_chunks, n_layers, n_channels,
+        chunk_size, 1, PRED_NONE, workGM_ptr);
+}
+
+// pac_encode() from the tables a previous chunk left in meta_data_ptr, e.g. by pac_encode_with_meta(). Every block
+// of N_C_PER_BLOCK channels is first measured against its cached tables, a block with a channel coding to more than
+// max_bits_per_symbol bits per token on average (raw bits not counted) or with a symbol its tables can't encode is
+// re-derived as pac_encode_with_meta() does and its tables in meta_data_ptr are overwritten. meta_data_ptr always
+// ends up holding the tables the chunk was encoded with. Same batching, workspace and sub-stream requirements as
+// pac_encode().
+void pac_encode_adaptive(
+    uint8_t* input_data_ptr,
+    uint8_t* meta_data_ptr,
+    uint8_t* output_data_ptr,
+    uint8_t* output_lengths_data_ptr,
+    uint8_t* sub_offsets_ptr,
+    uint8_t* raw_bits_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bins,
+    const int n_tokens,
+    const int n_layers,
+    const int n_channels,
+    const int chunk_size,
+    const int n_sub_streams,
+    const int pred_group,
+    const float max_bits_per_symbol,
+    uint8_t* workGM_ptr) {
+
+    check_pac_params(n_bins, n_sub_streams, pred_group, raw_bits_ptr != nullptr);
+
+    if (n_tokens < 1 || n_tokens > N_T_CHUNK_MAX) {
+        ASCENDC_REPORT_NOT_SUPPORT(false, "Unsupported number of PAC tokens.");
+        throw std::runtime_error("n_tokens: " + std::to_string(n_tokens) + " not supported.");
+    }
+
+    if (!(max_bits_per_symbol >= 0.0f)) {
+        ASCENDC_REPORT_NOT_SUPPORT(false, "Unsupported PAC metadata reuse threshold.");
+        throw std::runtime_error("max_bits_per_symbol: " + std::to_string(max_bits_per_symbol) + " not supported.");
+    }
+
+    int n_c_blocks = (n_channels + N_C_PER_BLOCK - 1) / N_C_PER_BLOCK;
+    int blockDim = n_layers * n_c_blocks < n_aiv ? n_layers * n_c_blocks : n_aiv;
+
+    float scale_factor = static_cast<half>(kvcache_ops::pac_coder::N_T_MAX - kvcache_ops::pac_coder::N_B_MAX) / static_cast<half>(n_tokens);
+    // No code is longer than 9 bits, past that only un-encodable symbols re-derive a block
+    int cost_limit = max_bits_per_symbol < 9.0f ? static_cast<int>(max_bits_per_symbol * n_tokens) : 9 * n_tokens;
+    pac_encode_adaptive_kernel<<<blockDim, nullptr, stream>>>(
+        input_data_ptr,
+        meta_data_ptr,
+        output_data_ptr,
+        output_lengths_data_ptr,
+        sub_offsets_ptr,
+        raw_bits_ptr,
         n_bins,
         n_tokens,
         n_layers,
         n_channels,
         chunk_size,
+        n_sub_streams,
+        pred_group,
         scale_factor,
+        cost_limit,
         workGM_ptr);
 }
 
+void pac_encode_adaptive(
+    uint8_t* input_data_ptr,
+    uint8_t* meta_data_ptr,
+    uint8_t* output_data_ptr,
+    uint8_t* output_lengths_data_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bins,
+    const int n_tokens,
+    const int n_layers,
+    const int n_channels,
+    const int chunk_size,
+    const float max_bits_per_symbol,
+    uint8_t* workGM_ptr) {
+    pac_encode_adaptive(input_data_ptr, meta_data_ptr, output_data_ptr, output_lengths_data_ptr, nullptr, nullptr, stream,
+        n_aiv, n_bins, n_tokens, n_layers, n_channels, chunk_size, 1, PRED_NONE, max_bits_per_symbol, workGM_ptr);
+}
+
+// pred_group has to match the pac_encode() the tables are for, they are tables of the residuals
 void pac_prep_enc_metadata(
     uint8_t* input_data_ptr,
     uint8_t* meta_data_ptr,
@@ -1391,9 +2417,13 @@ void pac_prep_enc_metadata(
     const int n_bins,
     const int n_tokens,
     const int n_layers,
-    const int n_channels) {
+    const int n_channels,
+    const int pred_group) {
+
+    check_pac_params(n_bins, 1, pred_group);
 
-    int blockDim = n_layers * (n_channels / N_C_PER_BLOCK) < n_aiv ? n_layers * (n_channels / N_C_PER_BLOCK) : n_aiv;
+    int n_c_blocks = (n_channels + N_C_PER_BLOCK - 1) / N_C_PER_BLOCK;
+    int blockDim = n_layers * n_c_blocks < n_aiv ? n_layers * n_c_blocks : n_aiv;
 
     float scale_factor = static_cast<half>(kvcache_ops::pac_coder::N_T_MAX - kvcache_ops::pac_coder::N_B_MAX) / static_cast<half>(n_tokens);
     pac_prep_enc_metadata_kernel<<<blockDim, nullptr, stream>>>(
@@ -1403,8 +2433,74 @@ void pac_prep_enc_metadata(
         n_tokens,
         n_layers,
         n_channels,
+        pred_group,
         scale_factor);
 }
 
+void pac_prep_enc_metadata(
+    uint8_t* input_data_ptr,
+    uint8_t* meta_data_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bins,
+    const int n_tokens,
+    const int n_layers,
+    const int n_channels) {
+    pac_prep_enc_metadata(input_data_ptr, meta_data_ptr, stream, n_aiv, n_bins, n_tokens, n_layers, n_channels, PRED_NONE);
+}
+
+// Estimates what pac_encode() with the same arguments would produce without running it, to choose between PAC,
+// pack_bits() and the raw symbols per chunk. output_bits_ptr receives [n_layers, n_channels] uint32, the bits of
+// every channel: its symbols under the tables pac_prep_enc_metadata() would build, the raw bit planes of n_bins past
+// N_B_MAX, its table of N_B_MAX uint16 and an upper bound of one uint16 slot per batch and sub-stream for the slot
+// rounding. The symbol bits are exact, the slot rounding may be over by up to 16 bits per batch and sub-stream.
+// Not counted are the lengths and sub-stream offsets. Costs the metadata pass and one more read of the chunk.
+void pac_estimate(
+    uint8_t* input_data_ptr,
+    uint8_t* output_bits_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bins,
+    const int n_tokens,
+    const int n_layers,
+    const int n_channels,
+    const int n_sub_streams,
+    const int pred_group) {
+
+    if (n_tokens < 1 || n_tokens > N_T_CHUNK_MAX) {
+        ASCENDC_REPORT_NOT_SUPPORT(false, "Unsupported number of PAC tokens.");
+        throw std::runtime_error("n_tokens: " + std::to_string(n_tokens) + " not supported.");
+    }
+
+    check_pac_params(n_bins, n_sub_streams, pred_group);
+
+    int n_c_blocks = (n_channels + N_C_PER_BLOCK - 1) / N_C_PER_BLOCK;
+    int blockDim = n_layers * n_c_blocks < n_aiv ? n_layers * n_c_blocks : n_aiv;
+
+    float scale_factor = static_cast<half>(kvcache_ops::pac_coder::N_T_MAX - kvcache_ops::pac_coder::N_B_MAX) / static_cast<half>(n_tokens);
+    pac_estimate_kernel<<<blockDim, nullptr, stream>>>(
+        input_data_ptr,
+        output_bits_ptr,
+        n_bins,
+        n_tokens,
+        n_layers,
+        n_channels,
+        n_sub_streams,
+        pred_group,
+        scale_factor);
+}
+
+void pac_estimate(
+    uint8_t* input_data_ptr,
+    uint8_t* output_bits_ptr,
+    void* stream,
+    const int n_aiv,
+    const int n_bins,
+    const int n_tokens,
+    const int n_layers,
+    const int n_channels) {
+    pac_estimate(input_data_ptr, output_bits_ptr, stream, n_aiv, n_bins, n_tokens, n_layers, n_channels, 1, PRED_NONE);
+}
+
 } // namespace pac_coder
-} // namespace kvcache_ops
\ No newline at end of file
+} // namespace kvcache_ops
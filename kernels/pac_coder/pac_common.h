@@ -0,0 +1,123 @@
+#ifndef PAC_COMMON_H
+#define PAC_COMMON_H
+
+#include "kernel_operator.h"
+#include <stdexcept>
+#include <string>
+
+namespace kvcache_ops {
+namespace pac_coder {
+
+// Layout shared by the PAC encoder and decoder: blocks of N_C_PER_BLOCK channels, each with a table of
+// N_B_MAX uint16 entries per channel
+constexpr int32_t DATABLOCK_BYTES = 32;
+constexpr int32_t N_C_PER_BLOCK = 32;
+static_assert(N_C_PER_BLOCK % DATABLOCK_BYTES == 0);
+
+// Some intializations and copy masks implicitly assume 32 channels - update as appropriate before changing this assert
+static_assert(N_C_PER_BLOCK == 32);
+
+constexpr int32_t N_DBs_PER_BLOCK = N_C_PER_BLOCK / DATABLOCK_BYTES; // Data blocks per copy block (assuming u8)
+
+constexpr int32_t N_B_MAX = 32;
+static_assert(N_B_MAX % 32 == 0);
+
+constexpr int32_t N_T_MAX = 256;
+static_assert(N_T_MAX % 256 == 0);
+
+// Longer chunks are encoded as batches of N_T_MAX tokens sharing the chunk's tables. Histogram counts
+// accumulate in half which is exact up to 2048.
+constexpr int32_t N_T_CHUNK_MAX = 2048;
+
+// The code space is 8 bits wide, more bins than N_B_MAX would leave no room to compress. Symbols of up to
+// N_RAW_BITS_MAX more bits code their top bits through the tables and carry the low bits raw as bit planes.
+// Below the top 5 bits of min-max quantized KV the low bits are close to uniform: coding all 6-8 bits would save
+// under 0.1 bit per symbol, less than the 2 bits per symbol a 256 entry table costs a 2048 token chunk.
+constexpr int32_t N_RAW_BITS_MAX = 3;
+
+// Tokens of a channel can be split round robin into this many independently decodable sub-streams
+constexpr int32_t N_SUB_STREAMS_MAX = 4;
+
+// Symbols can be coded as residuals against an earlier token of their channel, see PacEncoder::predict_batch().
+// PRED_PREV codes against the previous token, groups of PRED_GROUP_MIN up to N_T_MAX tokens against their first.
+constexpr int32_t PRED_NONE = 0;
+constexpr int32_t PRED_PREV = 1;
+constexpr int32_t PRED_GROUP_MIN = 4;
+
+// Host side check of the coding parameters shared by the pac_encode and pac_decode entry points. n_bins past
+// N_B_MAX carry raw bit planes, has_raw_bits is false when the call has no raw_bits_ptr for them.
+inline void check_pac_params(int n_bins, int n_sub_streams, int pred_group, bool has_raw_bits = true) {
+    if (n_sub_streams < 1 || n_sub_streams > N_SUB_STREAMS_MAX || N_SUB_STREAMS_MAX % n_sub_streams != 0) {
+        ASCENDC_REPORT_NOT_SUPPORT(false, "Unsupported number of PAC sub-streams.");
+        throw std::runtime_error("n_sub_streams: " + std::to_string(n_sub_streams) + " not supported.");
+    }
+
+    bool raw_bins = n_bins == (N_B_MAX << 1) || n_bins == (N_B_MAX << 2) || n_bins == (N_B_MAX << N_RAW_BITS_MAX);
+    if (n_bins < 1 || (n_bins > N_B_MAX && !raw_bins) || (raw_bins && !has_raw_bits)) {
+        ASCENDC_REPORT_NOT_SUPPORT(false, "Unsupported number of PAC bins.");
+        throw std::runtime_error("n_bins: " + std::to_string(n_bins) + " not supported.");
+    }
+
+    if (pred_group != PRED_NONE && pred_group != PRED_PREV &&
+            (pred_group < PRED_GROUP_MIN || pred_group > N_T_MAX || (pred_group & (pred_group - 1)) != 0)) {
+        ASCENDC_REPORT_NOT_SUPPORT(false, "Unsupported PAC prediction group.");
+        throw std::runtime_error("pred_group: " + std::to_string(pred_group) + " not supported.");
+    }
+}
+
+namespace impl {
+__aicore__ inline auto ceil_32(int32_t size) -> uint32_t {
+    return size % 32 == 0 ? size : 32 * (1 + (size / 32));
+};
+
+// Channels of the block starting at channel_start_id, fewer than N_C_PER_BLOCK for the tail block
+__aicore__ inline auto block_channels(int32_t n_channels, int32_t channel_start_id) -> int32_t {
+    return n_channels - channel_start_id < N_C_PER_BLOCK ? n_channels - channel_start_id : N_C_PER_BLOCK;
+};
+
+// Tables for the padding channels of a tail block: symbol 0 (the padding value) is a 1 bit code, every other
+// symbol is un-encodable, so an all zero stream decodes to symbol 0. Keeps the padding lanes well behaved, they
+// are never written out. The length 1 entries are the first lane of each padding channel's row, one repeat per row.
+__aicore__ inline auto fill_tail_meta(const AscendC::LocalTensor<uint16_t>& meta, int32_t n_valid) -> void {
+    AscendC::Duplicate(meta[n_valid * N_B_MAX], static_cast<uint16_t>(9), (N_C_PER_BLOCK - n_valid) * N_B_MAX);
+    AscendC::PipeBarrier<PIPE_V>();
+    constexpr uint8_t row_blocks = N_B_MAX * sizeof(uint16_t) / DATABLOCK_BYTES;
+    AscendC::Duplicate(meta[n_valid * N_B_MAX], static_cast<uint16_t>(1), static_cast<uint64_t>(1),
+        static_cast<uint8_t>(N_C_PER_BLOCK - n_valid), 1, row_blocks);
+    AscendC::PipeBarrier<PIPE_V>();
+};
+
+// Device address in word `word` of chunk chunk_id's descriptor, a row of desc_words uint64 addresses in the
+// desc_ptr array of a batched launch
+__aicore__ inline GM_ADDR chunk_desc_addr(
+    AscendC::GlobalTensor<uint64_t>& gm_desc, int32_t desc_words, int32_t chunk_id, int32_t word) {
+    return reinterpret_cast<GM_ADDR>(gm_desc.GetValue(chunk_id * desc_words + word));
+}
+
+// Batched launches skip the chunks whose n_tokens is outside [1, n_tokens_max], they would divide by zero or
+// overrun the buffers sized for n_tokens_max
+__aicore__ inline bool chunk_tokens_valid(int32_t n_tokens, int32_t n_tokens_max) {
+    return n_tokens >= 1 && n_tokens <= n_tokens_max;
+}
+
+// First work item from work_idx on, in steps of n_cores, of a chunk with valid n_tokens. max_work_idx if there is none
+__aicore__ inline int32_t next_chunk_work(
+    AscendC::GlobalTensor<int32_t>& gm_chunk_tokens,
+    int32_t work_idx,
+    int32_t max_work_idx,
+    int32_t chunk_work_items,
+    int32_t n_cores,
+    int32_t n_tokens_max) {
+    for (; work_idx < max_work_idx; work_idx += n_cores) {
+        if (chunk_tokens_valid(gm_chunk_tokens.GetValue(work_idx / chunk_work_items), n_tokens_max)) {
+            return work_idx;
+        }
+    }
+    return max_work_idx;
+}
+} // namespace impl
+
+} // namespace pac_coder
+} // namespace kvcache_ops
+
+#endif